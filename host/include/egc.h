@@ -0,0 +1,106 @@
+#ifndef EGC_H
+#define EGC_H
+
+/* Host stub of embedded-game-controller: the subset of its API used by input_device.c, with
+ * devices that are added, fed and inspected by hand through egc_stub_* */
+
+#include "types.h"
+
+#define EGC_GAMEPAD_TOUCH_RES 1024
+
+#define EGC_RUMBLE_OFF 0
+#define EGC_RUMBLE_MAX 255
+
+typedef enum {
+    EGC_GAMEPAD_BUTTON_SOUTH,
+    EGC_GAMEPAD_BUTTON_EAST,
+    EGC_GAMEPAD_BUTTON_WEST,
+    EGC_GAMEPAD_BUTTON_NORTH,
+    EGC_GAMEPAD_BUTTON_BACK,
+    EGC_GAMEPAD_BUTTON_GUIDE,
+    EGC_GAMEPAD_BUTTON_START,
+    EGC_GAMEPAD_BUTTON_LEFT_STICK,
+    EGC_GAMEPAD_BUTTON_RIGHT_STICK,
+    EGC_GAMEPAD_BUTTON_LEFT_SHOULDER,
+    EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER,
+    EGC_GAMEPAD_BUTTON_DPAD_UP,
+    EGC_GAMEPAD_BUTTON_DPAD_DOWN,
+    EGC_GAMEPAD_BUTTON_DPAD_LEFT,
+    EGC_GAMEPAD_BUTTON_DPAD_RIGHT,
+    EGC_GAMEPAD_BUTTON_MISC1,
+    EGC_GAMEPAD_BUTTON_RIGHT_PADDLE1,
+    EGC_GAMEPAD_BUTTON_LEFT_PADDLE1,
+    EGC_GAMEPAD_BUTTON_RIGHT_PADDLE2,
+    EGC_GAMEPAD_BUTTON_LEFT_PADDLE2,
+    EGC_GAMEPAD_BUTTON_TOUCHPAD,
+    EGC_GAMEPAD_BUTTON_COUNT
+} egc_gamepad_button_e;
+
+typedef enum {
+    EGC_GAMEPAD_AXIS_LEFTX,
+    EGC_GAMEPAD_AXIS_LEFTY,
+    EGC_GAMEPAD_AXIS_RIGHTX,
+    EGC_GAMEPAD_AXIS_RIGHTY,
+    EGC_GAMEPAD_AXIS_LEFT_TRIGGER,
+    EGC_GAMEPAD_AXIS_RIGHT_TRIGGER,
+    EGC_GAMEPAD_AXIS_COUNT
+} egc_gamepad_axis_e;
+
+typedef struct {
+    s16 x, y;
+} egc_touch_point_t;
+
+typedef struct {
+    s16 x, y, z;
+} egc_motion_t;
+
+typedef struct {
+    u32 buttons;
+    s16 axes[EGC_GAMEPAD_AXIS_COUNT];
+    egc_touch_point_t touch_points[2];
+    egc_motion_t accelerometer[1];
+    egc_motion_t gyroscope[1];
+} egc_gamepad_state_t;
+
+typedef struct {
+    egc_gamepad_state_t gamepad;
+} egc_input_state_t;
+
+typedef struct {
+    u32 available_buttons;
+    u8 num_touch_points;
+    u8 num_accelerometers;
+    u8 num_gyroscopes;
+} egc_device_description_t;
+
+typedef struct egc_input_device_t {
+    const egc_device_description_t *desc;
+    egc_input_state_t state;
+    u16 vid, pid;
+    /* Last values set through the API, stub only */
+    bool suspended;
+    u32 leds;
+    u8 rumble;
+} egc_input_device_t;
+
+typedef void (*egc_device_added_cb)(egc_input_device_t *device, void *userdata);
+typedef void (*egc_device_removed_cb)(egc_input_device_t *device, void *userdata);
+
+int egc_initialize(egc_device_added_cb added_cb, egc_device_removed_cb removed_cb, void *userdata);
+int egc_handle_events(void);
+int egc_input_device_resume(egc_input_device_t *device);
+int egc_input_device_suspend(egc_input_device_t *device);
+int egc_input_device_set_leds(egc_input_device_t *device, u32 leds);
+int egc_input_device_set_rumble(egc_input_device_t *device, u8 intensity);
+
+/* Stub control, the callbacks are the ones given to egc_initialize() */
+void egc_stub_add_device(egc_input_device_t *device);
+void egc_stub_remove_device(egc_input_device_t *device);
+/* Called by egc_handle_events(), that is on every tick of the OH1 hooks */
+typedef void (*egc_stub_events_cb)(void);
+void egc_stub_set_events_callback(egc_stub_events_cb cb);
+
+/* A DualShock 4 like description: all the buttons, touchpad, accelerometer and gyroscope */
+extern const egc_device_description_t egc_stub_gamepad_desc;
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+/* Recorded egc input, as fed to the stub devices, for fakemote_replay. Text, one event per line,
+ * '#' starts a comment:
+ *   A <slot>                 a stub gamepad is plugged in
+ *   R <slot>                 the gamepad is unplugged
+ *   S <slot> <buttons> <6 axes> <2 touch points: x y> <accelerometer: x y z> <gyroscope: x y z>
+ *   T <time_us>              tick of the OH1 hooks, which reads the current states
+ * States hold until the next S of the same slot. Only the ticks carry a time, on the clock of the
+ * capture: microseconds since the btsnoop epoch */
+
+#include <stdio.h>
+
+#include "egc.h"
+#include "types.h"
+
+#define INPUT_STREAM_MAX_SLOTS 8
+
+enum input_stream_event_e {
+    INPUT_STREAM_ADD,
+    INPUT_STREAM_REMOVE,
+    INPUT_STREAM_STATE,
+    INPUT_STREAM_TICK,
+};
+
+struct input_stream_event_t {
+    enum input_stream_event_e type;
+    u8 slot;
+    u64 time_us;
+    egc_gamepad_state_t state;
+};
+
+void input_stream_write(FILE *f, const struct input_stream_event_t *event);
+/* Returns 1 and the next event, 0 at the end of the stream or -1 on a malformed line, whose
+ * number is left in *line */
+int input_stream_read(FILE *f, struct input_stream_event_t *event, u32 *line);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef INTERNALS_H
+#define INTERNALS_H
+
+/* Host stand-in, nothing from the target's internals.h is used by the code built natively */
+
+#endif
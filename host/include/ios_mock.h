@@ -0,0 +1,41 @@
+#ifndef IOS_MOCK_H
+#define IOS_MOCK_H
+
+/* Control side of the mocked IOS: virtual time, heap statistics and the ReadyQs that the OH1
+ * hooks in oh1_hooks.c would otherwise own */
+
+#include "ipc.h"
+#include "types.h"
+
+struct ios_mock_heap_stats_t {
+    u32 allocs;
+    u32 frees;
+    u32 failed;
+    u32 bytes_in_use;
+    u32 peak_bytes_in_use;
+};
+
+/* Destroys every queue, heap and timer and rewinds the clock */
+void ios_mock_reset(void);
+
+/* Called by os_message_queue_ack(), that is whenever a request gets its reply */
+typedef void (*ios_mock_ack_cb_t)(ipcmessage *msg, int retval);
+void ios_mock_set_ack_callback(ios_mock_ack_cb_t cb);
+
+/* Virtual clock in microseconds. Advancing it fires the due timers, in order */
+u64 ios_mock_time_us(void);
+void ios_mock_advance_time(u32 us);
+
+int ios_mock_heap_get_stats(int heapid, struct ios_mock_heap_stats_t *stats);
+void ios_mock_heap_reset_stats(int heapid);
+/* Sum over every live heap, peak_bytes_in_use being the sum of the peaks */
+void ios_mock_heap_get_total_stats(struct ios_mock_heap_stats_t *stats);
+
+/* inject_msg_to_usb_*_ready_queue() for the native build: the injected messages are kept, with
+ * the firmware's queue depths, until popped. Pop returns NULL when empty, the message must be
+ * released with injmessage_free() */
+int oh1_mock_init(void);
+void *oh1_mock_pop_usb_intr_msg(void);
+void *oh1_mock_pop_usb_bulk_in_msg(void);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef IPC_H
+#define IPC_H
+
+/* Host stand-in for cios-lib's ipc.h */
+
+#include "types.h"
+
+#define IOS_OPEN   1
+#define IOS_CLOSE  2
+#define IOS_READ   3
+#define IOS_WRITE  4
+#define IOS_SEEK   5
+#define IOS_IOCTL  6
+#define IOS_IOCTLV 7
+
+#define IOS_OPEN_READ  1
+#define IOS_OPEN_WRITE 2
+#define IOS_OPEN_RW    3
+
+#define IOS_MESSAGE_NOBLOCK 1
+
+#define IOS_OK          0
+#define IOS_EACCES      -1
+#define IOS_EEXIST      -2
+#define IOS_EINVAL      -4
+#define IOS_ENOENT      -6
+#define IOS_EQUEUEEMPTY -7
+#define IOS_EQUEUEFULL  -8
+#define IOS_ENOMEM      -22
+
+typedef struct {
+    void *data;
+    u32 len;
+} ioctlv;
+
+typedef struct ipcmessage {
+    u32 command;
+    u32 result;
+    u32 fd;
+    union {
+        struct {
+            char *device;
+            u32 mode;
+            u32 resultfd;
+        } open;
+        struct {
+            void *data;
+            u32 length;
+        } read, write;
+        struct {
+            s32 offset;
+            s32 origin;
+        } seek;
+        struct {
+            u32 command;
+            u32 *buffer_in;
+            u32 length_in;
+            u32 *buffer_io;
+            u32 length_io;
+        } ioctl;
+        struct {
+            u32 command;
+            u32 num_in;
+            u32 num_io;
+            ioctlv *vector;
+        } ioctlv;
+    };
+} ipcmessage;
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+/* Host stand-in for cios-lib's syscalls.h, implemented by ios_mock.c. Only the syscalls used by
+ * the code built natively are provided */
+
+#include "ipc.h"
+#include "types.h"
+
+int os_message_queue_create(void *ptr, u32 n);
+int os_message_queue_destroy(int queueid);
+int os_message_queue_receive(int queueid, void *message, u32 flags);
+int os_message_queue_send(int queueid, void *message, u32 flags);
+int os_message_queue_ack(void *message, int retval);
+
+int os_heap_create(void *ptr, int size);
+int os_heap_destroy(int heapid);
+void *os_heap_alloc(int heapid, u32 size);
+void *os_heap_alloc_aligned(int heapid, u32 size, u32 align);
+void os_heap_free(int heapid, void *ptr);
+
+/* The message is pointer sized here, the firmware's timer cookies are addresses */
+int os_create_timer(int time_us, int repeat_time_us, int queueid, uintptr_t message);
+int os_stop_timer(int timerid);
+int os_destroy_timer(int timerid);
+
+void os_sync_before_read(void *ptr, u32 size);
+void os_sync_after_write(void *ptr, u32 size);
+
+/* Files are the host's, at the same path. /dev/fs only knows how to create and delete them */
+int os_open(const char *path, int mode);
+int os_close(int fd);
+int os_read(int fd, void *data, u32 len);
+int os_write(int fd, const void *data, u32 len);
+int os_ioctl(int fd, u32 request, void *in, u32 in_len, void *out, u32 out_len);
+
+/* Accepted and ignored, nothing can open the device */
+int os_device_register(const char *devicename, int queueid);
+
+/* Low MEM1, where the firmware finds e.g. the running title's game ID */
+extern u8 ios_mock_mem1[0x4000];
+
+/* The Hollywood timer, following the virtual clock */
+extern volatile u32 ios_mock_hw_timer;
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
+/* Host stand-in for cios-lib's tools.h */
+
+#include "ipc.h"
+#include "types.h"
+
+/* There are no caches to maintain on the host */
+void InvalidateVector(ioctlv *vector, u32 inlen, u32 iolen);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+/* Host stand-in for cios-lib's types.h */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define ATTRIBUTE_PACKED   __attribute__((packed))
+#define ATTRIBUTE_ALIGN(v) __attribute__((aligned(v)))
+
+/* Comes from newlib's sys/cdefs.h on the target */
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+/* Host stand-in for cios-lib's utils.h */
+
+#include <assert.h>
+#include <endian.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "types.h"
+
+#define ARRAY_SIZE(a)     ((int)(sizeof(a) / sizeof((a)[0])))
+#define MIN2(a, b)        (((a) < (b)) ? (a) : (b))
+#define MAX2(a, b)        (((a) > (b)) ? (a) : (b))
+#define BIT(n)            (1u << (n))
+#define MEMBER_SIZE(t, m) sizeof(((t *)0)->m)
+#define UNUSED(x)         (void)(x)
+#define STRINGIFY(x)      #x
+#define TOSTRING(x)       STRINGIFY(x)
+#define NORETURN          __attribute__((noreturn))
+
+#ifdef FAKEMOTE_HOST_DEBUG
+#define LOG_DEBUG(...) printf(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (0)
+#endif
+
+/* Returns the index of the first differing byte, or n if they are equal */
+static inline int memmismatch(const void *restrict a, const void *restrict b, int n)
+{
+    const u8 *pa = a, *pb = b;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (pa[i] != pb[i])
+            break;
+    }
+
+    return i;
+}
+
+static inline void reverse_memcpy(void *restrict dst, const void *restrict src, int n)
+{
+    u8 *d = dst;
+    const u8 *s = src;
+
+    for (int i = 0; i < n; i++)
+        d[n - 1 - i] = s[i];
+}
+
+#endif
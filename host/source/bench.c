@@ -0,0 +1,1063 @@
+/* Microbenchmarks of the per-tick paths, run natively against the IOS mock.
+ *
+ * Every benchmark reports the best ns/op out of a few timed runs and the heap allocations per
+ * operation seen by the mock. The results can be written as JSON and compared against a saved
+ * run, which makes the exit status non zero on any regression past the threshold. The self
+ * checks run first: word-at-a-time code paths against their bytewise references. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "button_map.h"
+#include "egc.h"
+#include "fake_wiimote.h"
+#include "fake_wiimote_mgr.h"
+#include "hci.h"
+#include "hci_state.h"
+#include "injmessage.h"
+#include "input_device.h"
+#include "ios_mock.h"
+#include "l2cap.h"
+#include "mapping_profile.h"
+#include "syscalls.h"
+#include "utils.h"
+#include "wiimote.h"
+#include "wiimote_crypto.h"
+
+/* source/libc.c built with its symbols renamed, see host/CMakeLists.txt */
+void *fakemote_memcpy(void *dest, const void *src, size_t n);
+void *fakemote_memset(void *s, int c, size_t n);
+int fakemote_memcmp(const void *s1, const void *s2, size_t n);
+
+#define NUM_INPUTS         256
+#define NUM_RUNS           5
+#define DEFAULT_MIN_TIME   20 /* ms per timed run */
+#define DEFAULT_THRESHOLD  10 /* percent */
+#define MAX_BENCHMARKS     64
+#define MAX_BASELINE_NAME  64
+#define NUM_PHYS_CON       4
+#define BENCH_CON_HANDLE   0x100
+#define BENCH_CNTL_CID     0x40
+#define BENCH_INTR_CID     0x41
+
+struct bench_t {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(u32 iters);
+};
+
+struct bench_result_t {
+    const char *name;
+    double ns_per_op;
+    double allocs_per_op;
+    u32 iters;
+};
+
+struct baseline_entry_t {
+    char name[MAX_BASELINE_NAME];
+    double ns_per_op;
+};
+
+static volatile u32 sink;
+
+/* Inputs, regenerated the same way on every run */
+static egc_gamepad_state_t inputs[NUM_INPUTS];
+static struct ir_dot_t ir_pointers[NUM_INPUTS];
+
+/* Mapping tables compiled from the default profile */
+static const struct mapping_profile_t *profile = &mapping_profile_default;
+static struct bm_button_lut16_t wiimote_lut, classic_lut, guitar_lut;
+static struct bm_button_lut8_t nunchuk_lut;
+static struct bm_button_lut32_t wiiu_pro_lut;
+static struct bm_stick_lut_t stick_luts[BM_STICK__NUM];
+static struct bm_ir_sensor_bar_t sensor_bar;
+static struct bm_ir_emulation_state_t ir_emu_state;
+
+/* Connected fake Wiimote fed by a stub controller */
+static egc_input_device_t egc_device;
+static fake_wiimote_t wiimote;
+
+/* Real connections known to hci_state */
+static u16 phys_con_handles[NUM_PHYS_CON];
+static u16 virt_con_handles[NUM_PHYS_CON];
+
+static struct wiimote_encryption_key_t crypto_key;
+static u8 crypto_key_data[4][16];
+static u8 crypto_buf[32] ATTRIBUTE_ALIGN(4);
+
+static u8 libc_src[128] ATTRIBUTE_ALIGN(4);
+static u8 libc_dst[128] ATTRIBUTE_ALIGN(4);
+
+static u32 rand_state = 0x12345678;
+
+static u32 rand_u32(void)
+{
+    /* xorshift32 */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static void rand_fill(void *buf, u32 size)
+{
+    u8 *p = buf;
+    for (u32 i = 0; i < size; i++)
+        p[i] = rand_u32();
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u32 total_allocs(void)
+{
+    struct ios_mock_heap_stats_t stats;
+    ios_mock_heap_get_total_stats(&stats);
+    return stats.allocs;
+}
+
+/* Environment */
+
+static void drain_injected_messages(void)
+{
+    void *msg;
+
+    while ((msg = oh1_mock_pop_usb_intr_msg()))
+        injmessage_free(msg);
+    while ((msg = oh1_mock_pop_usb_bulk_in_msg()))
+        injmessage_free(msg);
+}
+
+static void generate_inputs(void)
+{
+    /* Keep the combos out so that the mapping never switches under the benchmark */
+    u32 combos = profile->switch_extension_combo | profile->switch_ir_emu_mode_combo |
+                 profile->ir_recenter_combo;
+
+    rand_state = 0x12345678;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        egc_gamepad_state_t *in = &inputs[i];
+
+        in->buttons = rand_u32() & (BIT(EGC_GAMEPAD_BUTTON_COUNT) - 1) & ~combos;
+        for (int j = 0; j < EGC_GAMEPAD_AXIS_COUNT; j++)
+            in->axes[j] = rand_u32();
+        for (int j = 0; j < ARRAY_SIZE(in->touch_points); j++) {
+            in->touch_points[j].x = rand_u32() % EGC_GAMEPAD_TOUCH_RES;
+            in->touch_points[j].y = rand_u32() % EGC_GAMEPAD_TOUCH_RES;
+        }
+        in->accelerometer[0].x = (s16)rand_u32() / 4;
+        in->accelerometer[0].y = (s16)rand_u32() / 4;
+        in->accelerometer[0].z = BM_EGC_ACCEL_ONE_G + (s16)rand_u32() / 8;
+        in->gyroscope[0].x = (s16)rand_u32() / 16;
+        in->gyroscope[0].y = (s16)rand_u32() / 16;
+        in->gyroscope[0].z = (s16)rand_u32() / 16;
+
+        ir_pointers[i].x = rand_u32() % IR_CAMERA_RES_X;
+        ir_pointers[i].y = rand_u32() % IR_CAMERA_RES_Y;
+        ir_pointers[i].size = 2;
+        ir_pointers[i].intensity = 0x40;
+    }
+}
+
+static void build_luts(void)
+{
+    bm_button_lut16_build(&wiimote_lut, EGC_GAMEPAD_BUTTON_COUNT, profile->wiimote_button_map);
+    bm_button_lut8_build(&nunchuk_lut, EGC_GAMEPAD_BUTTON_COUNT, profile->nunchuk_button_map);
+    bm_button_lut16_build(&classic_lut, EGC_GAMEPAD_BUTTON_COUNT, profile->classic_button_map);
+    bm_button_lut32_build(&wiiu_pro_lut, EGC_GAMEPAD_BUTTON_COUNT, profile->wiiu_pro_button_map);
+    bm_button_lut16_build(&guitar_lut, EGC_GAMEPAD_BUTTON_COUNT, profile->guitar_button_map);
+    for (int i = 0; i < BM_STICK__NUM; i++)
+        bm_stick_lut_build(&stick_luts[i], &profile->stick_configs[i]);
+    bm_ir_sensor_bar_set_distance(&sensor_bar, BM_IR_DEFAULT_DISTANCE);
+    bm_ir_emulation_state_reset(&ir_emu_state);
+}
+
+static void env_reset(void)
+{
+    ios_mock_reset();
+    oh1_mock_init();
+    injmessage_init_heap();
+    hci_state_reset();
+    input_devices_init();
+    input_devices_set_mapping_profile(profile);
+    fake_wiimote_mgr_init();
+    egc_initialize(input_device_handle_added, input_device_handle_removed, NULL);
+}
+
+/* Output report from the host, on the HID interrupt channel */
+static void send_output_report(u8 report_id, const void *payload, u16 size)
+{
+    u8 buf[sizeof(hci_acldata_hdr_t) + sizeof(l2cap_hdr_t) + 2 + 32] ATTRIBUTE_ALIGN(4);
+    hci_acldata_hdr_t *acl = (void *)buf;
+    l2cap_hdr_t *l2cap = (void *)(acl + 1);
+    u8 *hid = (u8 *)(l2cap + 1);
+
+    assert(size <= 32);
+    acl->con_handle = htole16(HCI_MK_CON_HANDLE(wiimote.hci_con_handle, 2, 0));
+    acl->length = htole16(sizeof(*l2cap) + 2 + size);
+    l2cap->length = htole16(2 + size);
+    l2cap->dcid = htole16(BENCH_INTR_CID);
+    hid[0] = (HID_TYPE_DATA << 4) | HID_PARAM_OUTPUT;
+    hid[1] = report_id;
+    memcpy(&hid[2], payload, size);
+
+    fake_wiimote_handle_acl_data_out_request_from_host(&wiimote, acl);
+    drain_injected_messages();
+}
+
+static void write_register(u8 slave_address, u16 address, const void *data, u8 size)
+{
+    struct wiimote_output_report_write_data_t write;
+
+    memset(&write, 0, sizeof(write));
+    write.space = ADDRESS_SPACE_I2C_BUS;
+    write.slave_address = slave_address;
+    write.address = address;
+    write.size = size;
+    memcpy(write.data, data, size);
+    send_output_report(OUTPUT_REPORT_ID_WRITE_DATA, &write, sizeof(write));
+}
+
+static void set_ir_mode(u8 mode)
+{
+    write_register(CAMERA_I2C_ADDR, IR_CAMERA_MODE_OFFSET, &mode, 1);
+}
+
+static void setup_channel(l2cap_channel_info_t *info, u16 psm, u16 local_cid)
+{
+    info->valid = true;
+    info->state = L2CAP_CHANNEL_STATE_COMPLETE;
+    info->psm = psm;
+    info->local_cid = local_cid;
+    info->remote_cid = local_cid + 0x40;
+    info->remote_mtu = L2CAP_MTU_DEFAULT;
+}
+
+/* Brings up a Wiimote as it is after WPAD's connection sequence, reporting 0x37 continuously */
+static void setup_connected_wiimote(void)
+{
+    input_device_t *input_device;
+    struct wiimote_output_report_mode_t mode;
+    struct wiimote_output_report_enable_feature_t ir_enable;
+
+    env_reset();
+    memset(&egc_device, 0, sizeof(egc_device));
+    egc_device.desc = &egc_stub_gamepad_desc;
+    egc_device.state.gamepad = inputs[0];
+    egc_stub_add_device(&egc_device);
+
+    input_device = input_device_get_unassigned();
+    assert(input_device);
+    fake_wiimote_init(&wiimote, &FAKE_WIIMOTE_BDADDR(0));
+    input_device_assign_wiimote(input_device, &wiimote);
+    fake_wiimote_init_state(&wiimote, input_device);
+    wiimote.active = true;
+    wiimote.hci_con_handle = BENCH_CON_HANDLE;
+    wiimote.baseband_state = BASEBAND_STATE_COMPLETE;
+    wiimote.acl_state = ACL_STATE_INACTIVE;
+    setup_channel(&wiimote.psm_hid_cntl_chn, L2CAP_PSM_HID_CNTL, BENCH_CNTL_CID);
+    setup_channel(&wiimote.psm_hid_intr_chn, L2CAP_PSM_HID_INTR, BENCH_INTR_CID);
+
+    /* Let the extension attach settle */
+    for (int i = 0; i < 100; i++) {
+        fake_wiimote_tick(&wiimote);
+        drain_injected_messages();
+    }
+
+    memset(&ir_enable, 0, sizeof(ir_enable));
+    ir_enable.enable = 1;
+    send_output_report(OUTPUT_REPORT_ID_IR_ENABLE, &ir_enable, sizeof(ir_enable));
+    set_ir_mode(IR_MODE_BASIC);
+    assert(wiimote.status.ir && wiimote.ir_regs.mode == IR_MODE_BASIC);
+
+    memset(&mode, 0, sizeof(mode));
+    mode.continuous = 1;
+    mode.mode = INPUT_REPORT_ID_BTN_ACC_IR_EXP;
+    send_output_report(OUTPUT_REPORT_ID_REPORT_MODE, &mode, sizeof(mode));
+}
+
+static void setup_encrypted_wiimote(void)
+{
+    u8 key_data[16];
+    u8 encryption = ENCRYPTION_ENABLED;
+
+    setup_connected_wiimote();
+    rand_fill(key_data, sizeof(key_data));
+    write_register(EXTENSION_I2C_ADDR, ENCRYPTION_KEY_DATA_BEGIN, key_data, sizeof(key_data));
+    write_register(EXTENSION_I2C_ADDR, EXTENSION_ENCRYPTION_OFFSET, &encryption, 1);
+    assert(wiimote.extension_regs.encryption == ENCRYPTION_ENABLED);
+}
+
+static void setup_ir_extended(void)
+{
+    setup_connected_wiimote();
+    set_ir_mode(IR_MODE_EXTENDED);
+}
+
+static void setup_ir_full(void)
+{
+    setup_connected_wiimote();
+    set_ir_mode(IR_MODE_FULL);
+}
+
+/* Maps NUM_PHYS_CON real connections, as if the controller had reported them */
+static void setup_hci_connections(void)
+{
+    u8 buf[sizeof(hci_event_hdr_t) + sizeof(hci_con_compl_ep)];
+    hci_event_hdr_t *hdr = (void *)buf;
+    hci_con_compl_ep *ep = (void *)(hdr + 1);
+
+    env_reset();
+    for (int i = 0; i < NUM_PHYS_CON; i++) {
+        phys_con_handles[i] = 0x10 + i;
+        memset(buf, 0, sizeof(buf));
+        hdr->event = HCI_EVENT_CON_COMPL;
+        hdr->length = sizeof(*ep);
+        ep->status = 0;
+        ep->con_handle = htole16(phys_con_handles[i]);
+        ep->link_type = HCI_LINK_ACL;
+        hci_state_handle_hci_event_from_controller(buf, sizeof(buf));
+        virt_con_handles[i] = le16toh(ep->con_handle);
+    }
+}
+
+static void setup_crypto(void)
+{
+    rand_state = 0xC0FFEE;
+    rand_fill(crypto_key_data, sizeof(crypto_key_data));
+    /* As many keys as the cache holds, so that every cache slot gets looked up in turn */
+    for (int i = ARRAY_SIZE(crypto_key_data) - 1; i >= 0; i--)
+        wiimote_crypto_generate_key_from_extension_key_data(&crypto_key, crypto_key_data[i]);
+    rand_fill(crypto_buf, sizeof(crypto_buf));
+}
+
+static void setup_injmessage(void)
+{
+    env_reset();
+}
+
+static void setup_libc(void)
+{
+    rand_state = 0xBEEF;
+    rand_fill(libc_src, sizeof(libc_src));
+    memcpy(libc_dst, libc_src, sizeof(libc_dst));
+}
+
+/* Button mapping as it was before the lookup tables: a loop over the profile's bindings */
+static u16 map_buttons_loop(u32 buttons, const u16 *button_map)
+{
+    u16 out = 0;
+
+    for (int i = 0; i < EGC_GAMEPAD_BUTTON_COUNT; i++) {
+        if (buttons & BIT(i))
+            out |= button_map[i];
+    }
+    return out;
+}
+
+/* Benchmarks */
+
+static void run_bm_map_wiimote(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++) {
+        u16 buttons = 0;
+        bm_map_wiimote(inputs[i % NUM_INPUTS].buttons, &wiimote_lut, &buttons);
+        sink += buttons;
+    }
+}
+
+static void run_bm_map_wiimote_loop(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        sink += map_buttons_loop(inputs[i % NUM_INPUTS].buttons, profile->wiimote_button_map);
+}
+
+static void run_bm_map_nunchuk(u32 iters)
+{
+    struct wiimote_extension_data_format_nunchuk_t nunchuk;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_nunchuk(in->buttons, EGC_GAMEPAD_AXIS_COUNT, in->axes, ACCEL_ZERO_G, ACCEL_ZERO_G,
+                       ACCEL_ONE_G, &nunchuk_lut, profile->nunchuk_analog_axis_map,
+                       &stick_luts[BM_STICK_NUNCHUK], &nunchuk);
+        sink += nunchuk.jx;
+    }
+}
+
+static void run_bm_map_classic(u32 iters)
+{
+    union wiimote_extension_data_t classic;
+    u8 size;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_classic(in->buttons, EGC_GAMEPAD_AXIS_COUNT, in->axes, &classic_lut,
+                       profile->classic_analog_axis_map, &stick_luts[BM_STICK_CLASSIC_LEFT],
+                       &stick_luts[BM_STICK_CLASSIC_RIGHT], CLASSIC_DATA_FORMAT_DEFAULT, &classic,
+                       &size);
+        sink += size;
+    }
+}
+
+static void run_bm_map_wiiu_pro(u32 iters)
+{
+    struct wiimote_extension_data_format_wiiu_pro_t wiiu_pro;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_wiiu_pro(in->buttons, EGC_GAMEPAD_AXIS_COUNT, in->axes, &wiiu_pro_lut,
+                        profile->classic_analog_axis_map, &stick_luts[BM_STICK_CLASSIC_LEFT],
+                        &stick_luts[BM_STICK_CLASSIC_RIGHT], &wiiu_pro);
+        sink += ((u8 *)&wiiu_pro)[0];
+    }
+}
+
+static void run_bm_map_guitar(u32 iters)
+{
+    struct wiimote_extension_data_format_guitar_t guitar;
+    bool tilt;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_guitar(in->buttons, EGC_GAMEPAD_AXIS_COUNT, in->axes, &guitar_lut,
+                      profile->guitar_analog_axis_map, &guitar, &tilt);
+        sink += ((u8 *)&guitar)[0] + tilt;
+    }
+}
+
+static void run_bm_map_ir_direct(u32 iters)
+{
+    struct ir_dot_t pointer;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        sink += bm_map_ir_direct(in->touch_points[0].x, in->touch_points[0].y, &pointer);
+        sink += pointer.x;
+    }
+}
+
+static void run_bm_map_ir_analog_axis(u32 iters)
+{
+    struct ir_dot_t pointer;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_ir_analog_axis(BM_IR_EMULATION_MODE_RELATIVE_ANALOG_AXIS, &ir_emu_state,
+                              EGC_GAMEPAD_AXIS_COUNT, in->axes, profile->ir_analog_axis_map,
+                              &pointer);
+        sink += pointer.x;
+    }
+}
+
+static void run_bm_map_ir_gyro(u32 iters)
+{
+    struct ir_dot_t pointer;
+
+    for (u32 i = 0; i < iters; i++) {
+        const egc_gamepad_state_t *in = &inputs[i % NUM_INPUTS];
+        bm_map_ir_gyro(&ir_emu_state, BM_IR_GYRO_DEFAULT_SENSITIVITY, in->gyroscope[0].x,
+                       in->gyroscope[0].y, &pointer);
+        sink += pointer.x;
+    }
+}
+
+static void run_bm_ir_synthesize_dots(u32 iters)
+{
+    struct ir_dot_t dots[IR_MAX_DOTS];
+
+    for (u32 i = 0; i < iters; i++) {
+        bm_ir_synthesize_dots(&ir_pointers[i % NUM_INPUTS], &sensor_bar, ACCEL_ZERO_G,
+                              ACCEL_ONE_G, dots);
+        sink += dots[0].x;
+    }
+}
+
+static void run_fake_wiimote_report_ir_dots(u32 iters)
+{
+    struct ir_dot_t dots[IR_MAX_DOTS];
+
+    for (u32 i = 0; i < iters; i++) {
+        const struct ir_dot_t *pointer = &ir_pointers[i % NUM_INPUTS];
+        for (int j = 0; j < IR_MAX_DOTS; j++) {
+            dots[j] = *pointer;
+            dots[j].x += j * 64;
+        }
+        fake_wiimote_report_ir_dots(&wiimote, dots);
+    }
+    sink += wiimote.ir_regs.camera_data[0];
+}
+
+static void run_input_device_report_input(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++) {
+        egc_device.state.gamepad = inputs[i % NUM_INPUTS];
+        sink += input_device_report_input(wiimote.input_device);
+    }
+}
+
+/* send_data_report is only reachable through the tick, which also maps the input */
+static void run_fake_wiimote_tick(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++) {
+        egc_device.state.gamepad = inputs[i % NUM_INPUTS];
+        fake_wiimote_tick(&wiimote);
+        drain_injected_messages();
+    }
+}
+
+static void run_wiimote_crypto_encrypt_6(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        wiimote_crypto_encrypt(crypto_buf, &crypto_key, 0, 6);
+    sink += crypto_buf[0];
+}
+
+static void run_wiimote_crypto_encrypt_21(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        wiimote_crypto_encrypt(crypto_buf, &crypto_key, 0, CONTROLLER_DATA_BYTES);
+    sink += crypto_buf[0];
+}
+
+static void run_wiimote_crypto_encrypt_unaligned(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        wiimote_crypto_encrypt(crypto_buf + 1, &crypto_key, 3, 19);
+    sink += crypto_buf[1];
+}
+
+static void run_wiimote_crypto_generate_key(u32 iters)
+{
+    struct wiimote_encryption_key_t key;
+
+    for (u32 i = 0; i < iters; i++) {
+        wiimote_crypto_generate_key_from_extension_key_data(
+            &key, crypto_key_data[i % ARRAY_SIZE(crypto_key_data)]);
+        sink += key.ft[0];
+    }
+}
+
+static void run_hci_acl_data_in(u32 iters)
+{
+    u8 buf[sizeof(hci_acldata_hdr_t) + sizeof(l2cap_hdr_t)] ATTRIBUTE_ALIGN(4) = { 0 };
+    hci_acldata_hdr_t *hdr = (void *)buf;
+
+    for (u32 i = 0; i < iters; i++) {
+        hdr->con_handle = htole16(HCI_MK_CON_HANDLE(phys_con_handles[i % NUM_PHYS_CON], 2, 0));
+        hci_state_handle_acl_data_in_response_from_controller(buf, sizeof(buf));
+        sink += hdr->con_handle;
+    }
+}
+
+static void run_hci_acl_data_out(u32 iters)
+{
+    u8 buf[sizeof(hci_acldata_hdr_t) + sizeof(l2cap_hdr_t)] ATTRIBUTE_ALIGN(4) = { 0 };
+    hci_acldata_hdr_t *hdr = (void *)buf;
+    bool fwd_to_usb = true;
+
+    for (u32 i = 0; i < iters; i++) {
+        hdr->con_handle = htole16(HCI_MK_CON_HANDLE(virt_con_handles[i % NUM_PHYS_CON], 2, 0));
+        hci_state_handle_acl_data_out_request_from_host(buf, sizeof(buf), &fwd_to_usb);
+        sink += hdr->con_handle + fwd_to_usb;
+    }
+}
+
+static void run_hci_event_num_compl_pkts(u32 iters)
+{
+    u8 buf[sizeof(hci_event_hdr_t) + sizeof(hci_num_compl_pkts_ep) +
+           NUM_PHYS_CON * sizeof(hci_num_compl_pkts_info)] ATTRIBUTE_ALIGN(4);
+    hci_event_hdr_t *hdr = (void *)buf;
+    hci_num_compl_pkts_ep *ep = (void *)(hdr + 1);
+    hci_num_compl_pkts_info *info = (void *)(ep + 1);
+
+    hdr->event = HCI_EVENT_NUM_COMPL_PKTS;
+    hdr->length = sizeof(buf) - sizeof(*hdr);
+    ep->num_con_handles = NUM_PHYS_CON;
+    for (u32 i = 0; i < iters; i++) {
+        for (int j = 0; j < NUM_PHYS_CON; j++) {
+            info[j].con_handle = htole16(phys_con_handles[j]);
+            info[j].compl_pkts = htole16(1);
+        }
+        hci_state_handle_hci_event_from_controller(buf, sizeof(buf));
+        sink += info[0].con_handle;
+    }
+}
+
+static void run_inject_hci_event(u32 iters)
+{
+    u16 con_handles[1] = { BENCH_CON_HANDLE };
+    u16 compl_pkts[1] = { 1 };
+
+    for (u32 i = 0; i < iters; i++) {
+        inject_hci_event_num_compl_pkts(1, con_handles, compl_pkts);
+        injmessage_free(oh1_mock_pop_usb_intr_msg());
+    }
+}
+
+static void run_inject_l2cap_packet(u32 iters)
+{
+    u8 report[2 + CONTROLLER_DATA_BYTES] = { 0 };
+
+    for (u32 i = 0; i < iters; i++) {
+        inject_l2cap_packet(BENCH_CON_HANDLE, BENCH_INTR_CID + 0x40, report, sizeof(report));
+        injmessage_free(oh1_mock_pop_usb_bulk_in_msg());
+    }
+}
+
+static void run_memcpy_22(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        fakemote_memcpy(libc_dst, libc_src + (i & 4), CONTROLLER_DATA_BYTES + 1);
+    sink += libc_dst[0];
+}
+
+static void run_memcpy_unaligned_64(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        fakemote_memcpy(libc_dst, libc_src + 1, 64);
+    sink += libc_dst[0];
+}
+
+static void run_memset_64(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        fakemote_memset(libc_dst, i, 64);
+    sink += libc_dst[0];
+}
+
+static void run_memcmp_equal_22(u32 iters)
+{
+    for (u32 i = 0; i < iters; i++)
+        sink += fakemote_memcmp(libc_dst + 64, libc_src + 64, CONTROLLER_DATA_BYTES + 1);
+}
+
+static const struct bench_t benchmarks[] = {
+    { "bm_map_wiimote", build_luts, run_bm_map_wiimote },
+    { "bm_map_wiimote/bindings_loop", build_luts, run_bm_map_wiimote_loop },
+    { "bm_map_nunchuk", build_luts, run_bm_map_nunchuk },
+    { "bm_map_classic", build_luts, run_bm_map_classic },
+    { "bm_map_wiiu_pro", build_luts, run_bm_map_wiiu_pro },
+    { "bm_map_guitar", build_luts, run_bm_map_guitar },
+    { "bm_map_ir_direct", build_luts, run_bm_map_ir_direct },
+    { "bm_map_ir_analog_axis", build_luts, run_bm_map_ir_analog_axis },
+    { "bm_map_ir_gyro", build_luts, run_bm_map_ir_gyro },
+    { "bm_ir_synthesize_dots", build_luts, run_bm_ir_synthesize_dots },
+    { "fake_wiimote_report_ir_dots/basic", setup_connected_wiimote,
+      run_fake_wiimote_report_ir_dots },
+    { "fake_wiimote_report_ir_dots/extended", setup_ir_extended, run_fake_wiimote_report_ir_dots },
+    { "fake_wiimote_report_ir_dots/full", setup_ir_full, run_fake_wiimote_report_ir_dots },
+    { "input_device_report_input", setup_connected_wiimote, run_input_device_report_input },
+    { "fake_wiimote_send_data_report/0x37", setup_connected_wiimote, run_fake_wiimote_tick },
+    { "fake_wiimote_send_data_report/0x37_encrypted", setup_encrypted_wiimote,
+      run_fake_wiimote_tick },
+    { "wiimote_crypto_encrypt/6", setup_crypto, run_wiimote_crypto_encrypt_6 },
+    { "wiimote_crypto_encrypt/21", setup_crypto, run_wiimote_crypto_encrypt_21 },
+    { "wiimote_crypto_encrypt/unaligned_19", setup_crypto, run_wiimote_crypto_encrypt_unaligned },
+    { "wiimote_crypto_generate_key/cached_4", setup_crypto, run_wiimote_crypto_generate_key },
+    { "hci_state/acl_data_in", setup_hci_connections, run_hci_acl_data_in },
+    { "hci_state/acl_data_out", setup_hci_connections, run_hci_acl_data_out },
+    { "hci_state/event_num_compl_pkts", setup_hci_connections, run_hci_event_num_compl_pkts },
+    { "injmessage_alloc/hci_event", setup_injmessage, run_inject_hci_event },
+    { "injmessage_alloc/l2cap_packet", setup_injmessage, run_inject_l2cap_packet },
+    { "memcpy/22", setup_libc, run_memcpy_22 },
+    { "memcpy/unaligned_64", setup_libc, run_memcpy_unaligned_64 },
+    { "memset/64", setup_libc, run_memset_64 },
+    { "memcmp/equal_22", setup_libc, run_memcmp_equal_22 },
+};
+static_assert(ARRAY_SIZE(benchmarks) <= MAX_BENCHMARKS);
+
+/* Self checks */
+
+static int check_libc(void)
+{
+    static u8 a[96], b[96], c[96];
+    int errors = 0;
+
+    rand_state = 0x5EED;
+    for (u32 src_off = 0; src_off < 8; src_off++) {
+        for (u32 dst_off = 0; dst_off < 8; dst_off++) {
+            for (u32 n = 0; n <= 64; n++) {
+                rand_fill(a, sizeof(a));
+                rand_fill(b, sizeof(b));
+                memcpy(c, b, sizeof(c));
+                fakemote_memcpy(b + dst_off, a + src_off, n);
+                memcpy(c + dst_off, a + src_off, n);
+                errors += memcmp(b, c, sizeof(b)) != 0;
+
+                fakemote_memset(b + dst_off, src_off * 0x21, n);
+                memset(c + dst_off, src_off * 0x21, n);
+                errors += memcmp(b, c, sizeof(b)) != 0;
+
+                /* Equal, then differing at every position */
+                memcpy(b + dst_off, a + src_off, n);
+                errors += fakemote_memcmp(a + src_off, b + dst_off, n) != 0;
+                for (u32 i = 0; i < n; i++) {
+                    int ref, res;
+                    b[dst_off + i] ^= 1 << (i % 8);
+                    ref = memcmp(a + src_off, b + dst_off, n);
+                    res = fakemote_memcmp(a + src_off, b + dst_off, n);
+                    errors += (ref < 0) != (res < 0) || (ref > 0) != (res > 0);
+                    b[dst_off + i] ^= 1 << (i % 8);
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+/* Known answers: the key schedule of homebrew's all-zero key and of two first-party keys, and the
+ * ciphertext the bytewise (p - ft[a % 8]) ^ sb[a % 8] gives for it, at aligned and unaligned
+ * register addresses */
+static const struct {
+    u8 key_data[16];
+    u8 ft[8];
+    u8 sb[8];
+    u32 addr;
+    u32 size;
+    u8 plaintext[16];
+    u8 ciphertext[16];
+} crypto_vectors[] = {
+    {
+        .key_data = { 0 },
+        .ft = { 0x17, 0x17, 0x17, 0x17, 0x17, 0x17, 0x17, 0x17 },
+        .sb = { 0x17, 0x17, 0x17, 0x17, 0x17, 0x17, 0x17, 0x17 },
+        .addr = 0x00,
+        .size = 6,
+        .plaintext = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x03 },
+        .ciphertext = { 0x7e, 0x7e, 0x7e, 0x7e, 0x7e, 0xfb },
+    },
+    {
+        .key_data = { 0xed, 0x0f, 0xf0, 0xde, 0xbc, 0x9a, 0x78, 0x56, 0x34, 0x12, 0x1a, 0x5a, 0x93,
+                      0x4e, 0x4c, 0x22 },
+        .ft = { 0xea, 0x99, 0x4e, 0xea, 0xf6, 0xbe, 0x17, 0x9f },
+        .sb = { 0x9c, 0xa0, 0x3d, 0x0a, 0x9f, 0x39, 0xf9, 0x1e },
+        .addr = 0x08,
+        .size = 16,
+        .plaintext = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b,
+                       0x1c, 0x1d, 0x1e, 0x1f },
+        .ciphertext = { 0xba, 0xd8, 0xf9, 0x23, 0x81, 0x6e, 0x06, 0x66, 0xb2, 0x20, 0xf1, 0x3b,
+                        0xb9, 0x66, 0xfe, 0x9e },
+    },
+    {
+        .key_data = { 0x32, 0x10, 0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01, 0x7f, 0x8d, 0xf6,
+                      0x6b, 0x91, 0x1b },
+        .ft = { 0xf2, 0x7c, 0x34, 0xee, 0x38, 0xf9, 0x89, 0x86 },
+        .sb = { 0xe1, 0xf6, 0x09, 0x4b, 0x53, 0x3f, 0x3f, 0xb2 },
+        .addr = 0xfa,
+        .size = 6,
+        .plaintext = { 0x7f, 0x81, 0x80, 0x7e, 0x9a, 0x03 },
+        .ciphertext = { 0x42, 0xd8, 0x1b, 0xba, 0x2e, 0xcf },
+    },
+};
+
+static int check_crypto_vectors(void)
+{
+    struct wiimote_encryption_key_t key;
+    u8 data[32] ATTRIBUTE_ALIGN(4);
+    int errors = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(crypto_vectors); i++) {
+        wiimote_crypto_generate_key_from_extension_key_data(&key, crypto_vectors[i].key_data);
+        errors += memcmp(key.ft, crypto_vectors[i].ft, sizeof(key.ft)) != 0;
+        errors += memcmp(key.sb, crypto_vectors[i].sb, sizeof(key.sb)) != 0;
+        /* Through every buffer alignment */
+        for (u32 offset = 0; offset < 4; offset++) {
+            memcpy(data + offset, crypto_vectors[i].plaintext, crypto_vectors[i].size);
+            wiimote_crypto_encrypt(data + offset, &key, crypto_vectors[i].addr,
+                                   crypto_vectors[i].size);
+            errors += memcmp(data + offset, crypto_vectors[i].ciphertext,
+                             crypto_vectors[i].size) != 0;
+        }
+    }
+    return errors;
+}
+
+static int check_crypto(void)
+{
+    struct wiimote_encryption_key_t key;
+    u8 other_key_data[16];
+    u8 data[64] ATTRIBUTE_ALIGN(4), ref[64];
+    int errors = check_crypto_vectors();
+
+    /* Then against the bytewise routine, for every alignment, address and size, with a
+     * first-party key so that the lanes don't all see the same table byte */
+    rand_state = 0xC0DE;
+    wiimote_crypto_generate_key_from_extension_key_data(&key, crypto_vectors[1].key_data);
+
+    for (u32 offset = 0; offset < 8; offset++) {
+        for (u32 addr = 0; addr < 16; addr++) {
+            for (u32 size = 0; size <= 32; size++) {
+                rand_fill(data, sizeof(data));
+                memcpy(ref, data, sizeof(ref));
+                for (u32 i = 0; i < size; i++) {
+                    u32 a = addr + i;
+                    ref[offset + i] = (ref[offset + i] - key.ft[a % 8]) ^ key.sb[a % 8];
+                }
+                wiimote_crypto_encrypt(data + offset, &key, addr, size);
+                errors += memcmp(data, ref, sizeof(data)) != 0;
+            }
+        }
+    }
+
+    /* The key cache has to keep returning the right keys after other keys went through it */
+    for (int i = 0; i < 8; i++) {
+        rand_fill(other_key_data, sizeof(other_key_data));
+        wiimote_crypto_generate_key_from_extension_key_data(&key, other_key_data);
+        errors += check_crypto_vectors();
+    }
+    return errors;
+}
+
+static int check_button_luts(void)
+{
+    int errors = 0;
+
+    build_luts();
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        u32 buttons = inputs[i].buttons;
+        u16 mapped = 0;
+
+        bm_map_wiimote(buttons, &wiimote_lut, &mapped);
+        errors += mapped != map_buttons_loop(buttons, profile->wiimote_button_map);
+        errors += bm_button_lut16_lookup(&classic_lut, buttons) !=
+                  map_buttons_loop(buttons, profile->classic_button_map);
+    }
+    return errors;
+}
+
+/* Runs the self-checks whose name contains filter (all of them if NULL), false if one fails or
+ * none matches */
+static bool run_self_checks(const char *filter)
+{
+    static const struct {
+        const char *name;
+        int (*check)(void);
+    } checks[] = {
+        { "libc", check_libc },
+        { "wiimote_crypto", check_crypto },
+        { "button_lut", check_button_luts },
+    };
+    bool ok = true;
+    int num_run = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(checks); i++) {
+        int errors;
+
+        if (filter && !strstr(checks[i].name, filter))
+            continue;
+        errors = checks[i].check();
+        num_run++;
+        printf("self-check %-16s %s", checks[i].name, errors ? "FAILED" : "ok");
+        if (errors)
+            printf(" (%d mismatches)", errors);
+        printf("\n");
+        ok &= errors == 0;
+    }
+    return ok && num_run > 0;
+}
+
+/* Runner */
+
+static void run_benchmark(const struct bench_t *bench, u32 min_time_ms,
+                          struct bench_result_t *result)
+{
+    u64 min_time_ns = (u64)min_time_ms * 1000000;
+    u64 best_ns = UINT64_MAX;
+    u64 start, elapsed;
+    u32 allocs_start;
+    u32 iters = 1;
+
+    bench->setup();
+
+    /* Grow the iteration count until a run is long enough to time */
+    for (;;) {
+        start = now_ns();
+        bench->run(iters);
+        elapsed = now_ns() - start;
+        if (elapsed >= min_time_ns || iters >= (1u << 30))
+            break;
+        if (elapsed < min_time_ns / 16)
+            iters *= 16;
+        else
+            iters = (u32)((double)iters * min_time_ns / elapsed) + 1;
+    }
+
+    allocs_start = total_allocs();
+    for (int run = 0; run < NUM_RUNS; run++) {
+        start = now_ns();
+        bench->run(iters);
+        elapsed = now_ns() - start;
+        best_ns = MIN2(best_ns, elapsed);
+    }
+
+    result->name = bench->name;
+    result->iters = iters;
+    result->ns_per_op = (double)best_ns / iters;
+    result->allocs_per_op = (double)(total_allocs() - allocs_start) / ((u64)iters * NUM_RUNS);
+}
+
+static int write_json(const char *path, const struct bench_result_t *results, int num_results)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    /* One benchmark per line, load_baseline() relies on it */
+    fprintf(fp, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < num_results; i++) {
+        fprintf(fp,
+                "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f, "
+                "\"iterations\": %u}%s\n",
+                results[i].name, results[i].ns_per_op, results[i].allocs_per_op,
+                results[i].iters, i + 1 < num_results ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+static int load_baseline(const char *path, struct baseline_entry_t *entries, int max_entries)
+{
+    char line[256];
+    int num_entries = 0;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) && num_entries < max_entries) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *ns = strstr(line, "\"ns_per_op\": ");
+        const char *end;
+        size_t len;
+
+        if (!name || !ns)
+            continue;
+        name += strlen("\"name\": \"");
+        end = strchr(name, '"');
+        if (!end)
+            continue;
+        len = MIN2((size_t)(end - name), sizeof(entries->name) - 1);
+        memcpy(entries[num_entries].name, name, len);
+        entries[num_entries].name[len] = '\0';
+        entries[num_entries].ns_per_op = strtod(ns + strlen("\"ns_per_op\": "), NULL);
+        num_entries++;
+    }
+    fclose(fp);
+    return num_entries;
+}
+
+static const struct baseline_entry_t *find_baseline(const struct baseline_entry_t *entries,
+                                                    int num_entries, const char *name)
+{
+    for (int i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].name, name) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--json FILE] [--baseline FILE] [--threshold PERCENT] [--filter TEXT]\n"
+            "          [--min-time MS]\n"
+            "       %s --check TEXT    run only the self-checks whose name contains TEXT\n",
+            argv0, argv0);
+}
+
+int main(int argc, char **argv)
+{
+    static struct bench_result_t results[MAX_BENCHMARKS];
+    static struct baseline_entry_t baseline[MAX_BENCHMARKS];
+    const char *json_path = NULL;
+    const char *baseline_path = NULL;
+    const char *filter = NULL;
+    const char *check = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    u32 min_time_ms = DEFAULT_MIN_TIME;
+    int num_baseline = 0;
+    int num_results = 0;
+    int regressions = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--json") == 0) {
+            json_path = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--baseline") == 0) {
+            baseline_path = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--threshold") == 0) {
+            threshold = strtod(argv[++i], NULL);
+        } else if (i + 1 < argc && strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--min-time") == 0) {
+            min_time_ms = strtoul(argv[++i], NULL, 0);
+        } else if (i + 1 < argc && strcmp(argv[i], "--check") == 0) {
+            check = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (baseline_path) {
+        num_baseline = load_baseline(baseline_path, baseline, ARRAY_SIZE(baseline));
+        if (num_baseline < 0)
+            return 2;
+    }
+
+    generate_inputs();
+    if (check)
+        return run_self_checks(check) ? 0 : 1;
+    if (!run_self_checks(NULL))
+        return 1;
+
+    printf("\n%-46s %12s %10s", "benchmark", "ns/op", "allocs/op");
+    if (baseline_path)
+        printf(" %10s", "vs base");
+    printf("\n");
+
+    for (int i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        struct bench_result_t *result = &results[num_results];
+        const struct baseline_entry_t *base;
+
+        if (filter && !strstr(benchmarks[i].name, filter))
+            continue;
+
+        run_benchmark(&benchmarks[i], min_time_ms, result);
+        num_results++;
+
+        printf("%-46s %12.2f %10.2f", result->name, result->ns_per_op, result->allocs_per_op);
+        base = find_baseline(baseline, num_baseline, result->name);
+        if (base && base->ns_per_op > 0) {
+            double delta = (result->ns_per_op / base->ns_per_op - 1.0) * 100.0;
+            bool regressed = delta > threshold;
+            printf(" %+9.1f%%%s", delta, regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        } else if (baseline_path) {
+            printf(" %10s", "new");
+        }
+        printf("\n");
+    }
+
+    if (json_path && write_json(json_path, results, num_results) < 0)
+        return 2;
+
+    if (regressions) {
+        printf("\n%d benchmark(s) slower than the baseline by more than %.1f%%\n", regressions,
+               threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "egc.h"
+#include "utils.h"
+
+static egc_device_added_cb device_added_cb;
+static egc_device_removed_cb device_removed_cb;
+static void *callbacks_userdata;
+static egc_stub_events_cb events_cb;
+
+const egc_device_description_t egc_stub_gamepad_desc = {
+    .available_buttons = BIT(EGC_GAMEPAD_BUTTON_COUNT) - 1,
+    .num_touch_points = 2,
+    .num_accelerometers = 1,
+    .num_gyroscopes = 1,
+};
+
+int egc_initialize(egc_device_added_cb added_cb, egc_device_removed_cb removed_cb, void *userdata)
+{
+    device_added_cb = added_cb;
+    device_removed_cb = removed_cb;
+    callbacks_userdata = userdata;
+    return 0;
+}
+
+/* Input state is written directly into the devices, there are no events to pull */
+int egc_handle_events(void)
+{
+    if (events_cb)
+        events_cb();
+    return 0;
+}
+
+int egc_input_device_resume(egc_input_device_t *device)
+{
+    device->suspended = false;
+    return 0;
+}
+
+int egc_input_device_suspend(egc_input_device_t *device)
+{
+    device->suspended = true;
+    return 0;
+}
+
+int egc_input_device_set_leds(egc_input_device_t *device, u32 leds)
+{
+    device->leds = leds;
+    return 0;
+}
+
+int egc_input_device_set_rumble(egc_input_device_t *device, u8 intensity)
+{
+    device->rumble = intensity;
+    return 0;
+}
+
+void egc_stub_add_device(egc_input_device_t *device)
+{
+    if (device_added_cb)
+        device_added_cb(device, callbacks_userdata);
+}
+
+void egc_stub_remove_device(egc_input_device_t *device)
+{
+    if (device_removed_cb)
+        device_removed_cb(device, callbacks_userdata);
+}
+
+void egc_stub_set_events_callback(egc_stub_events_cb cb)
+{
+    events_cb = cb;
+}
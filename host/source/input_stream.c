@@ -0,0 +1,111 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "input_stream.h"
+#include "utils.h"
+
+#define INPUT_STREAM_LINE_SIZE 256
+
+void input_stream_write(FILE *f, const struct input_stream_event_t *event)
+{
+    const egc_gamepad_state_t *s = &event->state;
+
+    switch (event->type) {
+    case INPUT_STREAM_ADD:
+        fprintf(f, "A %u\n", event->slot);
+        break;
+    case INPUT_STREAM_REMOVE:
+        fprintf(f, "R %u\n", event->slot);
+        break;
+    case INPUT_STREAM_STATE:
+        fprintf(f, "S %u 0x%06" PRIx32, event->slot, s->buttons);
+        for (int i = 0; i < EGC_GAMEPAD_AXIS_COUNT; i++)
+            fprintf(f, " %d", s->axes[i]);
+        for (int i = 0; i < ARRAY_SIZE(s->touch_points); i++)
+            fprintf(f, " %d %d", s->touch_points[i].x, s->touch_points[i].y);
+        fprintf(f, " %d %d %d %d %d %d\n", s->accelerometer[0].x, s->accelerometer[0].y,
+                s->accelerometer[0].z, s->gyroscope[0].x, s->gyroscope[0].y, s->gyroscope[0].z);
+        break;
+    case INPUT_STREAM_TICK:
+        fprintf(f, "T %" PRIu64 "\n", event->time_us);
+        break;
+    }
+}
+
+static bool parse_state(const char *args, egc_gamepad_state_t *s)
+{
+    int v[EGC_GAMEPAD_AXIS_COUNT + 2 * 2 + 3 + 3];
+    unsigned int buttons;
+    int n, pos = 0;
+
+    if (sscanf(args, "%i%n", &buttons, &n) != 1)
+        return false;
+    args += n;
+    for (int i = 0; i < ARRAY_SIZE(v); i++) {
+        if (sscanf(args, "%d%n", &v[i], &n) != 1)
+            return false;
+        args += n;
+    }
+
+    memset(s, 0, sizeof(*s));
+    s->buttons = buttons;
+    for (int i = 0; i < EGC_GAMEPAD_AXIS_COUNT; i++)
+        s->axes[i] = v[pos++];
+    for (int i = 0; i < ARRAY_SIZE(s->touch_points); i++) {
+        s->touch_points[i].x = v[pos++];
+        s->touch_points[i].y = v[pos++];
+    }
+    s->accelerometer[0].x = v[pos++];
+    s->accelerometer[0].y = v[pos++];
+    s->accelerometer[0].z = v[pos++];
+    s->gyroscope[0].x = v[pos++];
+    s->gyroscope[0].y = v[pos++];
+    s->gyroscope[0].z = v[pos++];
+    return true;
+}
+
+int input_stream_read(FILE *f, struct input_stream_event_t *event, u32 *line)
+{
+    char buf[INPUT_STREAM_LINE_SIZE];
+    const char *args;
+    unsigned long long time_us;
+    unsigned int slot;
+    char type;
+    int n;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        (*line)++;
+        if (sscanf(buf, " %c%n", &type, &n) != 1 || type == '#')
+            continue;
+        args = buf + n;
+
+        memset(event, 0, sizeof(*event));
+        if (type == 'T') {
+            if (sscanf(args, "%llu", &time_us) != 1)
+                return -1;
+            event->type = INPUT_STREAM_TICK;
+            event->time_us = time_us;
+            return 1;
+        }
+
+        if (sscanf(args, "%u%n", &slot, &n) != 1 || slot >= INPUT_STREAM_MAX_SLOTS)
+            return -1;
+        args += n;
+        event->slot = slot;
+        switch (type) {
+        case 'A':
+            event->type = INPUT_STREAM_ADD;
+            return 1;
+        case 'R':
+            event->type = INPUT_STREAM_REMOVE;
+            return 1;
+        case 'S':
+            event->type = INPUT_STREAM_STATE;
+            return parse_state(args, &event->state) ? 1 : -1;
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,485 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ios_mock.h"
+#include "syscalls.h"
+#include "tools.h"
+#include "utils.h"
+
+#define MAX_QUEUES 16
+#define MAX_HEAPS  8
+#define MAX_TIMERS 8
+#define MAX_FILES  8
+
+/* ISFS ioctls, on /dev/fs */
+#define ISFS_IOCTL_DELETE     7
+#define ISFS_IOCTL_CREATEFILE 9
+#define ISFS_ATTR_PATH_OFFSET 6
+#define ISFS_MAXPATH          64
+
+/* The Hollywood timer counts at 243 MHz / 128 */
+#define HW_TIMER_MUL 243
+#define HW_TIMER_DIV 128
+
+/* IOS hands out 32-byte aligned chunks, the header keeps the payload aligned */
+#define HEAP_ALIGN 32
+
+u8 ios_mock_mem1[0x4000];
+volatile u32 ios_mock_hw_timer;
+
+static struct {
+    bool used;
+    void **entries;
+    u32 size;
+    u32 head;
+    u32 count;
+} queues[MAX_QUEUES];
+
+struct heap_chunk_t {
+    u32 size;
+    u32 used;
+    u8 pad[HEAP_ALIGN - 2 * sizeof(u32)];
+};
+
+static struct {
+    bool used;
+    u8 *base;
+    u32 size;
+    struct ios_mock_heap_stats_t stats;
+} heaps[MAX_HEAPS];
+
+static struct {
+    bool used;
+    bool active;
+    u64 expire_us;
+    u32 repeat_us;
+    int queueid;
+    uintptr_t message;
+} timers[MAX_TIMERS];
+
+static struct {
+    bool used;
+    bool is_fs;
+    FILE *fp;
+} files[MAX_FILES];
+
+static u64 now_us;
+static ios_mock_ack_cb_t ack_cb;
+
+static void set_time(u64 us)
+{
+    now_us = us;
+    ios_mock_hw_timer = us * HW_TIMER_MUL / HW_TIMER_DIV;
+}
+
+void ios_mock_reset(void)
+{
+    memset(queues, 0, sizeof(queues));
+    memset(heaps, 0, sizeof(heaps));
+    memset(timers, 0, sizeof(timers));
+    memset(ios_mock_mem1, 0, sizeof(ios_mock_mem1));
+    for (int i = 0; i < MAX_FILES; i++) {
+        if (files[i].fp)
+            fclose(files[i].fp);
+    }
+    memset(files, 0, sizeof(files));
+    set_time(0);
+    ack_cb = NULL;
+}
+
+void ios_mock_set_ack_callback(ios_mock_ack_cb_t cb)
+{
+    ack_cb = cb;
+}
+
+void InvalidateVector(ioctlv *vector, u32 inlen, u32 iolen)
+{
+}
+
+/* Message queues */
+
+static inline bool queue_is_valid(int queueid)
+{
+    return queueid >= 0 && queueid < MAX_QUEUES && queues[queueid].used;
+}
+
+int os_message_queue_create(void *ptr, u32 n)
+{
+    for (int i = 0; i < MAX_QUEUES; i++) {
+        if (!queues[i].used) {
+            queues[i].used = true;
+            queues[i].entries = ptr;
+            queues[i].size = n;
+            queues[i].head = 0;
+            queues[i].count = 0;
+            return i;
+        }
+    }
+
+    return IOS_ENOMEM;
+}
+
+int os_message_queue_destroy(int queueid)
+{
+    if (!queue_is_valid(queueid))
+        return IOS_EINVAL;
+    queues[queueid].used = false;
+    return IOS_OK;
+}
+
+/* Nothing else runs on the host, so blocking on an empty queue would never return: both
+ * modes fail instead */
+int os_message_queue_receive(int queueid, void *message, u32 flags)
+{
+    if (!queue_is_valid(queueid))
+        return IOS_EINVAL;
+    if (queues[queueid].count == 0)
+        return IOS_EQUEUEEMPTY;
+
+    *(void **)message = queues[queueid].entries[queues[queueid].head];
+    queues[queueid].head = (queues[queueid].head + 1) % queues[queueid].size;
+    queues[queueid].count--;
+
+    return IOS_OK;
+}
+
+int os_message_queue_send(int queueid, void *message, u32 flags)
+{
+    u32 tail;
+
+    if (!queue_is_valid(queueid))
+        return IOS_EINVAL;
+    if (queues[queueid].count == queues[queueid].size)
+        return IOS_EQUEUEFULL;
+
+    tail = (queues[queueid].head + queues[queueid].count) % queues[queueid].size;
+    queues[queueid].entries[tail] = message;
+    queues[queueid].count++;
+
+    return IOS_OK;
+}
+
+int os_message_queue_ack(void *message, int retval)
+{
+    ((ipcmessage *)message)->result = retval;
+    if (ack_cb)
+        ack_cb(message, retval);
+    return IOS_OK;
+}
+
+/* Heaps: first fit over the caller's buffer, free chunks are merged with the following ones */
+
+static inline bool heap_is_valid(int heapid)
+{
+    return heapid >= 0 && heapid < MAX_HEAPS && heaps[heapid].used;
+}
+
+static inline struct heap_chunk_t *heap_next_chunk(struct heap_chunk_t *chunk)
+{
+    return (struct heap_chunk_t *)((u8 *)(chunk + 1) + chunk->size);
+}
+
+static inline bool heap_chunk_in_heap(int heapid, const struct heap_chunk_t *chunk)
+{
+    return (const u8 *)chunk < heaps[heapid].base + heaps[heapid].size;
+}
+
+int os_heap_create(void *ptr, int size)
+{
+    struct heap_chunk_t *chunk = ptr;
+
+    assert(((uintptr_t)ptr % HEAP_ALIGN) == 0);
+    if (size < 2 * (int)sizeof(*chunk))
+        return IOS_EINVAL;
+
+    for (int i = 0; i < MAX_HEAPS; i++) {
+        if (!heaps[i].used) {
+            heaps[i].used = true;
+            heaps[i].base = ptr;
+            heaps[i].size = size & ~(HEAP_ALIGN - 1);
+            memset(&heaps[i].stats, 0, sizeof(heaps[i].stats));
+            chunk->size = heaps[i].size - sizeof(*chunk);
+            chunk->used = false;
+            return i;
+        }
+    }
+
+    return IOS_ENOMEM;
+}
+
+int os_heap_destroy(int heapid)
+{
+    if (!heap_is_valid(heapid))
+        return IOS_EINVAL;
+    heaps[heapid].used = false;
+    return IOS_OK;
+}
+
+void *os_heap_alloc_aligned(int heapid, u32 size, u32 align)
+{
+    struct heap_chunk_t *chunk;
+
+    if (!heap_is_valid(heapid) || align > HEAP_ALIGN)
+        return NULL;
+
+    size = (size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+    chunk = (struct heap_chunk_t *)heaps[heapid].base;
+    for (; heap_chunk_in_heap(heapid, chunk); chunk = heap_next_chunk(chunk)) {
+        if (chunk->used || chunk->size < size)
+            continue;
+
+        /* Split if the rest can hold another chunk */
+        if (chunk->size - size >= 2 * sizeof(*chunk)) {
+            struct heap_chunk_t *rest = (struct heap_chunk_t *)((u8 *)(chunk + 1) + size);
+            rest->size = chunk->size - size - sizeof(*chunk);
+            rest->used = false;
+            chunk->size = size;
+        }
+        chunk->used = true;
+
+        heaps[heapid].stats.allocs++;
+        heaps[heapid].stats.bytes_in_use += chunk->size;
+        heaps[heapid].stats.peak_bytes_in_use =
+            MAX2(heaps[heapid].stats.peak_bytes_in_use, heaps[heapid].stats.bytes_in_use);
+        return chunk + 1;
+    }
+
+    heaps[heapid].stats.failed++;
+    return NULL;
+}
+
+void *os_heap_alloc(int heapid, u32 size)
+{
+    return os_heap_alloc_aligned(heapid, size, HEAP_ALIGN);
+}
+
+void os_heap_free(int heapid, void *ptr)
+{
+    struct heap_chunk_t *chunk = (struct heap_chunk_t *)ptr - 1;
+    struct heap_chunk_t *next;
+
+    if (!heap_is_valid(heapid) || !ptr)
+        return;
+
+    assert((u8 *)chunk >= heaps[heapid].base && heap_chunk_in_heap(heapid, chunk));
+    assert(chunk->used);
+
+    chunk->used = false;
+    heaps[heapid].stats.frees++;
+    heaps[heapid].stats.bytes_in_use -= chunk->size;
+
+    next = heap_next_chunk(chunk);
+    while (heap_chunk_in_heap(heapid, next) && !next->used) {
+        chunk->size += sizeof(*next) + next->size;
+        next = heap_next_chunk(chunk);
+    }
+}
+
+int ios_mock_heap_get_stats(int heapid, struct ios_mock_heap_stats_t *stats)
+{
+    if (!heap_is_valid(heapid))
+        return IOS_EINVAL;
+    *stats = heaps[heapid].stats;
+    return IOS_OK;
+}
+
+void ios_mock_heap_get_total_stats(struct ios_mock_heap_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < MAX_HEAPS; i++) {
+        if (!heaps[i].used)
+            continue;
+        stats->allocs += heaps[i].stats.allocs;
+        stats->frees += heaps[i].stats.frees;
+        stats->failed += heaps[i].stats.failed;
+        stats->bytes_in_use += heaps[i].stats.bytes_in_use;
+        stats->peak_bytes_in_use += heaps[i].stats.peak_bytes_in_use;
+    }
+}
+
+void ios_mock_heap_reset_stats(int heapid)
+{
+    u32 bytes_in_use;
+
+    if (!heap_is_valid(heapid))
+        return;
+    bytes_in_use = heaps[heapid].stats.bytes_in_use;
+    memset(&heaps[heapid].stats, 0, sizeof(heaps[heapid].stats));
+    heaps[heapid].stats.bytes_in_use = bytes_in_use;
+    heaps[heapid].stats.peak_bytes_in_use = bytes_in_use;
+}
+
+/* Timers, driven by the virtual clock */
+
+int os_create_timer(int time_us, int repeat_time_us, int queueid, uintptr_t message)
+{
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (!timers[i].used) {
+            timers[i].used = true;
+            timers[i].active = true;
+            timers[i].expire_us = now_us + time_us;
+            timers[i].repeat_us = repeat_time_us;
+            timers[i].queueid = queueid;
+            timers[i].message = message;
+            return i;
+        }
+    }
+
+    return IOS_ENOMEM;
+}
+
+int os_stop_timer(int timerid)
+{
+    if (timerid < 0 || timerid >= MAX_TIMERS || !timers[timerid].used)
+        return IOS_EINVAL;
+    timers[timerid].active = false;
+    return IOS_OK;
+}
+
+int os_destroy_timer(int timerid)
+{
+    if (timerid < 0 || timerid >= MAX_TIMERS || !timers[timerid].used)
+        return IOS_EINVAL;
+    timers[timerid].used = false;
+    return IOS_OK;
+}
+
+u64 ios_mock_time_us(void)
+{
+    return now_us;
+}
+
+void ios_mock_advance_time(u32 us)
+{
+    u64 target_us = now_us + us;
+
+    while (1) {
+        int next = -1;
+
+        for (int i = 0; i < MAX_TIMERS; i++) {
+            if (timers[i].used && timers[i].active && timers[i].expire_us <= target_us &&
+                (next < 0 || timers[i].expire_us < timers[next].expire_us))
+                next = i;
+        }
+        if (next < 0)
+            break;
+
+        set_time(timers[next].expire_us);
+        /* Like IOS, a full queue just loses the timer message */
+        os_message_queue_send(timers[next].queueid, (void *)timers[next].message,
+                              IOS_MESSAGE_NOBLOCK);
+        if (timers[next].repeat_us)
+            timers[next].expire_us += timers[next].repeat_us;
+        else
+            timers[next].active = false;
+    }
+
+    set_time(target_us);
+}
+
+/* The host has coherent caches */
+
+void os_sync_before_read(void *ptr, u32 size)
+{
+}
+
+void os_sync_after_write(void *ptr, u32 size)
+{
+}
+
+/* Files */
+
+static inline bool file_is_valid(int fd)
+{
+    return fd >= 0 && fd < MAX_FILES && files[fd].used;
+}
+
+int os_open(const char *path, int mode)
+{
+    static const char *const fopen_modes[] = {
+        [IOS_OPEN_READ] = "rb",
+        [IOS_OPEN_WRITE] = "r+b",
+        [IOS_OPEN_RW] = "r+b",
+    };
+    bool is_fs = !strcmp(path, "/dev/fs");
+    FILE *fp = NULL;
+
+    if (!is_fs) {
+        if (mode < IOS_OPEN_READ || mode > IOS_OPEN_RW)
+            return IOS_EINVAL;
+        fp = fopen(path, fopen_modes[mode]);
+        if (!fp)
+            return IOS_ENOENT;
+    }
+
+    for (int i = 0; i < MAX_FILES; i++) {
+        if (!files[i].used) {
+            files[i].used = true;
+            files[i].is_fs = is_fs;
+            files[i].fp = fp;
+            return i;
+        }
+    }
+
+    if (fp)
+        fclose(fp);
+    return IOS_ENOMEM;
+}
+
+int os_close(int fd)
+{
+    if (!file_is_valid(fd))
+        return IOS_EINVAL;
+    if (files[fd].fp)
+        fclose(files[fd].fp);
+    memset(&files[fd], 0, sizeof(files[fd]));
+    return IOS_OK;
+}
+
+int os_read(int fd, void *data, u32 len)
+{
+    if (!file_is_valid(fd) || !files[fd].fp)
+        return IOS_EINVAL;
+    return fread(data, 1, len, files[fd].fp);
+}
+
+int os_write(int fd, const void *data, u32 len)
+{
+    if (!file_is_valid(fd) || !files[fd].fp)
+        return IOS_EINVAL;
+    if (fwrite(data, 1, len, files[fd].fp) != len)
+        return IOS_EACCES;
+    return len;
+}
+
+int os_ioctl(int fd, u32 request, void *in, u32 in_len, void *out, u32 out_len)
+{
+    char path[ISFS_MAXPATH + 1] = { 0 };
+    FILE *fp;
+
+    if (!file_is_valid(fd) || !files[fd].is_fs)
+        return IOS_EINVAL;
+
+    switch (request) {
+    case ISFS_IOCTL_DELETE:
+        memcpy(path, in, MIN2(in_len, ISFS_MAXPATH));
+        return remove(path) ? IOS_ENOENT : IOS_OK;
+    case ISFS_IOCTL_CREATEFILE:
+        if (in_len < ISFS_ATTR_PATH_OFFSET + ISFS_MAXPATH)
+            return IOS_EINVAL;
+        memcpy(path, (u8 *)in + ISFS_ATTR_PATH_OFFSET, ISFS_MAXPATH);
+        fp = fopen(path, "wxb");
+        if (!fp)
+            return IOS_EEXIST;
+        fclose(fp);
+        return IOS_OK;
+    default:
+        return IOS_EINVAL;
+    }
+}
+
+int os_device_register(const char *devicename, int queueid)
+{
+    return IOS_OK;
+}
@@ -0,0 +1,151 @@
+/* Checks that mapping profile files keep loading as the format grows.
+ *
+ * Each case is a file laid out byte by byte as the version that introduced it wrote it, so that
+ * settings added since then can't get in the way of the older files. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mapping_profile.h"
+#include "syscalls.h"
+#include "wiimote.h"
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static int failures;
+
+/* Two profiles as the first version of the format (before titles, orientation and stick
+ * settings) wrote them: no INHERIT, header bytes 3 and 6 are padding, no title index */
+static const u8 v1_file[] = {
+    /* File header: magic, version, number of profiles, padding */
+    'F', 'K', 'M', 'P', 1, 2, 0, 0,
+    /* Profile 0: Classic by default, 3 bindings, no flags, padding, combos L3+L1, R3+R1, R3 */
+    WIIMOTE_EXT_CLASSIC, 3, 0, 0,
+    0x00, 0x00, 0x02, 0x80,
+    0x00, 0x00, 0x05, 0x00,
+    0x00, 0x00, 0x01, 0x00,
+    MAPPING_PROFILE_TARGET_WIIMOTE_BUTTON, EGC_GAMEPAD_BUTTON_SOUTH, 0x00, 0x08,
+    MAPPING_PROFILE_TARGET_CLASSIC_BUTTON, EGC_GAMEPAD_BUTTON_EAST, 0x00, 0x10,
+    MAPPING_PROFILE_TARGET_CLASSIC_AXIS, EGC_GAMEPAD_AXIS_LEFTX, 0x00, 0x01,
+    /* Profile 1: no extension, no bindings at all */
+    WIIMOTE_EXT_NONE, 0, 0, 0,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+};
+
+/* Two profiles with the settings version 2 added: a title index, the motion orientation and
+ * bindings for the sticks and the extension rotation */
+static const u8 v2_file[] = {
+    /* File header: magic, version, number of profiles, number of titles, padding */
+    'F', 'K', 'M', 'P', 2, 2, 1, 0,
+    /* Profile 0: Nunchuk by default, 2 bindings, INHERIT, held sideways, combos L3+L1, none, R3 */
+    WIIMOTE_EXT_NUNCHUK, 2, MAPPING_PROFILE_FLAG_INHERIT_DEFAULT, BM_MOTION_ORIENTATION_SIDEWAYS,
+    0x00, 0x00, 0x02, 0x80,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x00,
+    MAPPING_PROFILE_TARGET_STICK_DEADZONE, BM_STICK_NUNCHUK, 0x00, 20,
+    MAPPING_PROFILE_TARGET_EXTENSION_ROTATION, 0, 0x00, WIIMOTE_EXT_GUITAR,
+    /* Profile 1: no extension, no bindings at all */
+    WIIMOTE_EXT_NONE, 0, 0, 0,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    /* Titles: game ID, profile, padding */
+    'R', 'S', 'B', 'E', 1, 0, 0, 0,
+};
+
+static void test_v1_file(void)
+{
+    const struct mapping_profile_t *profile;
+
+    CHECK(mapping_profiles_load(v1_file, sizeof(v1_file)) == 2);
+    CHECK(mapping_profiles_count() == 2);
+
+    profile = mapping_profile_get(0);
+    CHECK(profile != &mapping_profile_default);
+    CHECK(profile->default_extension == WIIMOTE_EXT_CLASSIC);
+    CHECK(profile->wiimote_button_map[EGC_GAMEPAD_BUTTON_SOUTH] == WIIMOTE_BUTTON_A);
+    CHECK(profile->wiimote_button_map[EGC_GAMEPAD_BUTTON_EAST] == 0);
+    CHECK(profile->classic_button_map[EGC_GAMEPAD_BUTTON_EAST] == CLASSIC_CTRL_BUTTON_A);
+    CHECK(profile->classic_analog_axis_map[EGC_GAMEPAD_AXIS_LEFTX] == 1);
+    CHECK(profile->switch_extension_combo ==
+          (BIT(EGC_GAMEPAD_BUTTON_LEFT_STICK) | BIT(EGC_GAMEPAD_BUTTON_LEFT_SHOULDER)));
+    /* Settings the file predates keep their defaults */
+    CHECK(profile->motion_orientation == mapping_profile_default.motion_orientation);
+    CHECK(!memcmp(profile->stick_configs, mapping_profile_default.stick_configs,
+                  sizeof(profile->stick_configs)));
+    CHECK(profile->ir_distance == mapping_profile_default.ir_distance);
+    CHECK(profile->ir_gyro_sensitivity == mapping_profile_default.ir_gyro_sensitivity);
+    CHECK(profile->motion_route == mapping_profile_default.motion_route);
+    CHECK(profile->num_extension_rotation == mapping_profile_default.num_extension_rotation);
+    CHECK(!memcmp(profile->extension_rotation, mapping_profile_default.extension_rotation,
+                  sizeof(profile->extension_rotation)));
+
+    profile = mapping_profile_get(1);
+    CHECK(profile->default_extension == WIIMOTE_EXT_NONE);
+    CHECK(mapping_profile_find_title(0x52534245 /* "RSBE" */) == NULL);
+}
+
+static void test_v2_file(void)
+{
+    const struct mapping_profile_t *profile;
+
+    CHECK(mapping_profiles_load(v2_file, sizeof(v2_file)) == 2);
+    CHECK(mapping_profiles_count() == 2);
+
+    profile = mapping_profile_get(0);
+    CHECK(profile->default_extension == WIIMOTE_EXT_NUNCHUK);
+    CHECK(profile->motion_orientation == BM_MOTION_ORIENTATION_SIDEWAYS);
+    /* Inherited, then patched */
+    CHECK(profile->wiimote_button_map[EGC_GAMEPAD_BUTTON_SOUTH] == WIIMOTE_BUTTON_A);
+    CHECK(profile->stick_configs[BM_STICK_NUNCHUK].deadzone == 20);
+    CHECK(profile->stick_configs[BM_STICK_NUNCHUK].saturation ==
+          mapping_profile_default.stick_configs[BM_STICK_NUNCHUK].saturation);
+    CHECK(profile->num_extension_rotation == 1);
+    CHECK(profile->extension_rotation[0] == WIIMOTE_EXT_GUITAR);
+    CHECK(profile->switch_ir_emu_mode_combo == 0);
+
+    profile = mapping_profile_get(1);
+    CHECK(mapping_profile_find_title(0x52534245 /* "RSBE" */) == profile);
+    CHECK(mapping_profile_find_title(0x52534250 /* "RSBP" */) == NULL);
+}
+
+static void test_rejected_file(void)
+{
+    u8 file[sizeof(v2_file)];
+
+    /* A binding out of range rejects the whole file */
+    memcpy(file, v2_file, sizeof(file));
+    file[MAPPING_PROFILE_FILE_HEADER_SIZE + MAPPING_PROFILE_HEADER_SIZE + 1] =
+        EGC_GAMEPAD_BUTTON_COUNT;
+    CHECK(mapping_profiles_load(file, sizeof(file)) == IOS_EINVAL);
+    CHECK(mapping_profiles_count() == 0);
+    CHECK(mapping_profile_get(0) == &mapping_profile_default);
+    CHECK(mapping_profile_find_title(0x52534245) == NULL);
+
+    /* So does a version this loader doesn't know */
+    memcpy(file, v2_file, sizeof(file));
+    file[4] = MAPPING_PROFILES_VERSION + 1;
+    CHECK(mapping_profiles_load(file, sizeof(file)) == IOS_EINVAL);
+}
+
+int main(void)
+{
+    test_v1_file();
+    test_v2_file();
+    test_rejected_file();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("mapping profiles: all checks passed\n");
+    return 0;
+}
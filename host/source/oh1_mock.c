@@ -0,0 +1,59 @@
+#include "hci.h"
+#include "injmessage.h"
+#include "ios_mock.h"
+#include "syscalls.h"
+#include "utils.h"
+
+/* Same depths as the ReadyQs in oh1_hooks.c */
+static void *ready_usb_intr_msg_queue_data[8];
+static int ready_usb_intr_msg_queue_id;
+static void *ready_usb_bulk_in_msg_queue_data[16];
+static int ready_usb_bulk_in_msg_queue_id;
+
+int oh1_mock_init(void)
+{
+    int ret;
+
+    ret = os_message_queue_create(ready_usb_intr_msg_queue_data,
+                                  ARRAY_SIZE(ready_usb_intr_msg_queue_data));
+    if (ret < 0)
+        return ret;
+    ready_usb_intr_msg_queue_id = ret;
+
+    ret = os_message_queue_create(ready_usb_bulk_in_msg_queue_data,
+                                  ARRAY_SIZE(ready_usb_bulk_in_msg_queue_data));
+    if (ret < 0)
+        return ret;
+    ready_usb_bulk_in_msg_queue_id = ret;
+
+    return 0;
+}
+
+int inject_msg_to_usb_intr_ready_queue(void *msg)
+{
+    return os_message_queue_send(ready_usb_intr_msg_queue_id, msg, IOS_MESSAGE_NOBLOCK);
+}
+
+int inject_msg_to_usb_bulk_in_ready_queue(void *msg)
+{
+    return os_message_queue_send(ready_usb_bulk_in_msg_queue_id, msg, IOS_MESSAGE_NOBLOCK);
+}
+
+static void *pop(int queueid)
+{
+    void *msg;
+
+    if (os_message_queue_receive(queueid, &msg, IOS_MESSAGE_NOBLOCK) != IOS_OK)
+        return NULL;
+    return msg;
+}
+
+void *oh1_mock_pop_usb_intr_msg(void)
+{
+    return pop(ready_usb_intr_msg_queue_id);
+}
+
+void *oh1_mock_pop_usb_bulk_in_msg(void)
+{
+    return pop(ready_usb_bulk_in_msg_queue_id);
+}
@@ -0,0 +1,735 @@
+/* Deterministic replay of a capture through the emulation, run natively against the IOS mock.
+ *
+ * A FAKEMOTE_CAPTURE trace holds both the inputs and the outputs of the emulation: the packets
+ * from the BT stack and from the dongle, recorded before any translation, and the packets fakemote
+ * injected, flagged as such. The inputs are fed to hci_state_handle_*() in their recorded order,
+ * interleaved with the ticks and the controller input, which drive the input devices and the fake
+ * Wiimote manager. The clock is virtual. What gets injected is diffed, per endpoint and in order,
+ * against the injected packets of the trace.
+ * The controller input comes from the input records of the trace, or from an input stream
+ * recorded along with it (fakemote_sim --record-inputs). The records only hold the changes and
+ * the number of ticks before each, the ticks in between are spread evenly.
+ * Real Wiimotes' traffic just passes through the translation, so traces where they are
+ * interleaved with fake ones replay the same way.
+ * The Wiimote reports are native endian, so only traces of a build of the host's byte order are
+ * accepted: console traces are refused on little endian hosts. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "egc.h"
+#include "fake_wiimote_mgr.h"
+#include "hci.h"
+#include "hci_state.h"
+#include "injmessage.h"
+#include "input_device.h"
+#include "input_stream.h"
+#include "ios_mock.h"
+#include "utils.h"
+
+#define BTSNOOP_HEADER_SIZE        16
+#define BTSNOOP_RECORD_HEADER_SIZE 24
+#define BTSNOOP_VERSION            1
+#define BTSNOOP_DATALINK_HCI_UNENC 1001
+#define BTSNOOP_FLAG_RECEIVED      BIT(0)
+#define BTSNOOP_FLAG_COMMAND_EVENT BIT(1)
+#define BTSNOOP_EPOCH_DELTA_US     0x00dcddb30f2f8000ull
+
+/* PERIODC_TIMER_PERIOD of oh1_hooks.c */
+#define REPLAY_TICK_PERIOD_US  5000
+/* Size of the hand down messages of oh1_hooks.c */
+#define REPLAY_MAX_PACKET_SIZE 4096
+/* Injected messages waiting for their trace record */
+#define REPLAY_PENDING_DEPTH   1024
+#define REPLAY_MAX_DIFFS_SHOWN 10
+#define REPLAY_DUMP_BYTES      32
+
+enum replay_packet_e {
+    REPLAY_PACKET_HCI_CMD,
+    REPLAY_PACKET_HCI_EVENT,
+    REPLAY_PACKET_ACL_OUT,
+    REPLAY_PACKET_ACL_IN,
+    REPLAY_PACKET__NUM
+};
+
+static const char *const packet_names[REPLAY_PACKET__NUM] = {
+    [REPLAY_PACKET_HCI_CMD] = "HCI command",
+    [REPLAY_PACKET_HCI_EVENT] = "HCI event",
+    [REPLAY_PACKET_ACL_OUT] = "ACL out",
+    [REPLAY_PACKET_ACL_IN] = "ACL in",
+};
+
+struct replay_record_t {
+    u64 time_us;
+    u32 orig_len;
+    u32 incl_len;
+    u8 type;
+    bool injected;
+    const u8 *data;
+};
+
+/* Input record of the trace */
+struct replay_input_t {
+    u64 time_us;
+    u32 tick;
+    struct input_stream_event_t event;
+};
+
+struct replay_tick_t {
+    u64 time_us;
+    /* Events preceding the tick in the stream */
+    u32 first_event;
+    u32 num_events;
+};
+
+/* Injected messages of one endpoint, oldest first */
+struct replay_pending_t {
+    injmessage *msgs[REPLAY_PENDING_DEPTH];
+    u32 head, tail;
+};
+
+static struct replay_record_t *records;
+static u32 num_records;
+static u8 *trace_data;
+
+static struct replay_input_t *trace_inputs;
+static u32 num_trace_inputs;
+
+static struct input_stream_event_t *events;
+static u32 num_events;
+static struct replay_tick_t *ticks;
+static u32 num_ticks;
+
+static egc_input_device_t devices[INPUT_STREAM_MAX_SLOTS];
+static struct replay_pending_t pending_events, pending_acl_in;
+static u8 packet_buf[REPLAY_MAX_PACKET_SIZE] ATTRIBUTE_ALIGN(32);
+
+/* Statistics */
+static u32 packets[REPLAY_PACKET__NUM];
+static u32 injected_packets;
+static u32 truncated_packets;
+static u32 forwarded_packets;
+static u32 state_changes;
+static u32 plugged_before;
+static u32 compared, differ, missing, unexpected;
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline s16 get_be16(const u8 *p)
+{
+    return (s16)(((u16)p[0] << 8) | p[1]);
+}
+
+static inline u32 get_be32(const u8 *p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static inline u64 get_be64(const u8 *p)
+{
+    return ((u64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static void *read_file(const char *path, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    void *data;
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size ? *size : 1);
+    if (data && (fread(data, 1, *size, f) != (size_t)*size)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    if (!data)
+        fprintf(stderr, "%s: read error\n", path);
+    return data;
+}
+
+/* See capture.h for the layout */
+static bool parse_input_record(struct replay_input_t *input, const u8 *data, u32 size)
+{
+    egc_gamepad_state_t *state = &input->event.state;
+    const u8 *p = &data[CAPTURE_INPUT_HEADER_SIZE];
+
+    if ((size < CAPTURE_INPUT_HEADER_SIZE) || (data[0] != HCI_EVENT_VENDOR) ||
+        (data[1] != size - 2) || (data[3] >= INPUT_STREAM_MAX_SLOTS))
+        return false;
+
+    memset(&input->event, 0, sizeof(input->event));
+    input->event.slot = data[3];
+    input->tick = get_be32(&data[4]);
+
+    switch (data[2]) {
+    case CAPTURE_INPUT_ADDED:
+        input->event.type = INPUT_STREAM_ADD;
+        return size == CAPTURE_INPUT_HEADER_SIZE;
+    case CAPTURE_INPUT_REMOVED:
+        input->event.type = INPUT_STREAM_REMOVE;
+        return size == CAPTURE_INPUT_HEADER_SIZE;
+    case CAPTURE_INPUT_STATE:
+        if (size != CAPTURE_INPUT_HEADER_SIZE + CAPTURE_INPUT_STATE_SIZE)
+            return false;
+        input->event.type = INPUT_STREAM_STATE;
+        state->buttons = get_be32(p);
+        p += 4;
+        for (int i = 0; i < EGC_GAMEPAD_AXIS_COUNT; i++, p += 2)
+            state->axes[i] = get_be16(p);
+        for (int i = 0; i < ARRAY_SIZE(state->touch_points); i++, p += 4) {
+            state->touch_points[i].x = get_be16(&p[0]);
+            state->touch_points[i].y = get_be16(&p[2]);
+        }
+        state->accelerometer[0].x = get_be16(&p[0]);
+        state->accelerometer[0].y = get_be16(&p[2]);
+        state->accelerometer[0].z = get_be16(&p[4]);
+        state->gyroscope[0].x = get_be16(&p[6]);
+        state->gyroscope[0].y = get_be16(&p[8]);
+        state->gyroscope[0].z = get_be16(&p[10]);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool load_trace(const char *path)
+{
+    struct replay_record_t *rec;
+    const u8 *p, *end;
+    u32 flags, max_records;
+    long size;
+
+    trace_data = read_file(path, &size);
+    if (!trace_data)
+        return false;
+
+    if ((size < BTSNOOP_HEADER_SIZE) || memcmp(trace_data, "btsnoop", 8) ||
+        (get_be32(&trace_data[8]) != BTSNOOP_VERSION) ||
+        (get_be32(&trace_data[12]) != BTSNOOP_DATALINK_HCI_UNENC)) {
+        fprintf(stderr, "%s: not a btsnoop file of unencapsulated HCI\n", path);
+        return false;
+    }
+
+    max_records = size / BTSNOOP_RECORD_HEADER_SIZE;
+    records = calloc(max_records ? max_records : 1, sizeof(*records));
+    trace_inputs = calloc(max_records ? max_records : 1, sizeof(*trace_inputs));
+    if (!records || !trace_inputs)
+        return false;
+
+    end = trace_data + size;
+    for (p = trace_data + BTSNOOP_HEADER_SIZE; p < end; p += BTSNOOP_RECORD_HEADER_SIZE) {
+        rec = &records[num_records];
+        if (end - p < BTSNOOP_RECORD_HEADER_SIZE)
+            goto truncated;
+        rec->orig_len = get_be32(&p[0]);
+        rec->incl_len = get_be32(&p[4]);
+        flags = get_be32(&p[8]);
+        rec->time_us = get_be64(&p[16]) - BTSNOOP_EPOCH_DELTA_US;
+        if ((rec->incl_len > rec->orig_len) || (rec->orig_len > REPLAY_MAX_PACKET_SIZE) ||
+            (end - p - BTSNOOP_RECORD_HEADER_SIZE < rec->incl_len))
+            goto truncated;
+        rec->data = p + BTSNOOP_RECORD_HEADER_SIZE;
+        p += rec->incl_len;
+
+        if ((flags & BTSNOOP_FLAG_LITTLE_ENDIAN) != BTSNOOP_FLAGS_BYTE_ORDER) {
+            fprintf(stderr, "%s: recorded by a %s endian build (the console is big endian), "
+                    "its Wiimote reports would be misparsed by this one\n", path,
+                    (flags & BTSNOOP_FLAG_LITTLE_ENDIAN) ? "little" : "big");
+            return false;
+        }
+
+        if (flags & BTSNOOP_FLAG_INPUT) {
+            struct replay_input_t *input = &trace_inputs[num_trace_inputs];
+
+            if ((rec->incl_len != rec->orig_len) ||
+                !parse_input_record(input, rec->data, rec->incl_len)) {
+                fprintf(stderr, "%s: bad input record after packet %u\n", path, num_records);
+                return false;
+            }
+            input->time_us = rec->time_us;
+            num_trace_inputs++;
+            continue;
+        }
+
+        if (flags & BTSNOOP_FLAG_COMMAND_EVENT) {
+            rec->type = (flags & BTSNOOP_FLAG_RECEIVED) ? REPLAY_PACKET_HCI_EVENT :
+                                                          REPLAY_PACKET_HCI_CMD;
+        } else {
+            rec->type = (flags & BTSNOOP_FLAG_RECEIVED) ? REPLAY_PACKET_ACL_IN :
+                                                          REPLAY_PACKET_ACL_OUT;
+        }
+        rec->injected = !!(flags & BTSNOOP_FLAG_INJECTED);
+
+        packets[rec->type]++;
+        injected_packets += rec->injected;
+        truncated_packets += rec->incl_len < rec->orig_len;
+        num_records++;
+    }
+
+    return true;
+
+truncated:
+    fprintf(stderr, "%s: bad or truncated record %u\n", path, num_records);
+    return false;
+}
+
+static bool load_inputs(const char *path)
+{
+    struct input_stream_event_t event;
+    u32 max_events = 0, max_ticks = 0, first_event = 0, line = 0;
+    FILE *f;
+    int ret;
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    while ((ret = input_stream_read(f, &event, &line)) > 0) {
+        if (event.type == INPUT_STREAM_TICK) {
+            if (num_ticks == max_ticks) {
+                max_ticks = max_ticks ? 2 * max_ticks : 1024;
+                ticks = realloc(ticks, max_ticks * sizeof(*ticks));
+                if (!ticks)
+                    break;
+            }
+            if (num_ticks && (event.time_us < ticks[num_ticks - 1].time_us)) {
+                fprintf(stderr, "%s:%u: tick goes back in time\n", path, line);
+                ret = -2;
+                break;
+            }
+            ticks[num_ticks].time_us = event.time_us;
+            ticks[num_ticks].first_event = first_event;
+            ticks[num_ticks].num_events = num_events - first_event;
+            first_event = num_events;
+            num_ticks++;
+        } else {
+            if (num_events == max_events) {
+                max_events = max_events ? 2 * max_events : 256;
+                events = realloc(events, max_events * sizeof(*events));
+                if (!events)
+                    break;
+            }
+            events[num_events++] = event;
+            state_changes += event.type == INPUT_STREAM_STATE;
+        }
+    }
+    fclose(f);
+
+    if (ret == -1)
+        fprintf(stderr, "%s:%u: malformed line\n", path, line);
+    else if ((ret == 0) && (num_events != first_event))
+        fprintf(stderr, "%s: ignoring the events after the last tick\n", path);
+    return (ret == 0) && (!num_ticks || ticks) && (!num_events || events);
+}
+
+static bool push_event(const struct input_stream_event_t *event, u32 *max_events)
+{
+    if (num_events == *max_events) {
+        *max_events = *max_events ? 2 * *max_events : 256;
+        events = realloc(events, *max_events * sizeof(*events));
+        if (!events)
+            return false;
+    }
+    events[num_events++] = *event;
+    state_changes += event->type == INPUT_STREAM_STATE;
+    return true;
+}
+
+static u32 last_of_tick(u32 i)
+{
+    while ((i + 1 < num_trace_inputs) && (trace_inputs[i + 1].tick == trace_inputs[i].tick))
+        i++;
+    return i;
+}
+
+/* Time of tick n. The last record of a tick is the closest to it: between two such records the
+ * ticks are spread evenly, before the first and after the last one they're a period apart */
+static u64 tick_time(u32 n, u32 *anchor)
+{
+    const struct replay_input_t *a, *b;
+
+    *anchor = last_of_tick(*anchor);
+    while ((*anchor + 1 < num_trace_inputs) && (trace_inputs[*anchor + 1].tick <= n))
+        *anchor = last_of_tick(*anchor + 1);
+    a = &trace_inputs[*anchor];
+
+    if (n <= a->tick)
+        return a->time_us - (u64)(a->tick - n) * REPLAY_TICK_PERIOD_US;
+    if (*anchor + 1 == num_trace_inputs)
+        return a->time_us + (u64)(n - a->tick) * REPLAY_TICK_PERIOD_US;
+    b = &trace_inputs[last_of_tick(*anchor + 1)];
+    return a->time_us + (b->time_us - a->time_us) * (n - a->tick) / (b->tick - a->tick);
+}
+
+/* Turns the input records of the trace into the events and ticks an input stream would give */
+static bool inputs_from_trace(u64 start_us, u64 end_us)
+{
+    const struct replay_input_t *first = &trace_inputs[0];
+    const struct replay_input_t *last = &trace_inputs[num_trace_inputs - 1];
+    struct input_stream_event_t add = { .type = INPUT_STREAM_ADD };
+    bool plugged[INPUT_STREAM_MAX_SLOTS] = { false };
+    u32 max_events = 0, anchor = 0, input_i = 0;
+    u32 first_tick, last_tick, n, tick;
+
+    /* Every record is made during the tick it counts, or right before it */
+    first_tick =
+        first->tick - MIN2(first->tick, (first->time_us - start_us) / REPLAY_TICK_PERIOD_US);
+    last_tick = last->tick + (end_us - MIN2(end_us, last->time_us)) / REPLAY_TICK_PERIOD_US;
+
+    num_ticks = last_tick - first_tick + 1;
+    ticks = calloc(num_ticks, sizeof(*ticks));
+    if (!ticks)
+        return false;
+
+    for (n = first_tick; n <= last_tick; n++) {
+        struct replay_tick_t *t = &ticks[n - first_tick];
+
+        t->time_us = tick_time(n, &anchor);
+        t->first_event = num_events;
+        for (; input_i < num_trace_inputs; input_i++) {
+            const struct input_stream_event_t *event = &trace_inputs[input_i].event;
+
+            tick = MAX2(trace_inputs[input_i].tick, first_tick);
+            if (tick > n)
+                break;
+
+            switch (event->type) {
+            case INPUT_STREAM_ADD:
+                if (plugged[event->slot])
+                    continue;
+                plugged[event->slot] = true;
+                break;
+            case INPUT_STREAM_REMOVE:
+                /* Unless it was added before the trace, it's known */
+                if (!plugged[event->slot]) {
+                    plugged_before++;
+                    continue;
+                }
+                plugged[event->slot] = false;
+                break;
+            case INPUT_STREAM_STATE:
+                if (!plugged[event->slot]) {
+                    /* Plugged in before the trace starts */
+                    plugged_before++;
+                    plugged[event->slot] = true;
+                    add.slot = event->slot;
+                    if (!push_event(&add, &max_events))
+                        return false;
+                }
+                break;
+            case INPUT_STREAM_TICK:
+                break;
+            }
+            if (!push_event(event, &max_events))
+                return false;
+        }
+        t->num_events = num_events - t->first_event;
+    }
+
+    return true;
+}
+
+/* Same initialization as ensure_initalized() in oh1_hooks.c */
+static void replay_init(void)
+{
+    ios_mock_reset();
+    oh1_mock_init();
+    injmessage_init_heap();
+    hci_state_reset();
+    input_devices_init();
+    fake_wiimote_mgr_init();
+    egc_initialize(input_device_handle_added, input_device_handle_removed, NULL);
+}
+
+static void advance_clock(u64 time_us)
+{
+    u64 now = ios_mock_time_us();
+
+    /* Traces don't start at 0, the first record sets the clock */
+    while (time_us > now) {
+        ios_mock_advance_time(MIN2(time_us - now, (u64)UINT32_MAX));
+        now = ios_mock_time_us();
+    }
+}
+
+static void pending_push(struct replay_pending_t *pending, injmessage *msg)
+{
+    if (pending->head - pending->tail == REPLAY_PENDING_DEPTH) {
+        /* Nothing in the trace claimed these, they'll never match */
+        unexpected++;
+        injmessage_free(msg);
+        return;
+    }
+    pending->msgs[pending->head++ % REPLAY_PENDING_DEPTH] = msg;
+}
+
+static injmessage *pending_pop(struct replay_pending_t *pending)
+{
+    if (pending->head == pending->tail)
+        return NULL;
+    return pending->msgs[pending->tail++ % REPLAY_PENDING_DEPTH];
+}
+
+/* Moves the injected messages out of the ReadyQs, so that they never fill up */
+static void collect_injected(void)
+{
+    void *msg;
+
+    while ((msg = oh1_mock_pop_usb_intr_msg()))
+        pending_push(&pending_events, msg);
+    while ((msg = oh1_mock_pop_usb_bulk_in_msg()))
+        pending_push(&pending_acl_in, msg);
+}
+
+static void dump_bytes(const char *label, const u8 *data, u32 size)
+{
+    printf("  %-9s", label);
+    for (u32 i = 0; i < MIN2(size, REPLAY_DUMP_BYTES); i++)
+        printf(" %02x", data[i]);
+    printf("%s\n", (size > REPLAY_DUMP_BYTES) ? " ..." : "");
+}
+
+static void report_diff(u32 index, const struct replay_record_t *rec, const injmessage *msg,
+                        const char *what)
+{
+    if (differ + missing > REPLAY_MAX_DIFFS_SHOWN)
+        return;
+
+    printf("#%u at %.3f ms, injected %s: %s\n", index,
+           (double)(rec->time_us - records[0].time_us) / 1000, packet_names[rec->type], what);
+    dump_bytes("expected:", rec->data, rec->incl_len);
+    if (msg)
+        dump_bytes("got:", msg->data, msg->size);
+    if (differ + missing == REPLAY_MAX_DIFFS_SHOWN)
+        printf("(further differences not shown)\n");
+}
+
+static void compare_injected(u32 index, const struct replay_record_t *rec)
+{
+    struct replay_pending_t *pending;
+    injmessage *msg;
+    char what[64];
+    u32 i;
+
+    pending = (rec->type == REPLAY_PACKET_HCI_EVENT) ? &pending_events : &pending_acl_in;
+    msg = pending_pop(pending);
+    if (!msg) {
+        missing++;
+        report_diff(index, rec, NULL, "not injected");
+        return;
+    }
+
+    compared++;
+    for (i = 0; i < MIN2(rec->incl_len, msg->size); i++) {
+        if (rec->data[i] != msg->data[i])
+            break;
+    }
+    if ((msg->size != rec->orig_len) || (i < rec->incl_len)) {
+        differ++;
+        snprintf(what, sizeof(what), "%u bytes, got %u, first difference at byte %u",
+                 rec->orig_len, msg->size, i);
+        report_diff(index, rec, msg, what);
+    }
+    injmessage_free(msg);
+}
+
+static void replay_record(u32 index, const struct replay_record_t *rec)
+{
+    bool fwd_to_usb;
+
+    advance_clock(rec->time_us);
+
+    if (rec->injected) {
+        compare_injected(index, rec);
+        return;
+    }
+
+    /* The handlers translate in place. Truncated packets are zero filled */
+    memcpy(packet_buf, rec->data, rec->incl_len);
+    memset(packet_buf + rec->incl_len, 0, rec->orig_len - rec->incl_len);
+
+    switch (rec->type) {
+    case REPLAY_PACKET_HCI_CMD:
+        fwd_to_usb = true;
+        hci_state_handle_hci_cmd_from_host(packet_buf, rec->orig_len, &fwd_to_usb);
+        forwarded_packets += fwd_to_usb;
+        break;
+    case REPLAY_PACKET_HCI_EVENT:
+        hci_state_handle_hci_event_from_controller(packet_buf, rec->orig_len);
+        break;
+    case REPLAY_PACKET_ACL_OUT:
+        fwd_to_usb = true;
+        hci_state_handle_acl_data_out_request_from_host(packet_buf, rec->orig_len, &fwd_to_usb);
+        forwarded_packets += fwd_to_usb;
+        break;
+    case REPLAY_PACKET_ACL_IN:
+        hci_state_handle_acl_data_in_response_from_controller(packet_buf, rec->orig_len);
+        break;
+    }
+}
+
+static void replay_tick(const struct replay_tick_t *tick)
+{
+    const struct input_stream_event_t *event;
+    egc_input_device_t *device;
+
+    advance_clock(tick->time_us);
+
+    /* egc reports device changes from egc_handle_events(), that is on ticks */
+    for (u32 i = 0; i < tick->num_events; i++) {
+        event = &events[tick->first_event + i];
+        device = &devices[event->slot];
+        switch (event->type) {
+        case INPUT_STREAM_ADD:
+            memset(device, 0, sizeof(*device));
+            device->desc = &egc_stub_gamepad_desc;
+            egc_stub_add_device(device);
+            break;
+        case INPUT_STREAM_REMOVE:
+            egc_stub_remove_device(device);
+            break;
+        case INPUT_STREAM_STATE:
+            device->state.gamepad = event->state;
+            break;
+        case INPUT_STREAM_TICK:
+            break;
+        }
+    }
+
+    /* What the periodic timer of oh1_hooks.c does */
+    egc_handle_events();
+    input_devices_tick();
+    fake_wiimote_mgr_tick_devices();
+}
+
+static u32 count_pending(struct replay_pending_t *pending)
+{
+    injmessage *msg;
+    u32 count = 0;
+
+    while ((msg = pending_pop(pending))) {
+        injmessage_free(msg);
+        count++;
+    }
+    return count;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s TRACE.btsnoop [INPUTS.txt]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const struct replay_record_t *first;
+    u32 rec_i = 0, tick_i = 0, replayed_ticks;
+    u64 end_us, wall_ns;
+    double duration_s;
+    bool incomplete = false;
+
+    if ((argc != 2) && (argc != 3)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!load_trace(argv[1]))
+        return 2;
+    if (!num_records) {
+        fprintf(stderr, "%s: empty trace\n", argv[1]);
+        return 2;
+    }
+    first = &records[0];
+    end_us = records[num_records - 1].time_us;
+
+    /* An input stream takes precedence over the input records */
+    if (argc == 3) {
+        if (!load_inputs(argv[2]))
+            return 2;
+    } else if (!num_trace_inputs) {
+        fprintf(stderr, "%s: no controller input in the trace, pass the input stream recorded "
+                "along with it\n", argv[1]);
+        return 2;
+    } else if (!inputs_from_trace(first->time_us, end_us)) {
+        return 2;
+    }
+
+    /* Whatever is missing from the trace makes the emulation diverge, say so up front */
+    if ((first->type != REPLAY_PACKET_HCI_CMD) || (first->incl_len < sizeof(hci_cmd_hdr_t)) ||
+        (le16toh(((const hci_cmd_hdr_t *)first->data)->opcode) != HCI_CMD_RESET)) {
+        incomplete = true;
+        printf("incomplete trace: it doesn't start with HCI_Reset, the capture ring wrapped and "
+               "what the BT stack set up before is unknown\n");
+    }
+    if (plugged_before) {
+        incomplete = true;
+        printf("incomplete trace: %u controller(s) plugged in before it starts, added at their "
+               "first recorded state\n", plugged_before);
+    }
+    if (truncated_packets) {
+        incomplete = true;
+        printf("incomplete trace: %u packets truncated to the capture's snaplen, replayed zero "
+               "filled and compared on their captured bytes only\n", truncated_packets);
+    }
+
+    replay_init();
+    advance_clock(first->time_us);
+
+    /* Stop with the trace: later ticks would inject what was never captured */
+    while ((num_ticks > tick_i) && (ticks[num_ticks - 1].time_us > end_us))
+        num_ticks--;
+
+    wall_ns = now_ns();
+    while ((rec_i < num_records) || (tick_i < num_ticks)) {
+        /* The timer message is queued before whatever the BT stack sends at the same time */
+        if ((tick_i < num_ticks) &&
+            ((rec_i == num_records) || (ticks[tick_i].time_us <= records[rec_i].time_us))) {
+            replay_tick(&ticks[tick_i++]);
+        } else {
+            replay_record(rec_i, &records[rec_i]);
+            rec_i++;
+        }
+        collect_injected();
+    }
+    wall_ns = now_ns() - wall_ns;
+    replayed_ticks = tick_i;
+
+    unexpected += count_pending(&pending_events) + count_pending(&pending_acl_in);
+
+    duration_s = (double)(end_us - first->time_us) / 1e6;
+    printf("trace: %u packets in %.3f s: %u HCI commands, %u HCI events, %u ACL out, %u ACL in, "
+           "%u injected, %u truncated\n",
+           num_records, duration_s, packets[REPLAY_PACKET_HCI_CMD],
+           packets[REPLAY_PACKET_HCI_EVENT], packets[REPLAY_PACKET_ACL_OUT],
+           packets[REPLAY_PACKET_ACL_IN], injected_packets, truncated_packets);
+    printf("inputs: %u ticks replayed, %u state changes\n", replayed_ticks, state_changes);
+    printf("replay: %u packets forwarded to the dongle, %u injected packets compared\n",
+           forwarded_packets, compared);
+    printf("diff: %u differ, %u missing, %u unexpected%s\n", differ, missing, unexpected,
+           (incomplete && (differ || missing || unexpected)) ?
+               " (expected from an incomplete trace)" :
+               "");
+    printf("throughput: %.0f ns/packet, %.0f packets/s wall clock, %.0fx real time\n",
+           (double)wall_ns / num_records, num_records * 1e9 / (wall_ns ? wall_ns : 1),
+           wall_ns ? duration_s * 1e9 / wall_ns : 0.0);
+
+    return (differ || missing || unexpected) ? 1 : 0;
+}
@@ -0,0 +1,1087 @@
+/* End-to-end simulation of a Wii with fake Wiimotes, run natively against the IOS mock.
+ *
+ * Three parties talk through the same OH1 message queue as on the console:
+ *  - a model of the Wii's BT stack (WPAD), which posts the /dev/usb/oh1 requests a game would:
+ *    the HCI init sequence, accepting connections, the L2CAP channel setup and the HID output
+ *    reports that start data reporting,
+ *  - the OH1 hooks from source/oh1_hooks.c, unchanged, with their PendingQ/ReadyQ handling,
+ *  - a model of the BT dongle, which answers the HCI commands handed down to it.
+ * Controllers are stub egc gamepads. Time is virtual, so the connection times and the latencies
+ * are deterministic; only the wall clock cost per report depends on the machine. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "egc.h"
+#include "fake_wiimote.h"
+#include "fake_wiimote_mgr.h"
+#include "fakemote_dev.h"
+#include "hci.h"
+#include "input_stream.h"
+#include "ios_mock.h"
+#include "l2cap.h"
+#include "oh1_hooks.h"
+#include "syscalls.h"
+#include "utils.h"
+#include "wiimote.h"
+
+#define SIM_STEP_US            1000
+#define SIM_CONNECT_TIMEOUT_US (5 * 1000 * 1000)
+#define SIM_INPUT_PERIOD_US    13000 /* Button toggle period, per controller */
+#define SIM_INPUT_PHASE_US     3000  /* Offset between the controllers' toggles */
+#define SIM_DEFAULT_DURATION   10    /* s */
+#define SIM_OH1_FD             1
+#define SIM_OH1_QUEUE_DEPTH    64
+#define SIM_NUM_REQUESTS       32
+#define SIM_REQUEST_DATA_SIZE  512
+#define SIM_NUM_HCI_CMDS       16
+#define SIM_HCI_CMD_MAX_PARAMS 32
+#define SIM_NUM_DONGLE_EVENTS  8
+#define SIM_DONGLE_EVENT_SIZE  64
+#define SIM_DONGLE_MAX_KEYS    8
+#define SIM_HOST_CID_BASE      0x40
+
+/* One /dev/usb/oh1 request from the BT stack. The ack callback gets the ipcmessage back */
+struct sim_request_t {
+    ipcmessage msg;
+    ioctlv vector[7];
+    bool busy;
+    u8 bmRequestType;
+    u8 bRequest;
+    u8 unknown;
+    u8 ep;
+    u16 wValue;
+    u16 wIndex;
+    u16 wLength;
+    u16 len;
+    u8 data[SIM_REQUEST_DATA_SIZE] ATTRIBUTE_ALIGN(32);
+};
+
+struct sim_hci_cmd_t {
+    u16 opcode;
+    u8 size;
+    u8 params[SIM_HCI_CMD_MAX_PARAMS];
+};
+
+enum sim_channel_e {
+    SIM_CHANNEL_CNTL,
+    SIM_CHANNEL_INTR,
+    SIM_CHANNEL__NUM
+};
+
+struct sim_channel_t {
+    u16 local_cid;
+    u16 remote_cid;
+    bool local_configured;  /* Our Configuration Request got its response */
+    bool remote_configured; /* We answered theirs */
+};
+
+struct sim_controller_t {
+    egc_input_device_t egc;
+    bool connected;
+    bool ready;
+    bool streaming;
+    bool extension_initialized;
+    u16 con_handle;
+    struct sim_channel_t channels[SIM_CHANNEL__NUM];
+    /* Virtual times */
+    u64 con_req_us;
+    u64 con_compl_us;
+    u64 ready_us;
+    u64 first_report_us;
+    /* Measurement */
+    bool pressed;
+    bool latency_pending;
+    u64 toggle_us;
+    u64 next_toggle_us;
+    u32 reports;
+    u32 latency_samples;
+    u32 latency_missed;
+    u64 latency_min_us;
+    u64 latency_max_us;
+    u64 latency_sum_us;
+};
+
+static void *oh1_queue_data[SIM_OH1_QUEUE_DEPTH];
+static struct sim_request_t requests[SIM_NUM_REQUESTS];
+
+/* BT stack state */
+static struct sim_controller_t controllers[MAX_FAKE_WIIMOTES];
+static int num_controllers = MAX_FAKE_WIIMOTES;
+static u8 report_mode = INPUT_REPORT_ID_BTN_ACC_IR_EXP;
+static struct sim_hci_cmd_t hci_cmds[SIM_NUM_HCI_CMDS];
+static u32 hci_cmds_head, hci_cmds_tail;
+static u16 hci_cmd_outstanding;
+static u8 l2cap_ident;
+static u64 scan_enable_us;
+static bool scan_enabled;
+static u16 stored_link_keys_read;
+static u16 returned_link_keys;
+static u32 errors;
+
+/* Dongle state */
+static ipcmessage *dongle_intr_read;
+static ipcmessage *dongle_bulk_in_read;
+static struct {
+    u8 data[SIM_DONGLE_EVENT_SIZE];
+    u16 size;
+} dongle_events[SIM_NUM_DONGLE_EVENTS];
+static u32 dongle_events_head, dongle_events_tail;
+static u32 dongle_acl_out_packets;
+
+/* Input recording for fakemote_replay */
+static FILE *inputs_file;
+static egc_gamepad_state_t recorded_states[MAX_FAKE_WIIMOTES];
+
+static const bdaddr_t dongle_bdaddr = {
+    .b = { 0x01, 0x00, 0x00, 0x09, 0x17, 0x00 }
+};
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double us_to_ms(u64 us)
+{
+    return us / 1000.0;
+}
+
+/* Requests */
+
+static struct sim_request_t *request_alloc(void)
+{
+    for (int i = 0; i < ARRAY_SIZE(requests); i++) {
+        if (!requests[i].busy) {
+            memset(&requests[i], 0, offsetof(struct sim_request_t, data));
+            requests[i].busy = true;
+            return &requests[i];
+        }
+    }
+
+    fprintf(stderr, "sim: out of requests\n");
+    abort();
+}
+
+static void request_free(struct sim_request_t *req)
+{
+    req->busy = false;
+}
+
+static void request_post(struct sim_request_t *req)
+{
+    int ret = os_message_queue_send(orig_msg_queueid, &req->msg, IOS_MESSAGE_NOBLOCK);
+
+    if (ret != IOS_OK) {
+        fprintf(stderr, "sim: request queue full (%d)\n", ret);
+        abort();
+    }
+}
+
+static void request_setup_ioctlv(struct sim_request_t *req, u32 cmd, u32 num_in, u32 num_io)
+{
+    req->msg.command = IOS_IOCTLV;
+    req->msg.fd = SIM_OH1_FD;
+    req->msg.ioctlv.command = cmd;
+    req->msg.ioctlv.num_in = num_in;
+    req->msg.ioctlv.num_io = num_io;
+    req->msg.ioctlv.vector = req->vector;
+}
+
+/* Interrupt and bulk requests share a layout: endpoint, length, buffer */
+static void request_setup_intr_bulk(struct sim_request_t *req, u32 cmd, u8 ep, u16 len)
+{
+    req->ep = ep;
+    req->len = len;
+    req->vector[0] = (ioctlv){ &req->ep, sizeof(req->ep) };
+    req->vector[1] = (ioctlv){ &req->len, sizeof(req->len) };
+    req->vector[2] = (ioctlv){ req->data, len };
+    request_setup_ioctlv(req, cmd, 2, 1);
+}
+
+static void post_read(u32 cmd, u8 ep)
+{
+    struct sim_request_t *req = request_alloc();
+
+    request_setup_intr_bulk(req, cmd, ep, sizeof(req->data));
+    request_post(req);
+}
+
+/* BT stack: HCI commands, sent one at a time like WPAD does */
+
+static void host_send_next_hci_cmd(void)
+{
+    struct sim_hci_cmd_t *cmd;
+    struct sim_request_t *req;
+    hci_cmd_hdr_t *hdr;
+    u16 size;
+
+    if (hci_cmd_outstanding || (hci_cmds_head == hci_cmds_tail))
+        return;
+
+    cmd = &hci_cmds[hci_cmds_head++ % ARRAY_SIZE(hci_cmds)];
+    size = sizeof(*hdr) + cmd->size;
+
+    req = request_alloc();
+    hdr = (void *)req->data;
+    hdr->opcode = htole16(cmd->opcode);
+    hdr->length = cmd->size;
+    memcpy(hdr + 1, cmd->params, cmd->size);
+
+    req->bmRequestType = 0x20;
+    req->bRequest = EP_HCI_CTRL;
+    req->wLength = htole16(size);
+    req->vector[0] = (ioctlv){ &req->bmRequestType, sizeof(req->bmRequestType) };
+    req->vector[1] = (ioctlv){ &req->bRequest, sizeof(req->bRequest) };
+    req->vector[2] = (ioctlv){ &req->wValue, sizeof(req->wValue) };
+    req->vector[3] = (ioctlv){ &req->wIndex, sizeof(req->wIndex) };
+    req->vector[4] = (ioctlv){ &req->wLength, sizeof(req->wLength) };
+    req->vector[5] = (ioctlv){ &req->unknown, sizeof(req->unknown) };
+    req->vector[6] = (ioctlv){ req->data, size };
+    request_setup_ioctlv(req, USBV0_IOCTLV_CTRLMSG, 6, 1);
+
+    hci_cmd_outstanding = cmd->opcode;
+    request_post(req);
+}
+
+static void host_queue_hci_cmd(u16 opcode, const void *params, u8 size)
+{
+    struct sim_hci_cmd_t *cmd;
+
+    assert(size <= SIM_HCI_CMD_MAX_PARAMS);
+    assert(hci_cmds_tail - hci_cmds_head < ARRAY_SIZE(hci_cmds));
+
+    cmd = &hci_cmds[hci_cmds_tail++ % ARRAY_SIZE(hci_cmds)];
+    cmd->opcode = opcode;
+    cmd->size = size;
+    memcpy(cmd->params, params, size);
+
+    host_send_next_hci_cmd();
+}
+
+static void host_hci_cmd_done(u16 opcode)
+{
+    if (opcode != hci_cmd_outstanding)
+        return;
+
+    hci_cmd_outstanding = 0;
+    host_send_next_hci_cmd();
+}
+
+static void host_queue_init_hci_cmds(void)
+{
+    hci_write_unit_class_cp unit_class = {
+        .uclass = { 0x04, 0x02, 0x40 }
+    };
+    hci_read_stored_link_key_cp read_keys = {
+        .read_all = 1
+    };
+    hci_write_scan_enable_cp scan_enable = {
+        .scan_enable = HCI_PAGE_SCAN_ENABLE
+    };
+
+    host_queue_hci_cmd(HCI_CMD_RESET, NULL, 0);
+    host_queue_hci_cmd(HCI_CMD_READ_BDADDR, NULL, 0);
+    host_queue_hci_cmd(HCI_CMD_READ_BUFFER_SIZE, NULL, 0);
+    host_queue_hci_cmd(HCI_CMD_WRITE_UNIT_CLASS, &unit_class, sizeof(unit_class));
+    host_queue_hci_cmd(HCI_CMD_READ_STORED_LINK_KEY, &read_keys, sizeof(read_keys));
+    host_queue_hci_cmd(HCI_CMD_WRITE_SCAN_ENABLE, &scan_enable, sizeof(scan_enable));
+}
+
+/* BT stack: controllers */
+
+static struct sim_controller_t *host_find_controller_by_bdaddr(const bdaddr_t *bdaddr)
+{
+    for (int i = 0; i < num_controllers; i++) {
+        if (bacmp(bdaddr, &FAKE_WIIMOTE_BDADDR(i)) == 0)
+            return &controllers[i];
+    }
+    return NULL;
+}
+
+static struct sim_controller_t *host_find_controller_by_con_handle(u16 con_handle)
+{
+    for (int i = 0; i < num_controllers; i++) {
+        if (controllers[i].connected && (controllers[i].con_handle == con_handle))
+            return &controllers[i];
+    }
+    return NULL;
+}
+
+static struct sim_channel_t *host_find_channel(struct sim_controller_t *ctrl, u16 local_cid)
+{
+    for (int i = 0; i < SIM_CHANNEL__NUM; i++) {
+        if (ctrl->channels[i].local_cid == local_cid)
+            return &ctrl->channels[i];
+    }
+    return NULL;
+}
+
+static void host_send_acl(struct sim_controller_t *ctrl, u16 dcid, const void *data, u16 size)
+{
+    struct sim_request_t *req = request_alloc();
+    hci_acldata_hdr_t *acl = (void *)req->data;
+    l2cap_hdr_t *l2cap = (void *)(acl + 1);
+    u16 total = sizeof(*acl) + sizeof(*l2cap) + size;
+
+    assert(total <= sizeof(req->data));
+    acl->con_handle = htole16(HCI_MK_CON_HANDLE(ctrl->con_handle, 2, 0));
+    acl->length = htole16(sizeof(*l2cap) + size);
+    l2cap->length = htole16(size);
+    l2cap->dcid = htole16(dcid);
+    memcpy(l2cap + 1, data, size);
+
+    request_setup_intr_bulk(req, USBV0_IOCTLV_BLKMSG, EP_ACL_DATA_OUT, total);
+    request_post(req);
+}
+
+static void host_send_l2cap_cmd(struct sim_controller_t *ctrl, u8 code, u8 ident,
+                                const void *payload, u16 size)
+{
+    u8 buf[sizeof(l2cap_cmd_hdr_t) + 32];
+    l2cap_cmd_hdr_t *hdr = (void *)buf;
+
+    assert(size <= sizeof(buf) - sizeof(*hdr));
+    hdr->code = code;
+    hdr->ident = ident;
+    hdr->length = htole16(size);
+    memcpy(hdr + 1, payload, size);
+
+    host_send_acl(ctrl, L2CAP_SIGNAL_CID, buf, sizeof(*hdr) + size);
+}
+
+static void host_send_config_req(struct sim_controller_t *ctrl, struct sim_channel_t *chn)
+{
+    u8 buf[sizeof(l2cap_cfg_req_cp) + sizeof(l2cap_cfg_opt_t) + L2CAP_OPT_MTU_SIZE];
+    l2cap_cfg_req_cp *req = (void *)buf;
+    l2cap_cfg_opt_t *opt = (void *)(req + 1);
+    u16 mtu = htole16(WII_REQUEST_MTU);
+
+    req->dcid = htole16(chn->remote_cid);
+    req->flags = 0;
+    opt->type = L2CAP_OPT_MTU;
+    opt->length = L2CAP_OPT_MTU_SIZE;
+    memcpy(opt + 1, &mtu, sizeof(mtu));
+
+    host_send_l2cap_cmd(ctrl, L2CAP_CONFIG_REQ, ++l2cap_ident, buf, sizeof(buf));
+}
+
+static void host_send_output_report(struct sim_controller_t *ctrl, u8 report_id,
+                                    const void *payload, u16 size)
+{
+    u8 buf[2 + 32];
+
+    assert(size <= sizeof(buf) - 2);
+    buf[0] = (HID_TYPE_DATA << 4) | HID_PARAM_OUTPUT;
+    buf[1] = report_id;
+    memcpy(&buf[2], payload, size);
+
+    host_send_acl(ctrl, ctrl->channels[SIM_CHANNEL_INTR].remote_cid, buf, 2 + size);
+}
+
+static void host_write_register(struct sim_controller_t *ctrl, u8 slave_address, u16 address,
+                                u8 value)
+{
+    struct wiimote_output_report_write_data_t write;
+
+    memset(&write, 0, sizeof(write));
+    write.space = ADDRESS_SPACE_I2C_BUS;
+    write.slave_address = slave_address;
+    write.address = address;
+    write.size = 1;
+    write.data[0] = value;
+    host_send_output_report(ctrl, OUTPUT_REPORT_ID_WRITE_DATA, &write, sizeof(write));
+}
+
+static void host_read_data(struct sim_controller_t *ctrl, u8 space, u8 slave_address,
+                           u16 address, u16 size)
+{
+    struct wiimote_output_report_read_data_t read;
+
+    memset(&read, 0, sizeof(read));
+    read.space = space;
+    read.slave_address = slave_address;
+    read.address = address;
+    read.size = size;
+    host_send_output_report(ctrl, OUTPUT_REPORT_ID_READ_DATA, &read, sizeof(read));
+}
+
+static void host_set_report_mode(struct sim_controller_t *ctrl)
+{
+    struct wiimote_output_report_mode_t mode;
+
+    memset(&mode, 0, sizeof(mode));
+    mode.continuous = 1;
+    mode.mode = report_mode;
+    host_send_output_report(ctrl, OUTPUT_REPORT_ID_REPORT_MODE, &mode, sizeof(mode));
+}
+
+/* What WPAD does once both HID channels are up */
+static void host_check_controller_ready(struct sim_controller_t *ctrl)
+{
+    struct wiimote_output_report_led_t led;
+    u8 rumble = 0;
+
+    if (ctrl->ready)
+        return;
+
+    for (int i = 0; i < SIM_CHANNEL__NUM; i++) {
+        if (!ctrl->channels[i].local_configured || !ctrl->channels[i].remote_configured)
+            return;
+    }
+
+    ctrl->ready = true;
+    ctrl->ready_us = ios_mock_time_us();
+
+    memset(&led, 0, sizeof(led));
+    led.leds = BIT(ctrl - controllers);
+    host_send_output_report(ctrl, OUTPUT_REPORT_ID_LED, &led, sizeof(led));
+    host_send_output_report(ctrl, OUTPUT_REPORT_ID_STATUS, &rumble, sizeof(rumble));
+    /* Calibration data */
+    host_read_data(ctrl, ADDRESS_SPACE_EEPROM, 0, 0x0016, 10);
+    host_set_report_mode(ctrl);
+}
+
+static void host_handle_l2cap_signal(struct sim_controller_t *ctrl, const u8 *data, u16 length)
+{
+    const l2cap_cmd_hdr_t *hdr;
+    const void *payload;
+    struct sim_channel_t *chn;
+    u16 cmd_len;
+
+    while (length >= sizeof(*hdr)) {
+        hdr = (const void *)data;
+        cmd_len = le16toh(hdr->length);
+        payload = hdr + 1;
+
+        switch (hdr->code) {
+        case L2CAP_CONNECT_REQ: {
+            const l2cap_con_req_cp *req = payload;
+            l2cap_con_rsp_cp rsp;
+            u16 psm = le16toh(req->psm);
+
+            if (psm == L2CAP_PSM_HID_CNTL) {
+                chn = &ctrl->channels[SIM_CHANNEL_CNTL];
+            } else if (psm == L2CAP_PSM_HID_INTR) {
+                chn = &ctrl->channels[SIM_CHANNEL_INTR];
+            } else {
+                errors++;
+                break;
+            }
+            chn->remote_cid = le16toh(req->scid);
+
+            rsp.dcid = htole16(chn->local_cid);
+            rsp.scid = req->scid;
+            rsp.result = htole16(L2CAP_SUCCESS);
+            rsp.status = htole16(L2CAP_NO_INFO);
+            host_send_l2cap_cmd(ctrl, L2CAP_CONNECT_RSP, hdr->ident, &rsp, sizeof(rsp));
+            host_send_config_req(ctrl, chn);
+            break;
+        }
+        case L2CAP_CONFIG_REQ: {
+            const l2cap_cfg_req_cp *req = payload;
+            u8 buf[sizeof(l2cap_cfg_rsp_cp) + 16];
+            l2cap_cfg_rsp_cp *rsp = (void *)buf;
+            u16 options_size = cmd_len - sizeof(*req);
+
+            chn = host_find_channel(ctrl, le16toh(req->dcid));
+            if (!chn || (options_size > sizeof(buf) - sizeof(*rsp))) {
+                errors++;
+                break;
+            }
+
+            /* Accept the options as they are */
+            rsp->scid = htole16(chn->remote_cid);
+            rsp->flags = 0;
+            rsp->result = htole16(L2CAP_SUCCESS);
+            memcpy(rsp + 1, req + 1, options_size);
+            host_send_l2cap_cmd(ctrl, L2CAP_CONFIG_RSP, hdr->ident, buf,
+                                sizeof(*rsp) + options_size);
+            chn->remote_configured = true;
+            break;
+        }
+        case L2CAP_CONFIG_RSP: {
+            const l2cap_cfg_rsp_cp *rsp = payload;
+
+            chn = host_find_channel(ctrl, le16toh(rsp->scid));
+            if (!chn || (le16toh(rsp->result) != L2CAP_SUCCESS)) {
+                errors++;
+                break;
+            }
+            chn->local_configured = true;
+            break;
+        }
+        }
+
+        data += sizeof(*hdr) + cmd_len;
+        length -= MIN2(length, sizeof(*hdr) + cmd_len);
+    }
+
+    host_check_controller_ready(ctrl);
+}
+
+static void host_handle_data_report(struct sim_controller_t *ctrl, u8 report_id, const u8 *data)
+{
+    u64 now = ios_mock_time_us();
+    u64 latency;
+    u16 buttons;
+
+    if (!ctrl->streaming) {
+        ctrl->streaming = true;
+        ctrl->first_report_us = now;
+    }
+    ctrl->reports++;
+
+    if (!ctrl->latency_pending)
+        return;
+
+    memcpy(&buttons, data, sizeof(buttons));
+    if (!!(buttons & WIIMOTE_BUTTON_A) != ctrl->pressed)
+        return;
+
+    latency = now - ctrl->toggle_us;
+    if (ctrl->latency_samples == 0 || latency < ctrl->latency_min_us)
+        ctrl->latency_min_us = latency;
+    if (latency > ctrl->latency_max_us)
+        ctrl->latency_max_us = latency;
+    ctrl->latency_sum_us += latency;
+    ctrl->latency_samples++;
+    ctrl->latency_pending = false;
+}
+
+static void host_handle_input_report(struct sim_controller_t *ctrl, u8 report_id, const u8 *data,
+                                     u16 size)
+{
+    switch (report_id) {
+    case INPUT_REPORT_ID_STATUS: {
+        const struct wiimote_input_report_status_t *status = (const void *)data;
+
+        if (size < sizeof(*status)) {
+            errors++;
+            break;
+        }
+
+        /* Disable the extension encryption and identify it, like WPAD */
+        if (status->extension && !ctrl->extension_initialized) {
+            host_write_register(ctrl, EXTENSION_I2C_ADDR, 0xF0, 0x55);
+            host_write_register(ctrl, EXTENSION_I2C_ADDR, 0xFB, 0x00);
+            host_read_data(ctrl, ADDRESS_SPACE_I2C_BUS, EXTENSION_I2C_ADDR, 0xFA, 6);
+        }
+        ctrl->extension_initialized = status->extension;
+
+        /* A status report means data reporting has to be set up again */
+        host_set_report_mode(ctrl);
+        break;
+    }
+    case INPUT_REPORT_ID_READ_DATA_REPLY:
+    case INPUT_REPORT_ID_ACK:
+        break;
+    default:
+        if (report_id >= INPUT_REPORT_ID_BTN)
+            host_handle_data_report(ctrl, report_id, data);
+        break;
+    }
+}
+
+static void host_handle_acl_in(const u8 *data, u16 size)
+{
+    const hci_acldata_hdr_t *acl = (const void *)data;
+    const l2cap_hdr_t *l2cap = (const void *)(acl + 1);
+    const u8 *payload = (const u8 *)(l2cap + 1);
+    struct sim_controller_t *ctrl;
+    u16 length, dcid;
+
+    if (size < sizeof(*acl) + sizeof(*l2cap)) {
+        errors++;
+        return;
+    }
+
+    ctrl = host_find_controller_by_con_handle(HCI_CON_HANDLE(le16toh(acl->con_handle)));
+    if (!ctrl) {
+        errors++;
+        return;
+    }
+
+    length = le16toh(l2cap->length);
+    dcid = le16toh(l2cap->dcid);
+
+    if (dcid == L2CAP_SIGNAL_CID) {
+        host_handle_l2cap_signal(ctrl, payload, length);
+    } else if (dcid == ctrl->channels[SIM_CHANNEL_INTR].local_cid) {
+        if ((length >= 2) && (payload[0] == ((HID_TYPE_DATA << 4) | HID_PARAM_INPUT)))
+            host_handle_input_report(ctrl, payload[1], &payload[2], length - 2);
+    }
+}
+
+static void host_handle_hci_event(const u8 *data, u16 size)
+{
+    const hci_event_hdr_t *hdr = (const void *)data;
+    const void *payload = hdr + 1;
+    struct sim_controller_t *ctrl;
+
+    switch (hdr->event) {
+    case HCI_EVENT_COMMAND_COMPL: {
+        const hci_command_compl_ep *ep = payload;
+        u16 opcode = le16toh(ep->opcode);
+
+        if (opcode == HCI_CMD_READ_STORED_LINK_KEY) {
+            const hci_read_stored_link_key_rp *rp = (const void *)(ep + 1);
+            stored_link_keys_read = le16toh(rp->num_keys_read);
+        } else if (opcode == HCI_CMD_WRITE_SCAN_ENABLE) {
+            scan_enabled = true;
+            scan_enable_us = ios_mock_time_us();
+        }
+        host_hci_cmd_done(opcode);
+        break;
+    }
+    case HCI_EVENT_COMMAND_STATUS: {
+        const hci_command_status_ep *ep = payload;
+        host_hci_cmd_done(le16toh(ep->opcode));
+        break;
+    }
+    case HCI_EVENT_RETURN_LINK_KEYS: {
+        const hci_return_link_keys_ep *ep = payload;
+        returned_link_keys += ep->num_keys;
+        break;
+    }
+    case HCI_EVENT_CON_REQ: {
+        const hci_con_req_ep *ep = payload;
+        hci_accept_con_cp cp;
+
+        ctrl = host_find_controller_by_bdaddr(&ep->bdaddr);
+        if (!ctrl) {
+            errors++;
+            break;
+        }
+        ctrl->con_req_us = ios_mock_time_us();
+
+        bacpy(&cp.bdaddr, &ep->bdaddr);
+        cp.role = HCI_ROLE_MASTER;
+        host_queue_hci_cmd(HCI_CMD_ACCEPT_CON, &cp, sizeof(cp));
+        break;
+    }
+    case HCI_EVENT_CON_COMPL: {
+        const hci_con_compl_ep *ep = payload;
+        hci_change_con_pkt_type_cp pkt_type;
+        hci_write_link_policy_settings_cp link_policy;
+
+        ctrl = host_find_controller_by_bdaddr(&ep->bdaddr);
+        if (!ctrl || (ep->status != 0)) {
+            errors++;
+            break;
+        }
+        ctrl->connected = true;
+        ctrl->con_handle = le16toh(ep->con_handle);
+        ctrl->con_compl_us = ios_mock_time_us();
+
+        pkt_type.con_handle = ep->con_handle;
+        pkt_type.pkt_type = htole16(HCI_PKT_DM1 | HCI_PKT_DH1);
+        host_queue_hci_cmd(HCI_CMD_CHANGE_CON_PACKET_TYPE, &pkt_type, sizeof(pkt_type));
+        link_policy.con_handle = ep->con_handle;
+        link_policy.settings = htole16(HCI_LINK_POLICY_ENABLE_SNIFF_MODE);
+        host_queue_hci_cmd(HCI_CMD_WRITE_LINK_POLICY_SETTINGS, &link_policy,
+                           sizeof(link_policy));
+        break;
+    }
+    }
+}
+
+/* Every reply to the BT stack's requests ends up here */
+static void host_handle_ack(ipcmessage *msg, int retval)
+{
+    struct sim_request_t *req = (void *)msg;
+
+    assert((req >= requests) && (req < requests + ARRAY_SIZE(requests)) && req->busy);
+
+    switch (msg->ioctlv.command) {
+    case USBV0_IOCTLV_INTRMSG:
+        if (retval > 0)
+            host_handle_hci_event(req->data, retval);
+        request_post(req);
+        break;
+    case USBV0_IOCTLV_BLKMSG:
+        if (req->ep == EP_ACL_DATA_IN) {
+            if (retval > 0)
+                host_handle_acl_in(req->data, retval);
+            request_post(req);
+        } else {
+            request_free(req);
+        }
+        break;
+    default:
+        request_free(req);
+        break;
+    }
+}
+
+/* Dongle: only the HCI commands get an answer, there are no real devices */
+
+static void dongle_queue_command_compl(u16 opcode, const void *rp, u8 size)
+{
+    u8 *data;
+    hci_event_hdr_t *hdr;
+    hci_command_compl_ep *ep;
+
+    assert(dongle_events_tail - dongle_events_head < ARRAY_SIZE(dongle_events));
+
+    data = dongle_events[dongle_events_tail % ARRAY_SIZE(dongle_events)].data;
+    hdr = (void *)data;
+    ep = (void *)(hdr + 1);
+    hdr->event = HCI_EVENT_COMMAND_COMPL;
+    hdr->length = sizeof(*ep) + size;
+    ep->num_cmd_pkts = 1;
+    ep->opcode = htole16(opcode);
+    memcpy(ep + 1, rp, size);
+    dongle_events[dongle_events_tail++ % ARRAY_SIZE(dongle_events)].size =
+        sizeof(*hdr) + hdr->length;
+}
+
+static void dongle_handle_hci_cmd(const void *data)
+{
+    const hci_cmd_hdr_t *hdr = data;
+    u16 opcode = le16toh(hdr->opcode);
+
+    switch (opcode) {
+    case HCI_CMD_READ_BDADDR: {
+        hci_read_bdaddr_rp rp = { 0 };
+        bacpy(&rp.bdaddr, &dongle_bdaddr);
+        dongle_queue_command_compl(opcode, &rp, sizeof(rp));
+        break;
+    }
+    case HCI_CMD_READ_BUFFER_SIZE: {
+        hci_read_buffer_size_rp rp = { 0 };
+        rp.max_acl_size = htole16(339);
+        rp.max_sco_size = 64;
+        rp.num_acl_pkts = htole16(10);
+        rp.num_sco_pkts = htole16(0);
+        dongle_queue_command_compl(opcode, &rp, sizeof(rp));
+        break;
+    }
+    case HCI_CMD_READ_STORED_LINK_KEY: {
+        hci_read_stored_link_key_rp rp = { 0 };
+        rp.max_num_keys = htole16(SIM_DONGLE_MAX_KEYS);
+        rp.num_keys_read = htole16(0);
+        dongle_queue_command_compl(opcode, &rp, sizeof(rp));
+        break;
+    }
+    default: {
+        u8 status = 0;
+        dongle_queue_command_compl(opcode, &status, sizeof(status));
+        break;
+    }
+    }
+}
+
+/* Messages the hooks let through to OH1 */
+static void dongle_handle_message(ipcmessage *msg)
+{
+    ioctlv *vector = msg->ioctlv.vector;
+
+    assert(msg->command == IOS_IOCTLV);
+
+    switch (msg->ioctlv.command) {
+    case USBV0_IOCTLV_CTRLMSG:
+        dongle_handle_hci_cmd(vector[6].data);
+        OH1_IOS_ResourceReply_hook(msg, le16toh(*(u16 *)vector[4].data));
+        break;
+    case USBV0_IOCTLV_INTRMSG:
+        assert(!dongle_intr_read);
+        dongle_intr_read = msg;
+        break;
+    case USBV0_IOCTLV_BLKMSG:
+        if (*(u8 *)vector[0].data == EP_ACL_DATA_IN) {
+            assert(!dongle_bulk_in_read);
+            dongle_bulk_in_read = msg;
+        } else {
+            dongle_acl_out_packets++;
+            OH1_IOS_ResourceReply_hook(msg, *(u16 *)vector[1].data);
+        }
+        break;
+    default:
+        OH1_IOS_ResourceReply_hook(msg, IOS_OK);
+        break;
+    }
+}
+
+static bool dongle_deliver_event(void)
+{
+    ipcmessage *msg = dongle_intr_read;
+    u16 size;
+
+    if (!msg || (dongle_events_head == dongle_events_tail))
+        return false;
+
+    size = dongle_events[dongle_events_head % ARRAY_SIZE(dongle_events)].size;
+    assert(size <= msg->ioctlv.vector[2].len);
+    memcpy(msg->ioctlv.vector[2].data,
+           dongle_events[dongle_events_head % ARRAY_SIZE(dongle_events)].data, size);
+    dongle_events_head++;
+
+    dongle_intr_read = NULL;
+    OH1_IOS_ResourceReply_hook(msg, size);
+    return true;
+}
+
+/* Simulation loop */
+
+static void sim_run_until_idle(void)
+{
+    ipcmessage *msg;
+
+    do {
+        msg = NULL;
+        OH1_IOS_ReceiveMessage_hook(orig_msg_queueid, &msg, 0);
+        if (msg)
+            dongle_handle_message(msg);
+    } while (msg || dongle_deliver_event());
+}
+
+static void sim_step(void)
+{
+    ios_mock_advance_time(SIM_STEP_US);
+    sim_run_until_idle();
+}
+
+static bool sim_all_streaming(void)
+{
+    for (int i = 0; i < num_controllers; i++) {
+        if (!controllers[i].streaming)
+            return false;
+    }
+    return true;
+}
+
+static bool sim_measures_latency(void)
+{
+    /* Report 0x3d has no buttons */
+    return report_mode != INPUT_REPORT_ID_EXP21;
+}
+
+static void sim_update_inputs(void)
+{
+    u64 now = ios_mock_time_us();
+
+    for (int i = 0; i < num_controllers; i++) {
+        struct sim_controller_t *ctrl = &controllers[i];
+
+        if (now < ctrl->next_toggle_us)
+            continue;
+
+        if (ctrl->latency_pending)
+            ctrl->latency_missed++;
+        ctrl->pressed = !ctrl->pressed;
+        ctrl->egc.state.gamepad.buttons ^= BIT(EGC_GAMEPAD_BUTTON_SOUTH);
+        ctrl->toggle_us = now;
+        ctrl->latency_pending = sim_measures_latency();
+        ctrl->next_toggle_us += SIM_INPUT_PERIOD_US;
+    }
+}
+
+/* egc_handle_events() callback: the states the tick is about to read */
+static void sim_record_tick(void)
+{
+    struct input_stream_event_t event;
+
+    for (int i = 0; i < num_controllers; i++) {
+        if (!memcmp(&controllers[i].egc.state.gamepad, &recorded_states[i],
+                    sizeof(recorded_states[i])))
+            continue;
+        recorded_states[i] = controllers[i].egc.state.gamepad;
+        event.type = INPUT_STREAM_STATE;
+        event.slot = i;
+        event.state = recorded_states[i];
+        input_stream_write(inputs_file, &event);
+    }
+
+    event.type = INPUT_STREAM_TICK;
+    event.time_us = ios_mock_time_us();
+    input_stream_write(inputs_file, &event);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--controllers N] [--duration S] [--mode REPORT_ID] [--capture FILE] "
+            "[--record-inputs FILE]\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    struct ios_mock_heap_stats_t heap_stats;
+    const char *capture_path = NULL;
+    const char *inputs_path = NULL;
+    u32 duration = SIM_DEFAULT_DURATION;
+    u32 total_reports = 0;
+    u64 start_us, wall_ns;
+    int ret;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--controllers") && (i + 1 < argc)) {
+            num_controllers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--duration") && (i + 1 < argc)) {
+            duration = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--mode") && (i + 1 < argc)) {
+            report_mode = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--capture") && (i + 1 < argc)) {
+            capture_path = argv[++i];
+        } else if (!strcmp(argv[i], "--record-inputs") && (i + 1 < argc)) {
+            inputs_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if ((num_controllers < 1) || (num_controllers > MAX_FAKE_WIIMOTES) || (duration == 0) ||
+        (report_mode < INPUT_REPORT_ID_BTN) || (report_mode > INPUT_REPORT_ID_EXP21)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (inputs_path) {
+        inputs_file = fopen(inputs_path, "w");
+        if (!inputs_file) {
+            perror(inputs_path);
+            return 2;
+        }
+        fprintf(inputs_file, "# fakemote_sim --controllers %d --mode 0x%02x\n", num_controllers,
+                report_mode);
+        egc_stub_set_events_callback(sim_record_tick);
+    }
+
+    ios_mock_reset();
+    ios_mock_set_ack_callback(host_handle_ack);
+    ret = os_message_queue_create(oh1_queue_data, ARRAY_SIZE(oh1_queue_data));
+    if (ret < 0) {
+        fprintf(stderr, "sim: can't create the OH1 queue (%d)\n", ret);
+        return 2;
+    }
+    orig_msg_queueid = ret;
+
+    for (int i = 0; i < num_controllers; i++) {
+        controllers[i].channels[SIM_CHANNEL_CNTL].local_cid = SIM_HOST_CID_BASE + 2 * i;
+        controllers[i].channels[SIM_CHANNEL_INTR].local_cid = SIM_HOST_CID_BASE + 2 * i + 1;
+    }
+
+    /* WPAD keeps two reads in flight on each endpoint */
+    post_read(USBV0_IOCTLV_INTRMSG, EP_HCI_EVENT);
+    post_read(USBV0_IOCTLV_INTRMSG, EP_HCI_EVENT);
+    post_read(USBV0_IOCTLV_BLKMSG, EP_ACL_DATA_IN);
+    post_read(USBV0_IOCTLV_BLKMSG, EP_ACL_DATA_IN);
+    host_queue_init_hci_cmds();
+
+    /* The hooks initialize everything, egc included, on their first call */
+    sim_run_until_idle();
+    for (int i = 0; i < num_controllers; i++) {
+        controllers[i].egc.desc = &egc_stub_gamepad_desc;
+        egc_stub_add_device(&controllers[i].egc);
+        if (inputs_file) {
+            struct input_stream_event_t event = { .type = INPUT_STREAM_ADD, .slot = i };
+            input_stream_write(inputs_file, &event);
+        }
+    }
+
+    while (!sim_all_streaming()) {
+        if (ios_mock_time_us() >= SIM_CONNECT_TIMEOUT_US) {
+            fprintf(stderr, "sim: timed out connecting the controllers (scan enabled: %s)\n",
+                    scan_enabled ? "yes" : "no");
+            return 1;
+        }
+        sim_step();
+    }
+
+    printf("link keys: %u read, %u returned\n", stored_link_keys_read, returned_link_keys);
+    for (int i = 0; i < num_controllers; i++) {
+        struct sim_controller_t *ctrl = &controllers[i];
+        printf("controller %d: con_req %.1f ms, con_compl %.1f ms, channels %.1f ms, "
+               "first report %.1f ms\n",
+               i, us_to_ms(ctrl->con_req_us - scan_enable_us),
+               us_to_ms(ctrl->con_compl_us - scan_enable_us),
+               us_to_ms(ctrl->ready_us - scan_enable_us),
+               us_to_ms(ctrl->first_report_us - scan_enable_us));
+    }
+
+    /* Throughput and latency, toggling a button on every controller */
+    start_us = ios_mock_time_us();
+    for (int i = 0; i < num_controllers; i++) {
+        controllers[i].reports = 0;
+        controllers[i].next_toggle_us = start_us + SIM_STEP_US + i * SIM_INPUT_PHASE_US;
+    }
+
+    wall_ns = now_ns();
+    while (ios_mock_time_us() - start_us < (u64)duration * 1000000) {
+        sim_update_inputs();
+        sim_step();
+    }
+    wall_ns = now_ns() - wall_ns;
+
+    for (int i = 0; i < num_controllers; i++) {
+        struct sim_controller_t *ctrl = &controllers[i];
+        printf("controller %d: %.1f reports/s, latency min/avg/max %llu/%llu/%llu us "
+               "(%u samples, %u missed)\n",
+               i, (double)ctrl->reports / duration, (unsigned long long)ctrl->latency_min_us,
+               (unsigned long long)(ctrl->latency_samples ?
+                                        ctrl->latency_sum_us / ctrl->latency_samples :
+                                        0),
+               (unsigned long long)ctrl->latency_max_us, ctrl->latency_samples,
+               ctrl->latency_missed);
+        total_reports += ctrl->reports;
+    }
+
+    ios_mock_heap_get_total_stats(&heap_stats);
+    printf("mode 0x%02x: %u reports in %u s, %.0f ns/report wall clock, %.0fx real time\n",
+           report_mode, total_reports, duration,
+           total_reports ? (double)wall_ns / total_reports : 0.0,
+           wall_ns ? (double)duration * 1e9 / wall_ns : 0.0);
+    printf("heap: %u allocs, %u failed, peak %u bytes\n", heap_stats.allocs, heap_stats.failed,
+           heap_stats.peak_bytes_in_use);
+    printf("stats: %u reports sent, %u dropped, ReadyQ high water %u intr / %u bulk in, "
+           "%u ticks, %u overruns\n",
+           fakemote_stats.reports_sent, fakemote_stats.reports_dropped,
+           fakemote_stats.intr_ready_queue_high_water,
+           fakemote_stats.bulk_in_ready_queue_high_water, fakemote_stats.ticks,
+           fakemote_stats.tick_overruns);
+
+    if (inputs_file) {
+        fclose(inputs_file);
+        printf("inputs: written to %s\n", inputs_path);
+    }
+
+    /* The ring only holds the latest packets */
+    if (capture_path) {
+        ret = capture_flush(capture_path);
+        if (ret < 0) {
+            fprintf(stderr, "sim: capture_flush(): %d%s\n", ret,
+                    (ret == IOS_EINVAL) ? ", is FAKEMOTE_CAPTURE on?" : "");
+            return 1;
+        }
+        printf("capture: %d packets written to %s\n", ret, capture_path);
+        if (ret == CAPTURE_NUM_RECORDS)
+            printf("capture: the ring is full, the oldest packets are missing\n");
+    }
+
+    if (errors || dongle_acl_out_packets) {
+        fprintf(stderr, "sim: %u protocol errors, %u ACL packets leaked to the dongle\n", errors,
+                dongle_acl_out_packets);
+        return 1;
+    }
+    if (stored_link_keys_read != MAX_FAKE_WIIMOTES || returned_link_keys != MAX_FAKE_WIIMOTES) {
+        fprintf(stderr, "sim: the fake Wiimotes' link keys were not reported\n");
+        return 1;
+    }
+    for (int i = 0; i < num_controllers; i++) {
+        if (controllers[i].reports == 0 ||
+            (sim_measures_latency() && controllers[i].latency_samples == 0)) {
+            fprintf(stderr, "sim: controller %d stopped reporting\n", i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
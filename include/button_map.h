@@ -19,7 +19,129 @@ enum bm_classic_analog_axis_e {
     BM_CLASSIC_ANALOG_AXIS_LEFT_Y,
     BM_CLASSIC_ANALOG_AXIS_RIGHT_X,
     BM_CLASSIC_ANALOG_AXIS_RIGHT_Y,
-    BM_CLASSIC_ANALOG_AXIS__NUM = BM_CLASSIC_ANALOG_AXIS_RIGHT_Y
+    BM_CLASSIC_ANALOG_AXIS_LEFT_TRIGGER,
+    BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER,
+    BM_CLASSIC_ANALOG_AXIS__NUM = BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER
+};
+
+/* Classic analog values are kept at 10 bits, the data format drops what it can't carry */
+#define BM_CLASSIC_ANALOG_MAX 0x3FF
+
+/* Guitar */
+enum bm_guitar_analog_axis_e {
+    BM_GUITAR_ANALOG_AXIS_STICK_X = 1,
+    BM_GUITAR_ANALOG_AXIS_STICK_Y,
+    BM_GUITAR_ANALOG_AXIS_WHAMMY,
+    BM_GUITAR_ANALOG_AXIS_TOUCH_BAR,
+    BM_GUITAR_ANALOG_AXIS__NUM = BM_GUITAR_ANALOG_AXIS_TOUCH_BAR
+};
+
+/* Not part of the report (the bit is always set there): raises the neck for star power on
+ * controllers without an accelerometer */
+#define BM_GUITAR_BUTTON_TILT 0x0002
+
+/* Wii U Pro Controller: Classic Controller buttons in the low half, WIIU_PRO_BUTTON_* in the
+ * high half. Its sticks are mapped like the Classic ones. */
+#define BM_WIIU_PRO_BUTTON_SHIFT 16
+
+/* Button mapping lookup tables: one table per 7-bit slice of the egc buttons bitmask, so mapping
+ * all the buttons is three loads OR'd together. egc has 21 buttons, whole bytes would waste a
+ * fourth table and half of the third one. */
+#define BM_BUTTON_LUT_SLICES     3
+#define BM_BUTTON_LUT_SLICE_BITS 7
+#define BM_BUTTON_LUT_ENTRIES    BIT(BM_BUTTON_LUT_SLICE_BITS)
+#define BM_BUTTON_LUT_MASK       (BM_BUTTON_LUT_ENTRIES - 1)
+
+struct bm_button_lut16_t {
+    u16 slice[BM_BUTTON_LUT_SLICES][BM_BUTTON_LUT_ENTRIES];
+};
+
+struct bm_button_lut8_t {
+    u8 slice[BM_BUTTON_LUT_SLICES][BM_BUTTON_LUT_ENTRIES];
+};
+
+struct bm_button_lut32_t {
+    u32 slice[BM_BUTTON_LUT_SLICES][BM_BUTTON_LUT_ENTRIES];
+};
+
+/* Analog stick conditioning. Each emulated stick goes through a radial deadzone, an outer
+ * saturation and a response curve, all folded into a gain LUT indexed by the squared radius,
+ * then optionally through circle to octagon gating like the Nunchuk's physical gate. */
+enum bm_stick_e {
+    BM_STICK_NUNCHUK,
+    BM_STICK_CLASSIC_LEFT,
+    BM_STICK_CLASSIC_RIGHT,
+    BM_STICK__NUM
+};
+
+/* Radii in percent of the full deflection */
+struct bm_stick_config_t {
+    u8 deadzone;
+    /* Output radius right outside the deadzone, for games with their own deadzone */
+    u8 anti_deadzone;
+    /* Input radius that gets the full output */
+    u8 saturation;
+    /* 0 is linear, 100 is cubic */
+    u8 curve;
+    bool octagon_gate;
+};
+
+/* Stick axes are reduced to 12 bits, so the squared radius is below 2^23. The radial LUT
+ * covers up to the square's corners so that they are brought back into the circle. Its first
+ * bin spans 6% of the radius, finer ones would only sharpen deadzones below that. */
+#define BM_STICK_RADIUS_SHIFT   4
+#define BM_STICK_FULL_RADIUS    (32768 >> BM_STICK_RADIUS_SHIFT)
+#define BM_STICK_RADIAL_LUT_LEN 512
+#define BM_STICK_RADIAL_SHIFT   14 /* 512 << 14 == 2 * BM_STICK_FULL_RADIUS^2 */
+#define BM_STICK_GATE_LUT_LEN   32
+#define BM_STICK_GATE_SHIFT     6 /* 32 << 6 == BM_STICK_FULL_RADIUS */
+
+struct bm_stick_lut_t {
+    /* Q12 gain applied to both axes */
+    u16 radial_gain[BM_STICK_RADIAL_LUT_LEN];
+    bool octagon_gate;
+};
+
+/* Accelerometer routing */
+enum bm_motion_route_e {
+    BM_MOTION_ROUTE_WIIMOTE,
+    BM_MOTION_ROUTE_NUNCHUK,
+    BM_MOTION_ROUTE_BOTH,
+    /* Left/right motion goes to the Wiimote, up/down and forward/backward to the Nunchuk */
+    BM_MOTION_ROUTE_SPLIT,
+};
+
+enum bm_motion_target_e {
+    BM_MOTION_TARGET_WIIMOTE,
+    BM_MOTION_TARGET_NUNCHUK,
+    BM_MOTION_TARGET__NUM
+};
+
+/* How the emulated Wiimote is meant to be held */
+enum bm_motion_orientation_e {
+    BM_MOTION_ORIENTATION_POINTING,
+    BM_MOTION_ORIENTATION_SIDEWAYS,
+    BM_MOTION_ORIENTATION_UPRIGHT,
+};
+
+/* egc accelerometer units per g for controllers without a calibration profile */
+#define BM_EGC_ACCEL_ONE_G 8192
+
+/* Per controller model accelerometer calibration. The matrix (Q12) rotates the controller axes
+ * (minus the bias) into the Wiimote axes: X left, Y towards the screen, Z up. */
+struct bm_accel_calibration_t {
+    u16 vid, pid;
+    s16 matrix[3][3];
+    s16 bias[3];
+    u16 one_g;
+};
+
+/* Calibration, orientation and routing composed into a single transform per target:
+ * out[i] = offset[i] + (sum(matrix[i][j] * in[j]) >> 16). Axes not routed to a target have
+ * an all zero row and the resting value as offset. */
+struct bm_motion_transform_t {
+    s32 matrix[BM_MOTION_TARGET__NUM][3][3];
+    s32 offset[BM_MOTION_TARGET__NUM][3];
 };
 
 /* IR pointer emulation */
@@ -28,6 +150,7 @@ enum bm_ir_emulation_mode_e {
     BM_IR_EMULATION_MODE_DIRECT,
     BM_IR_EMULATION_MODE_RELATIVE_ANALOG_AXIS,
     BM_IR_EMULATION_MODE_ABSOLUTE_ANALOG_AXIS,
+    BM_IR_EMULATION_MODE_GYRO,
 };
 
 enum bm_ir_axis_e {
@@ -39,48 +162,136 @@ enum bm_ir_axis_e {
 
 struct bm_ir_emulation_state_t {
     u16 position[BM_IR_AXIS__NUM];
+    /* Gyro mode: integrated and smoothed positions, in Q16 camera pixels */
+    s32 gyro_position[BM_IR_AXIS__NUM];
+    s32 gyro_filtered[BM_IR_AXIS__NUM];
+};
+
+/* Gyro pointer sensitivity, in camera pixels per degree of rotation */
+#define BM_IR_GYRO_DEFAULT_SENSITIVITY 25
+#define BM_IR_GYRO_MAX_SENSITIVITY     100
+
+/* Emulated distance between the Wiimote and the sensor bar, in cm */
+#define BM_IR_DEFAULT_DISTANCE 200
+#define BM_IR_MIN_DISTANCE     30
+#define BM_IR_MAX_DISTANCE     500
+
+/* Sensor bar as seen by the camera at the emulated distance */
+struct bm_ir_sensor_bar_t {
+    u16 distance;
+    u8 num_dots;
+    u8 dot_size;
+    u8 dot_intensity;
+    /* Horizontal offset of each dot from the pointed position, in camera pixels */
+    s16 dot_offset[IR_MAX_DOTS];
 };
 
+void bm_button_lut16_build(struct bm_button_lut16_t *lut, int num_buttons, const u16 *button_map);
+void bm_button_lut8_build(struct bm_button_lut8_t *lut, int num_buttons, const u8 *button_map);
+void bm_button_lut32_build(struct bm_button_lut32_t *lut, int num_buttons, const u32 *button_map);
+
 void bm_map_wiimote(
     /* Inputs */
-    int num_buttons, u32 buttons,
+    u32 buttons,
     /* Mapping tables */
-    const u16 *wiimote_button_map,
+    const struct bm_button_lut16_t *wiimote_button_lut,
     /* Outputs */
     u16 *wiimote_buttons);
 
+void bm_stick_lut_build(struct bm_stick_lut_t *lut, const struct bm_stick_config_t *config);
+
 void bm_map_nunchuk(
     /* Inputs */
-    int num_buttons, u32 buttons, int num_analog_axis, const s16 *analog_axis, u16 ax, u16 ay,
-    u16 az,
+    u32 buttons, int num_analog_axis, const s16 *analog_axis, u16 ax, u16 ay, u16 az,
     /* Mapping tables */
-    const u8 *nunchuk_button_map, const u8 *nunchuk_analog_axis_map,
+    const struct bm_button_lut8_t *nunchuk_button_lut, const u8 *nunchuk_analog_axis_map,
+    const struct bm_stick_lut_t *stick_lut,
     /* Outputs */
     struct wiimote_extension_data_format_nunchuk_t *nunchuk);
 
 void bm_map_classic(
     /* Inputs */
-    int num_buttons, u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
     /* Mapping tables */
-    const u16 *classic_button_map, const u8 *classic_analog_axis_map,
+    const struct bm_button_lut16_t *classic_button_lut, const u8 *classic_analog_axis_map,
+    const struct bm_stick_lut_t *left_stick_lut, const struct bm_stick_lut_t *right_stick_lut,
+    u8 data_format,
     /* Outputs */
-    struct wiimote_extension_data_format_classic_t *classic);
+    union wiimote_extension_data_t *classic, u8 *size);
 
-void bm_map_ir_direct(
+void bm_map_wiiu_pro(
+    /* Inputs */
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    /* Mapping tables */
+    const struct bm_button_lut32_t *wiiu_pro_button_lut, const u8 *classic_analog_axis_map,
+    const struct bm_stick_lut_t *left_stick_lut, const struct bm_stick_lut_t *right_stick_lut,
+    /* Outputs */
+    struct wiimote_extension_data_format_wiiu_pro_t *wiiu_pro);
+
+void bm_map_guitar(
+    /* Inputs */
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    /* Mapping tables */
+    const struct bm_button_lut16_t *guitar_button_lut, const u8 *guitar_analog_axis_map,
+    /* Outputs */
+    struct wiimote_extension_data_format_guitar_t *guitar, bool *tilt);
+
+void bm_motion_transform_init(struct bm_motion_transform_t *transform,
+                              const struct bm_accel_calibration_t *calibration,
+                              enum bm_motion_orientation_e orientation,
+                              enum bm_motion_route_e route);
+
+bool bm_map_ir_direct(
     /* Inputs */
     s16 x, s16 y,
     /* Outputs */
-    struct ir_dot_t ir_dots[static IR_MAX_DOTS]);
+    struct ir_dot_t *pointer);
 
 void bm_map_ir_analog_axis(
     /* Inputs */
     enum bm_ir_emulation_mode_e mode, struct bm_ir_emulation_state_t *state, int num_analog_axis,
     const s16 *analog_axis, const u8 *ir_analog_axis_map,
     /* Outputs */
+    struct ir_dot_t *pointer);
+
+void bm_map_ir_gyro(
+    /* Inputs */
+    struct bm_ir_emulation_state_t *state, u8 sensitivity, s16 pitch_rate, s16 yaw_rate,
+    /* Outputs */
+    struct ir_dot_t *pointer);
+
+void bm_ir_sensor_bar_set_distance(struct bm_ir_sensor_bar_t *sensor_bar, u16 distance);
+
+void bm_ir_synthesize_dots(
+    /* Inputs */
+    const struct ir_dot_t *pointer, const struct bm_ir_sensor_bar_t *sensor_bar, u16 acc_x,
+    u16 acc_z,
+    /* Outputs */
     struct ir_dot_t ir_dots[static IR_MAX_DOTS]);
 
 void bm_set_sensor_bar_position_top(bool on_top);
 
+static inline u16 bm_button_lut16_lookup(const struct bm_button_lut16_t *lut, u32 buttons)
+{
+    return lut->slice[0][buttons & BM_BUTTON_LUT_MASK] |
+           lut->slice[1][(buttons >> BM_BUTTON_LUT_SLICE_BITS) & BM_BUTTON_LUT_MASK] |
+           lut->slice[2][(buttons >> (2 * BM_BUTTON_LUT_SLICE_BITS)) & BM_BUTTON_LUT_MASK];
+}
+
+static inline u8 bm_button_lut8_lookup(const struct bm_button_lut8_t *lut, u32 buttons)
+{
+    return lut->slice[0][buttons & BM_BUTTON_LUT_MASK] |
+           lut->slice[1][(buttons >> BM_BUTTON_LUT_SLICE_BITS) & BM_BUTTON_LUT_MASK] |
+           lut->slice[2][(buttons >> (2 * BM_BUTTON_LUT_SLICE_BITS)) & BM_BUTTON_LUT_MASK];
+}
+
+static inline u32 bm_button_lut32_lookup(const struct bm_button_lut32_t *lut, u32 buttons)
+{
+    return lut->slice[0][buttons & BM_BUTTON_LUT_MASK] |
+           lut->slice[1][(buttons >> BM_BUTTON_LUT_SLICE_BITS) & BM_BUTTON_LUT_MASK] |
+           lut->slice[2][(buttons >> (2 * BM_BUTTON_LUT_SLICE_BITS)) & BM_BUTTON_LUT_MASK];
+}
+
 static inline bool bm_check_switch_mapping(u32 buttons, bool *switch_mapping,
                                            u32 switch_mapping_combo)
 {
@@ -110,39 +321,143 @@ static inline void bm_nunchuk_format(struct wiimote_extension_data_format_nunchu
     out->bt.z = !(buttons & NUNCHUK_BUTTON_Z);
 }
 
-static inline void bm_classic_format(struct wiimote_extension_data_format_classic_t *out,
-                                     u16 buttons,
-                                     u8 analog_axis[static BM_CLASSIC_ANALOG_AXIS__NUM])
+/* Returns the size of the data format */
+static inline u8 bm_classic_format(union wiimote_extension_data_t *out, u8 data_format,
+                                   u16 buttons,
+                                   const u16 analog_axis[static BM_CLASSIC_ANALOG_AXIS__NUM])
+{
+    u16 lx = analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1];
+    u16 ly = analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1];
+    u16 rx = analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1];
+    u16 ry = analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1];
+    u16 lt = analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_TRIGGER - 1];
+    u16 rt = analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER - 1];
+    u16 bt = (~buttons) & CLASSIC_CTRL_BUTTON_ALL;
+
+    if (data_format == CLASSIC_DATA_FORMAT_HIGH_RES) {
+        struct wiimote_extension_data_format_classic_high_res_t *classic = &out->classic_high_res;
+
+        classic->lx = lx >> 2;
+        classic->rx = rx >> 2;
+        classic->ly = ly >> 2;
+        classic->ry = ry >> 2;
+        classic->lx_lsb = lx & 3;
+        classic->rx_lsb = rx & 3;
+        classic->ly_lsb = ly & 3;
+        classic->ry_lsb = ry & 3;
+        classic->lt = lt >> 2;
+        classic->rt = rt >> 2;
+        classic->bt[0] = bt >> 8;
+        classic->bt[1] = bt & 0xFF;
+        return sizeof(*classic);
+    } else if (data_format == CLASSIC_DATA_FORMAT_FULL) {
+        struct wiimote_extension_data_format_classic_full_t *classic = &out->classic_full;
+
+        classic->lx = lx >> 2;
+        classic->rx = rx >> 2;
+        classic->ly = ly >> 2;
+        classic->ry = ry >> 2;
+        classic->lt = lt >> 2;
+        classic->rt = rt >> 2;
+        classic->bt[0] = bt >> 8;
+        classic->bt[1] = bt & 0xFF;
+        return sizeof(*classic);
+    } else {
+        struct wiimote_extension_data_format_classic_t *classic = &out->classic;
+
+        /* 6-bit left stick, 5-bit right stick and triggers */
+        lx >>= 4;
+        ly >>= 4;
+        rx >>= 5;
+        ry >>= 5;
+        lt >>= 5;
+        rt >>= 5;
+
+        classic->rx3 = (rx >> 3) & 3;
+        classic->lx = lx & 0x3F;
+        classic->rx2 = (rx >> 1) & 3;
+        classic->ly = ly & 0x3F;
+        classic->rx1 = rx & 1;
+        classic->lt2 = (lt >> 3) & 3;
+        classic->ry = ry & 0x1F;
+        classic->lt1 = lt & 0x7;
+        classic->rt = rt & 0x1F;
+        classic->bt.hex = bt;
+        return sizeof(*classic);
+    }
+}
+
+static inline void bm_guitar_format(struct wiimote_extension_data_format_guitar_t *out,
+                                    u16 buttons, u8 stick_x, u8 stick_y, u8 touch_bar, u8 whammy)
+{
+    u16 bt = (~buttons) & 0xFFFF;
+
+    out->sx = 0xC0 | (stick_x & 0x3F);
+    out->sy = 0xC0 | (stick_y & 0x3F);
+    out->tb = touch_bar & 0x1F;
+    out->wb = whammy & 0x1F;
+    out->bt[0] = bt >> 8;
+    out->bt[1] = bt & 0xFF;
+}
+
+/* Sticks are 12 bits centered at 0x800 */
+static inline void bm_wiiu_pro_format(struct wiimote_extension_data_format_wiiu_pro_t *out,
+                                      u32 buttons, u16 lx, u16 ly, u16 rx, u16 ry)
+{
+    u16 bt = (~buttons) & CLASSIC_CTRL_BUTTON_ALL;
+    u8 status = (~buttons >> BM_WIIU_PRO_BUTTON_SHIFT) & WIIU_PRO_BUTTON_ALL;
+
+    out->lx[0] = lx & 0xFF;
+    out->lx[1] = lx >> 8;
+    out->rx[0] = rx & 0xFF;
+    out->rx[1] = rx >> 8;
+    out->ly[0] = ly & 0xFF;
+    out->ly[1] = ly >> 8;
+    out->ry[0] = ry & 0xFF;
+    out->ry[1] = ry >> 8;
+    out->bt[0] = bt >> 8;
+    out->bt[1] = bt & 0xFF;
+    out->status = WIIU_PRO_STATUS_IDLE | status;
+}
+
+static inline void bm_map_motion(const struct bm_motion_transform_t *transform,
+                                 const s16 in[static 3], u16 out[static BM_MOTION_TARGET__NUM][3])
+{
+    for (int t = 0; t < BM_MOTION_TARGET__NUM; t++) {
+        for (int i = 0; i < 3; i++) {
+            const s32 *row = transform->matrix[t][i];
+            s32 value = transform->offset[t][i] +
+                        ((row[0] * in[0] + row[1] * in[1] + row[2] * in[2]) >> 16);
+            out[t][i] = (value < 0) ? 0 : ((value > 0x3FF) ? 0x3FF : value);
+        }
+    }
+}
+
+static inline void bm_motion_set_rest(u16 out[static BM_MOTION_TARGET__NUM][3])
 {
-    u8 lx = analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1] >> 2;
-    u8 ly = analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1] >> 2;
-    u8 rx = analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1] >> 3;
-    u8 ry = analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1] >> 3;
-    u8 lt = (buttons & CLASSIC_CTRL_BUTTON_FULL_L) ? 31 : 0;
-    u8 rt = (buttons & CLASSIC_CTRL_BUTTON_FULL_R) ? 31 : 0;
-
-    out->rx3 = (rx >> 3) & 3;
-    out->lx = lx & 0x3F;
-    out->rx2 = (rx >> 1) & 3;
-    out->ly = ly & 0x3F;
-    out->rx1 = rx & 1;
-    out->lt2 = (lt >> 3) & 3;
-    out->ry = ry & 0x1F;
-    out->lt1 = lt & 0x7;
-    out->rt = rt & 0x1F;
-    out->bt.hex = (~buttons) & CLASSIC_CTRL_BUTTON_ALL;
+    for (int t = 0; t < BM_MOTION_TARGET__NUM; t++) {
+        out[t][0] = ACCEL_ZERO_G;
+        out[t][1] = ACCEL_ZERO_G;
+        out[t][2] = ACCEL_ONE_G;
+    }
 }
 
 static inline void bm_ir_emulation_state_reset(struct bm_ir_emulation_state_t *state)
 {
     state->position[BM_IR_AXIS_X - 1] = IR_CENTER_X;
     state->position[BM_IR_AXIS_Y - 1] = IR_CENTER_Y;
+    state->gyro_position[BM_IR_AXIS_X - 1] = IR_CENTER_X << 16;
+    state->gyro_position[BM_IR_AXIS_Y - 1] = IR_CENTER_Y << 16;
+    state->gyro_filtered[BM_IR_AXIS_X - 1] = IR_CENTER_X << 16;
+    state->gyro_filtered[BM_IR_AXIS_Y - 1] = IR_CENTER_Y << 16;
 }
 
 static inline void bm_ir_dots_set_out_of_screen(struct ir_dot_t ir_dots[static IR_MAX_DOTS])
 {
-    for (int i = 0; i < IR_MAX_DOTS; i++)
-        ir_dots[i].y = 1023;
+    for (int i = 0; i < IR_MAX_DOTS; i++) {
+        ir_dots[i].x = IR_DOT_INVALID;
+        ir_dots[i].y = IR_DOT_INVALID;
+    }
 }
 
 #endif
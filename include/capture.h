@@ -0,0 +1,122 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "egc.h"
+#include "ipc.h"
+#include "types.h"
+
+/* Next to the mapping profiles */
+#define CAPTURE_PATH "/shared2/fakemote/capture.btsnoop"
+
+/* The ring keeps the latest CAPTURE_NUM_RECORDS packets, truncated to CAPTURE_SNAPLEN bytes.
+ * The native build makes it big enough for whole simulated sessions */
+#ifndef CAPTURE_NUM_RECORDS
+#define CAPTURE_NUM_RECORDS 64
+#endif
+#ifndef CAPTURE_SNAPLEN
+#define CAPTURE_SNAPLEN 56
+#endif
+
+/* Record flag (fakemote extension, a reserved bit of the spec): the packet was generated by
+ * fakemote rather than received from the dongle */
+#define BTSNOOP_FLAG_INJECTED BIT(2)
+/* Record flag (fakemote extension too): not a packet but a controller input change, laid out
+ * as a vendor specific HCI event so that btsnoop viewers still make sense of it */
+#define BTSNOOP_FLAG_INPUT BIT(3)
+/* Record flag (fakemote extension too): the record comes from a little endian build. The Wiimote
+ * reports are laid out in native byte order, so a trace only replays on a build of its own */
+#define BTSNOOP_FLAG_LITTLE_ENDIAN BIT(4)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BTSNOOP_FLAGS_BYTE_ORDER BTSNOOP_FLAG_LITTLE_ENDIAN
+#else
+#define BTSNOOP_FLAGS_BYTE_ORDER 0
+#endif
+
+/* Controller input records, big endian: HCI_EVENT_VENDOR, parameter length, enum
+ * capture_input_e, slot (input device index), u32 number of ticks completed before the record,
+ * then for states: u32 buttons, s16 axes[EGC_GAMEPAD_AXIS_COUNT], touch points (x, y), s16
+ * accelerometer x y z, s16 gyroscope x y z */
+enum capture_input_e {
+    CAPTURE_INPUT_ADDED,
+    CAPTURE_INPUT_REMOVED,
+    CAPTURE_INPUT_STATE,
+};
+
+#define CAPTURE_INPUT_HEADER_SIZE 8
+#define CAPTURE_INPUT_STATE_SIZE  (4 + 2 * (EGC_GAMEPAD_AXIS_COUNT + 2 * 2 + 3 + 3))
+
+/* The inputs and outputs of the emulation, which is what the replay tool needs: packets from the
+ * BT SW stack (virtual HCI connection handles) and from the dongle (physical ones) before any
+ * translation, and the messages fakemote injects */
+enum capture_type_e {
+    CAPTURE_TYPE_HCI_CMD,            /* Host to controller */
+    CAPTURE_TYPE_HCI_EVENT,          /* Controller to host */
+    CAPTURE_TYPE_ACL_OUT,            /* Host to controller */
+    CAPTURE_TYPE_ACL_IN,             /* Controller to host */
+    CAPTURE_TYPE_HCI_EVENT_INJECTED, /* Fakemote to host */
+    CAPTURE_TYPE_ACL_IN_INJECTED,    /* Fakemote to host */
+    CAPTURE_TYPE_INPUT,              /* Controller input change */
+};
+
+#ifdef FAKEMOTE_CAPTURE
+
+void capture_reset(void);
+void capture_record(enum capture_type_e type, const void *data, u32 size);
+/* States are only recorded when they differ from the previous one of the slot */
+void capture_record_input(enum capture_input_e type, u8 slot, const egc_gamepad_state_t *state);
+/* Called at the end of every tick, input records count them */
+void capture_tick(void);
+/* Number of records in the ring */
+u32 capture_count(void);
+/* Copies the ring aside and empties it: the bounded part of a flush, for the recording thread.
+ * Returns the number of records staged */
+int capture_stage(void);
+/* Writes the staged records as a btsnoop file (HCI unencapsulated), from any thread but the one
+ * staging. Returns the number of records written, or a negative IOS error */
+int capture_write_staged(const char *path);
+/* Both at once */
+int capture_flush(const char *path);
+
+#else
+
+static inline void capture_reset(void)
+{
+}
+
+static inline void capture_record(enum capture_type_e type, const void *data, u32 size)
+{
+}
+
+static inline void capture_record_input(enum capture_input_e type, u8 slot,
+                                        const egc_gamepad_state_t *state)
+{
+}
+
+static inline void capture_tick(void)
+{
+}
+
+static inline u32 capture_count(void)
+{
+    return 0;
+}
+
+static inline int capture_stage(void)
+{
+    return IOS_EINVAL;
+}
+
+static inline int capture_write_staged(const char *path)
+{
+    return IOS_EINVAL;
+}
+
+static inline int capture_flush(const char *path)
+{
+    return IOS_EINVAL;
+}
+
+#endif
+
+#endif
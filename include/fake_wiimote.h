@@ -35,6 +35,17 @@ typedef struct {
     u16 remote_mtu;
 } l2cap_channel_info_t;
 
+typedef enum {
+    MOTION_PLUS_PORT_IDLE,
+    /* The extension port has to report a detach, then an attach */
+    MOTION_PLUS_PORT_DETACH,
+    MOTION_PLUS_PORT_ATTACH,
+} motion_plus_port_event_e;
+
+/* Packs the dot positions into the IR camera data for the current IR mode */
+typedef void (*ir_camera_encoder_t)(u8 camera_data[static CAMERA_DATA_BYTES],
+                                    const struct ir_dot_t ir_dots[static IR_MAX_DOTS]);
+
 typedef struct fake_wiimote_t {
     bool active;
     bdaddr_t bdaddr;
@@ -66,14 +77,26 @@ typedef struct fake_wiimote_t {
     bool rumble_on;
     /* IR camera */
     struct wiimote_ir_camera_registers_t ir_regs;
-    struct ir_dot_t ir_dots[2];
-    u8 ir_valid_dots;
+    ir_camera_encoder_t ir_encode;
     /* Extension */
     struct wiimote_extension_registers_t extension_regs;
     struct wiimote_encryption_key_t extension_key;
     bool extension_key_dirty;
+    /* Encrypted copy of extension_regs.controller_data, the first extension_shadow_len bytes
+     * are up to date */
+    u8 extension_shadow[CONTROLLER_DATA_BYTES] ATTRIBUTE_ALIGN(4);
+    u8 extension_shadow_len;
     enum wiimote_ext_e cur_extension;
     enum wiimote_ext_e new_extension;
+    u8 extension_change_holdoff;
+    u8 classic_data_format;
+    /* MotionPlus */
+    struct wiimote_extension_registers_t motion_plus_regs;
+    bool motion_plus_available;
+    bool motion_plus_active;
+    bool motion_plus_report_ext;
+    motion_plus_port_event_e motion_plus_port_event;
+    s16 gyro_yaw, gyro_roll, gyro_pitch;
     /* EEPROM */
     union wiimote_usable_eeprom_data_t eeprom;
     /* Current in-progress "memory read request" */
@@ -101,8 +124,12 @@ void fake_wiimote_report_input(fake_wiimote_t *wiimote, u16 buttons);
 void fake_wiimote_report_accelerometer(fake_wiimote_t *wiimote, u16 acc_x, u16 acc_y, u16 acc_z);
 void fake_wiimote_report_ir_dots(fake_wiimote_t *wiimote,
                                  struct ir_dot_t ir_dots[static IR_MAX_DOTS]);
+void fake_wiimote_report_motion_plus(fake_wiimote_t *wiimote, s16 yaw, s16 roll, s16 pitch);
 void fake_wiimote_report_input_ext(fake_wiimote_t *wiimote, u16 buttons, const void *ext_data,
                                    u8 ext_size);
+u8 fake_wiimote_get_classic_data_format(const fake_wiimote_t *wiimote);
+/* The extension the game currently sees, which lags fake_wiimote_set_extension() */
+enum wiimote_ext_e fake_wiimote_get_extension(const fake_wiimote_t *wiimote);
 
 /* Helper functions */
 
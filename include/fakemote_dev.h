@@ -0,0 +1,91 @@
+#ifndef FAKEMOTE_DEV_H
+#define FAKEMOTE_DEV_H
+
+#include "types.h"
+
+/* /dev/fakemote: control and statistics for homebrew. Every request is a plain IOS_Ioctl, the
+ * structures below are shared as is (both CPUs are big endian) */
+#define FAKEMOTE_DEV_PATH    "/dev/fakemote"
+#define FAKEMOTE_DEV_VERSION 3
+
+enum fakemote_ioctl_e {
+    /* Out: u32, FAKEMOTE_DEV_VERSION */
+    FAKEMOTE_IOCTL_GET_VERSION,
+    /* Out: struct fakemote_stats_t */
+    FAKEMOTE_IOCTL_GET_STATS,
+    /* Resets the profile too */
+    FAKEMOTE_IOCTL_RESET_STATS,
+    /* In: struct fakemote_slot_options_t */
+    FAKEMOTE_IOCTL_SET_SLOT_OPTIONS,
+    /* In: u32, index of a loaded mapping profile or FAKEMOTE_MAPPING_PROFILE_TITLE. IOS_EINVAL
+     * if there is no such profile */
+    FAKEMOTE_IOCTL_SET_MAPPING_PROFILE,
+    /* Saves the capture ring to CAPTURE_PATH. Returns the number of packets written, IOS_EINVAL
+     * if the module was built without FAKEMOTE_CAPTURE */
+    FAKEMOTE_IOCTL_FLUSH_CAPTURE,
+    /* Out: struct fakemote_profile_t. IOS_EINVAL if the module was built without
+     * FAKEMOTE_PROFILE */
+    FAKEMOTE_IOCTL_GET_PROFILE,
+};
+
+struct fakemote_stats_t {
+    u32 reports_sent;    /* Input data reports of the fake Wiimotes */
+    u32 reports_dropped; /* ... that could not be injected */
+    /* Most messages ever waiting in the ReadyQs for the BT stack */
+    u32 intr_ready_queue_high_water;
+    u32 bulk_in_ready_queue_high_water;
+    u32 ticks;
+    u32 tick_overruns; /* Ticks that took longer than the tick period */
+};
+
+/* Fields set to FAKEMOTE_OPTION_KEEP are left as they are */
+#define FAKEMOTE_OPTION_KEEP 0xFF
+
+struct fakemote_slot_options_t {
+    u8 slot;         /* Controller, in the order they were plugged in */
+    u8 ir_mode;      /* enum bm_ir_emulation_mode_e, except BM_IR_EMULATION_MODE_NONE */
+    u8 extension;    /* enum wiimote_ext_e, those mapping profiles accept */
+    u8 motion_route; /* enum bm_motion_route_e */
+};
+
+/* The one the running title's entry selects, as on title start */
+#define FAKEMOTE_MAPPING_PROFILE_TITLE 0xFFFFFFFF
+
+/* Time spent in the OH1 hooks and in each stage of the periodic tick */
+enum fakemote_profile_stage_e {
+    FAKEMOTE_PROFILE_RECEIVE_MESSAGE, /* OH1_IOS_ReceiveMessage_hook, per request handled */
+    FAKEMOTE_PROFILE_RESOURCE_REPLY,  /* OH1_IOS_ResourceReply_hook */
+    FAKEMOTE_PROFILE_TICK,            /* The whole tick, see tick_overruns */
+    FAKEMOTE_PROFILE_EGC_EVENTS,      /* egc_handle_events() */
+    FAKEMOTE_PROFILE_INPUT_DEVICES,   /* input_devices_tick() */
+    FAKEMOTE_PROFILE_FAKE_WIIMOTES,   /* fake_wiimote_mgr_tick_devices() */
+    FAKEMOTE_PROFILE__NUM
+};
+
+#define FAKEMOTE_PROFILE_NUM_BUCKETS 16
+
+/* Durations are in Hollywood timer ticks (243 MHz / 128, ~0.53 us). Bucket i of the histogram
+ * counts the durations from 2^i up to 2^(i + 1) - 1 ticks, bucket 0 includes 0 and the last one
+ * is open ended */
+struct fakemote_profile_stage_t {
+    u32 count;
+    u32 min;
+    u32 max;
+    u32 pad;
+    u64 total;
+    u32 histogram[FAKEMOTE_PROFILE_NUM_BUCKETS];
+};
+
+struct fakemote_profile_t {
+    struct fakemote_profile_stage_t stages[FAKEMOTE_PROFILE__NUM];
+};
+
+/* Updated by the emulation */
+extern struct fakemote_stats_t fakemote_stats;
+
+/* Serves the device from the calling thread, never returns unless setting it up fails */
+int fakemote_dev_run(void);
+/* Runs the pending request that needs the emulation state, called by the OH1 thread's tick */
+void fakemote_dev_tick(void);
+
+#endif
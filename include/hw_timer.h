@@ -0,0 +1,29 @@
+#ifndef HW_TIMER_H
+#define HW_TIMER_H
+
+#include "types.h"
+
+/* Hollywood timer, a free running 32-bit counter at 243 MHz / 128. The native build points it to
+ * the mock's, which follows the virtual clock */
+#ifdef FAKEMOTE_HOST_BUILD
+extern volatile u32 ios_mock_hw_timer;
+#endif
+#ifndef HW_TIMER_ADDR
+#define HW_TIMER_ADDR 0x0D800010
+#endif
+#define HW_TIMER_MUL 128
+#define HW_TIMER_DIV 243
+
+#define HW_TIMER_US_TO_TICKS(us) ((u32)((u64)(us) * HW_TIMER_DIV / HW_TIMER_MUL))
+
+static inline u32 hw_timer_read(void)
+{
+    return *(volatile u32 *)HW_TIMER_ADDR;
+}
+
+static inline u64 hw_timer_ticks_to_us(u64 ticks)
+{
+    return ticks * HW_TIMER_MUL / HW_TIMER_DIV;
+}
+
+#endif
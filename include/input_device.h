@@ -1,11 +1,13 @@
 #ifndef INPUT_DEVICE_H
 #define INPUT_DEVICE_H
 
+#include "button_map.h"
 #include <stdbool.h>
 
 typedef struct fake_wiimote_t fake_wiimote_t;
 typedef struct input_device_t input_device_t;
 typedef struct egc_input_device_t egc_input_device_t;
+struct mapping_profile_t;
 
 typedef struct input_device_ops_t {
     int (*resume)(void *usrdata, fake_wiimote_t *wiimote);
@@ -16,6 +18,16 @@ typedef struct input_device_ops_t {
 } input_device_ops_t;
 
 void input_devices_init(void);
+/* Compiles the profile into the lookup tables used by every input device */
+void input_devices_set_mapping_profile(const struct mapping_profile_t *profile);
+/* Same, and re-derives the per-device state from it */
+void input_devices_switch_mapping_profile(const struct mapping_profile_t *profile);
+/* Switches to the profile of the running title, meant to be called when it starts */
+void input_devices_select_title_profile(void);
+/* IR emulation mode (enum bm_ir_emulation_mode_e), extension (enum wiimote_ext_e) and motion
+ * route (enum bm_motion_route_e) of the controller in the slot, negative values keep the current
+ * ones. Returns IOS_ENOENT if the slot is empty, IOS_EINVAL if the device can't use the mode */
+int input_devices_set_slot_options(u32 slot, int ir_emu_mode, int extension, int motion_route);
 void input_devices_tick(void);
 
 /** Used by input devices **/
@@ -36,5 +48,8 @@ int input_device_suspend(input_device_t *input_device);
 int input_device_set_leds(input_device_t *input_device, int leds);
 int input_device_set_rumble(input_device_t *input_device, bool rumble_on);
 bool input_device_report_input(input_device_t *input_device);
+bool input_device_has_gyroscope(input_device_t *input_device);
+/* The one selected for the device, the fake Wiimote attaches it when it can */
+enum wiimote_ext_e input_device_get_extension(input_device_t *input_device);
 
 #endif
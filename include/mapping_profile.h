@@ -0,0 +1,103 @@
+#ifndef MAPPING_PROFILE_H
+#define MAPPING_PROFILE_H
+
+#include "button_map.h"
+#include "egc.h"
+#include "types.h"
+#include "utils.h"
+
+#define MAPPING_PROFILES_PATH "/shared2/fakemote/mappings.bin"
+
+/* On-NAND format (big endian):
+ *   file header, then num_profiles times:
+ *     profile header, then num_bindings binding entries
+ *   then num_titles title entries, sorted by game ID
+ * Version 1 files still load: they had no title index, and the bytes now holding the number of
+ * titles and the motion orientation were padding */
+#define MAPPING_PROFILES_MAGIC   0x464B4D50 /* "FKMP" */
+#define MAPPING_PROFILES_VERSION 2
+#define MAPPING_PROFILES_MAX     8
+#define MAPPING_TITLES_MAX       64
+#define MAPPING_EXTENSIONS_MAX   8
+
+#define MAPPING_PROFILE_FILE_HEADER_SIZE 8
+#define MAPPING_PROFILE_HEADER_SIZE      16
+#define MAPPING_PROFILE_BINDING_SIZE     4
+#define MAPPING_TITLE_SIZE               8
+
+/* Profile header flags */
+#define MAPPING_PROFILE_FLAG_INHERIT_DEFAULT BIT(0) /* Bindings patch the built-in mappings */
+
+/* Binding entry targets. The source is an egc button for button targets, an egc axis for axis
+ * targets and a bm_stick_e for stick targets. The value is the output button mask, the
+ * BM_*_ANALOG_AXIS_* / BM_IR_AXIS_* or the stick parameter (radii in percent, gate 0 or 1).
+ * Extension rotation entries have the position as source and a wiimote_ext_e as value, they
+ * must be listed in order and position 0 starts a new list. The IR distance, gyro sensitivity and
+ * motion route entries have source 0 and the distance to the sensor bar in cm, the camera pixels
+ * per degree (up to BM_IR_GYRO_MAX_SENSITIVITY) or a bm_motion_route_e as value */
+enum mapping_profile_target_e {
+    MAPPING_PROFILE_TARGET_WIIMOTE_BUTTON,
+    MAPPING_PROFILE_TARGET_NUNCHUK_BUTTON,
+    MAPPING_PROFILE_TARGET_CLASSIC_BUTTON,
+    MAPPING_PROFILE_TARGET_NUNCHUK_AXIS,
+    MAPPING_PROFILE_TARGET_CLASSIC_AXIS,
+    MAPPING_PROFILE_TARGET_IR_AXIS,
+    MAPPING_PROFILE_TARGET_STICK_DEADZONE,
+    MAPPING_PROFILE_TARGET_STICK_ANTI_DEADZONE,
+    MAPPING_PROFILE_TARGET_STICK_SATURATION,
+    MAPPING_PROFILE_TARGET_STICK_CURVE,
+    MAPPING_PROFILE_TARGET_STICK_OCTAGON_GATE,
+    MAPPING_PROFILE_TARGET_WIIU_PRO_BUTTON,
+    MAPPING_PROFILE_TARGET_WIIU_PRO_STICK_BUTTON,
+    MAPPING_PROFILE_TARGET_GUITAR_BUTTON,
+    MAPPING_PROFILE_TARGET_GUITAR_AXIS,
+    MAPPING_PROFILE_TARGET_EXTENSION_ROTATION,
+    MAPPING_PROFILE_TARGET_IR_DISTANCE,
+    MAPPING_PROFILE_TARGET_IR_GYRO_SENSITIVITY,
+    MAPPING_PROFILE_TARGET_MOTION_ROUTE,
+    MAPPING_PROFILE_TARGET__NUM
+};
+
+/* Validated, source-form profile. Compiled into the runtime lookup tables by input_device */
+struct mapping_profile_t {
+    u16 wiimote_button_map[EGC_GAMEPAD_BUTTON_COUNT];
+    u8 nunchuk_button_map[EGC_GAMEPAD_BUTTON_COUNT];
+    u8 nunchuk_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
+    u16 classic_button_map[EGC_GAMEPAD_BUTTON_COUNT];
+    u8 classic_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
+    /* Sticks are shared with the Classic Controller */
+    u32 wiiu_pro_button_map[EGC_GAMEPAD_BUTTON_COUNT];
+    u16 guitar_button_map[EGC_GAMEPAD_BUTTON_COUNT];
+    u8 guitar_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
+    u8 ir_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
+    /* Emulated distance to the sensor bar, in cm */
+    u16 ir_distance;
+    u8 ir_gyro_sensitivity;
+    struct bm_stick_config_t stick_configs[BM_STICK__NUM];
+    /* Bitmasks of egc buttons */
+    u32 switch_extension_combo;
+    u32 switch_ir_emu_mode_combo;
+    u32 ir_recenter_combo;
+    /* Extensions cycled through with the switch combo, may include WIIMOTE_EXT_NONE */
+    u8 extension_rotation[MAPPING_EXTENSIONS_MAX];
+    u8 num_extension_rotation;
+    u8 default_extension;
+    u8 motion_orientation;
+    /* Where the controller accelerometer goes, enum bm_motion_route_e */
+    u8 motion_route;
+};
+
+extern const struct mapping_profile_t mapping_profile_default;
+
+/* Returns the number of profiles loaded, or IOS_EINVAL in which case none is */
+int mapping_profiles_load(const u8 *data, u32 size);
+/* Whether the extension can be emulated, for every interface that takes one */
+bool extension_is_valid(u8 extension);
+/* Number of profiles loaded */
+int mapping_profiles_count(void);
+/* Returns mapping_profile_default if there is no such loaded profile */
+const struct mapping_profile_t *mapping_profile_get(int index);
+/* game_id is the 4-character title code (e.g. "RSBE"), returns NULL if it has no profile */
+const struct mapping_profile_t *mapping_profile_find_title(u32 game_id);
+
+#endif
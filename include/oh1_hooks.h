@@ -0,0 +1,43 @@
+#ifndef OH1_HOOKS_H
+#define OH1_HOOKS_H
+
+#include "ipc.h"
+#include "types.h"
+
+/* /dev/usb/oh1 (USBV0) ioctls */
+#define USBV0_IOCTLV_CTRLMSG           0
+#define USBV0_IOCTLV_BLKMSG            1
+#define USBV0_IOCTLV_INTRMSG           2
+#define USBV0_IOCTL_SUSPENDDEV         5
+#define USBV0_IOCTL_RESUMEDEV          6
+#define USBV0_IOCTLV_ISOMSG            9
+#define USBV0_IOCTLV_LBLKMSG           10
+#define USBV0_IOCTLV_GETDEVLIST        12
+#define USBV0_IOCTL_GETRHDESCA         15
+#define USBV0_IOCTLV_GETRHPORTSTATUS   20
+#define USBV0_IOCTLV_SETRHPORTSTATUS   25
+#define USBV0_IOCTL_DEVREMOVALHOOK     26
+#define USBV0_IOCTLV_DEVINSERTHOOK     27
+#define USBV0_IOCTLV_DEVICECLASSCHANGE 28
+#define USBV0_IOCTL_RESET_DEVICE       29
+#define USBV0_IOCTLV_DEVINSERTHOOKID   30
+#define USBV0_IOCTL_CANCEL_INSERT_HOOK 31
+#define USBV0_IOCTLV_UNKNOWN_32        32
+
+/* Wii's BT USB dongle configuration */
+#define EP_HCI_CTRL     0x00
+#define EP_HCI_EVENT    0x81
+#define EP_ACL_DATA_IN  0x82
+#define EP_ACL_DATA_OUT 0x02
+
+/* Queue ID created by OH1 that receives ipcmessages from /dev/usb/oh1 */
+extern int orig_msg_queueid;
+
+/* Replacements for OH1's IOS_ReceiveMessage and IOS_ResourceReply. Requests from the BT SW
+ * stack are snooped (or fully handled for fake Wiimotes) before OH1 sees them, and the buffers
+ * it posts to read HCI events and ACL data are filled either from the BT dongle or from the
+ * injected messages, through a PendingQ/ReadyQ pair per endpoint */
+int OH1_IOS_ReceiveMessage_hook(int queueid, ipcmessage **ret_msg, u32 flags);
+int OH1_IOS_ResourceReply_hook(ipcmessage *ready_msg, int retval);
+
+#endif
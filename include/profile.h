@@ -0,0 +1,55 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "fakemote_dev.h"
+#include "hw_timer.h"
+#include "ipc.h"
+#include "types.h"
+
+/* Per stage durations of the OH1 hooks. Without FAKEMOTE_PROFILE (release builds) everything
+ * below compiles to nothing, the timer isn't even read */
+
+#ifdef FAKEMOTE_PROFILE
+
+void profile_reset(void);
+void profile_record(enum fakemote_profile_stage_e stage, u32 ticks);
+/* Copies the current profile, returns IOS_OK */
+int profile_get(struct fakemote_profile_t *profile);
+
+static inline u32 profile_timestamp(void)
+{
+    return hw_timer_read();
+}
+
+#else
+
+static inline void profile_reset(void)
+{
+}
+
+static inline void profile_record(enum fakemote_profile_stage_e stage, u32 ticks)
+{
+}
+
+static inline int profile_get(struct fakemote_profile_t *profile)
+{
+    return IOS_EINVAL;
+}
+
+static inline u32 profile_timestamp(void)
+{
+    return 0;
+}
+
+#endif
+
+/* Records the stage started at start, returns the timestamp the next stage starts from */
+static inline u32 profile_stage_end(enum fakemote_profile_stage_e stage, u32 start)
+{
+    u32 now = profile_timestamp();
+
+    profile_record(stage, now - start);
+    return now;
+}
+
+#endif
@@ -72,6 +72,8 @@
 #define EEPROM_I2C_ADDR    0x50
 #define EXTENSION_I2C_ADDR 0x52
 #define CAMERA_I2C_ADDR    0x58
+/* Inactive MotionPlus, it moves to EXTENSION_I2C_ADDR once activated */
+#define MOTION_PLUS_I2C_ADDR 0x53
 
 /* Memory sizes */
 #define EEPROM_FREE_SIZE 0x1700
@@ -121,6 +123,38 @@
 #define CLASSIC_CTRL_BUTTON_RIGHT  0x8000
 #define CLASSIC_CTRL_BUTTON_ALL    0xFEFF
 
+/* Guitar Hero guitar, bytes 4 and 5 of its report */
+#define GUITAR_BUTTON_STRUM_UP   0x0001
+#define GUITAR_BUTTON_YELLOW     0x0008
+#define GUITAR_BUTTON_GREEN      0x0010
+#define GUITAR_BUTTON_BLUE       0x0020
+#define GUITAR_BUTTON_RED        0x0040
+#define GUITAR_BUTTON_ORANGE     0x0080
+#define GUITAR_BUTTON_PLUS       0x0400
+#define GUITAR_BUTTON_MINUS      0x1000
+#define GUITAR_BUTTON_STRUM_DOWN 0x4000
+#define GUITAR_BUTTON_ALL        0x54F9
+
+/* Touch bar (World Tour) values, from the green to the orange end */
+#define GUITAR_TOUCH_BAR_NONE 0x0F
+#define GUITAR_WHAMMY_BAR_MIN 0x10
+#define GUITAR_WHAMMY_BAR_MAX 0x1B
+
+/* Wii U Pro Controller: Classic Controller buttons plus the stick clicks in the status byte */
+#define WIIU_PRO_BUTTON_RIGHT_STICK 0x01
+#define WIIU_PRO_BUTTON_LEFT_STICK  0x02
+#define WIIU_PRO_BUTTON_ALL         0x03
+/* Status byte bits other than the buttons: bit 7 is always set, bits 6:4 are the battery level
+ * (0 to 4), bit 3 is set while charging and bit 2 while on USB power */
+#define WIIU_PRO_STATUS_ALWAYS_SET    0x80
+#define WIIU_PRO_STATUS_BATTERY_SHIFT 4
+#define WIIU_PRO_STATUS_BATTERY_FULL  4
+#define WIIU_PRO_STATUS_CHARGING      0x08
+#define WIIU_PRO_STATUS_USB           0x04
+/* Full battery, neither charging nor wired */
+#define WIIU_PRO_STATUS_IDLE                                                                       \
+    (WIIU_PRO_STATUS_ALWAYS_SET | (WIIU_PRO_STATUS_BATTERY_FULL << WIIU_PRO_STATUS_BATTERY_SHIFT))
+
 /* Acceleromter configuration */
 #define ACCEL_ZERO_G (0x80 << 2)
 #define ACCEL_ONE_G  (0x9A << 2)
@@ -132,6 +166,9 @@
 
 /* IR configuration */
 #define IR_MAX_DOTS          4
+#define IR_CAMERA_RES_X      1024
+#define IR_CAMERA_RES_Y      768
+#define IR_DOT_INVALID       0x3FF
 #define IR_LOW_X             0x7F
 #define IR_LOW_Y             0x5D
 #define IR_HIGH_X            0x380
@@ -140,7 +177,6 @@
 #define IR_CENTER_Y          ((IR_HIGH_Y + IR_LOW_Y) >> 1)
 #define IR_HORIZONTAL_OFFSET 64
 #define IR_VERTICAL_OFFSET   110
-#define IR_DOT_SIZE          4
 #define IR_DOT_CENTER_MIN_X  (IR_LOW_X + IR_HORIZONTAL_OFFSET)
 #define IR_DOT_CENTER_MAX_X  (IR_HIGH_X - IR_HORIZONTAL_OFFSET)
 #define IR_DOT_CENTER_MIN_Y  (IR_LOW_Y + IR_VERTICAL_OFFSET)
@@ -267,8 +303,17 @@ struct wiimote_ir_camera_registers_t {
 
 static_assert(sizeof(struct wiimote_ir_camera_registers_t) == 0x100);
 
+#define IR_CAMERA_MODE_OFFSET offsetof(struct wiimote_ir_camera_registers_t, mode)
+
+#define IR_CAMERA_DATA_END                                                                         \
+    (offsetof(struct wiimote_ir_camera_registers_t, camera_data) +                                 \
+     MEMBER_SIZE(struct wiimote_ir_camera_registers_t, camera_data))
+
+/* Dots not seen by the camera have both coordinates set to IR_DOT_INVALID */
 struct ir_dot_t {
     u16 x, y;
+    u8 size;
+    u8 intensity;
 };
 
 /* Extensions */
@@ -334,14 +379,73 @@ struct wiimote_extension_data_format_classic_t {
     } bt;
 };
 
+/* Data format 2: 10-bit sticks, 8-bit triggers */
+struct wiimote_extension_data_format_classic_high_res_t {
+    u8 lx; // bits 9:2
+    u8 rx;
+    u8 ly;
+    u8 ry;
+    u8 lx_lsb : 2; // bits 1:0
+    u8 rx_lsb : 2;
+    u8 ly_lsb : 2;
+    u8 ry_lsb : 2;
+    u8 lt;
+    u8 rt;
+    u8 bt[2]; // same bits as the default format
+};
+
+/* Data format 3: 8-bit sticks and triggers */
+struct wiimote_extension_data_format_classic_full_t {
+    u8 lx;
+    u8 rx;
+    u8 ly;
+    u8 ry;
+    u8 lt;
+    u8 rt;
+    u8 bt[2]; // same bits as the default format
+};
+
+struct wiimote_extension_data_format_guitar_t {
+    u8 sx; // 6 bits, top 2 bits set
+    u8 sy; // 6 bits, top 2 bits set
+    u8 tb; // touch bar, 5 bits
+    u8 wb; // whammy bar, 5 bits
+    u8 bt[2];
+};
+
+/* Wii U Pro Controller: 12-bit little endian sticks */
+struct wiimote_extension_data_format_wiiu_pro_t {
+    u8 lx[2];
+    u8 rx[2];
+    u8 ly[2];
+    u8 ry[2];
+    u8 bt[2]; // same bits as the Classic Controller
+    u8 status;
+};
+
 union wiimote_extension_data_t {
     struct wiimote_extension_data_format_nunchuk_t nunchuk;
     struct wiimote_extension_data_format_classic_t classic;
+    struct wiimote_extension_data_format_classic_high_res_t classic_high_res;
+    struct wiimote_extension_data_format_classic_full_t classic_full;
+    struct wiimote_extension_data_format_wiiu_pro_t wiiu_pro;
+    struct wiimote_extension_data_format_guitar_t guitar;
 };
 static_assert(sizeof(union wiimote_extension_data_t) <= CONTROLLER_DATA_BYTES);
 
 #define ENCRYPTION_ENABLED 0xaa
 
+/* MotionPlus modes, written to the mode register (0xA600FE) to activate it */
+#define MOTION_PLUS_MODE_STANDALONE 0x04
+#define MOTION_PLUS_MODE_NUNCHUK    0x05
+#define MOTION_PLUS_MODE_CLASSIC    0x07
+/* Written to the encryption register (0xA400F0) of an active MotionPlus to deactivate it */
+#define MOTION_PLUS_DEACTIVATE 0x55
+
+#define MOTION_PLUS_DATA_BYTES 6
+/* Gyro values are 14 bits wide */
+#define MOTION_PLUS_GYRO_ZERO (1 << 13)
+
 struct wiimote_extension_registers_t {
     // 21 bytes of possible extension data
     u8 controller_data[CONTROLLER_DATA_BYTES];
@@ -367,6 +471,17 @@ static_assert(sizeof(struct wiimote_extension_registers_t) == 0x100);
     (ENCRYPTION_KEY_DATA_BEGIN +                                                                   \
      MEMBER_SIZE(struct wiimote_extension_registers_t, encryption_key_data))
 
+#define EXTENSION_ENCRYPTION_OFFSET offsetof(struct wiimote_extension_registers_t, encryption)
+
+#define MOTION_PLUS_MODE_OFFSET (offsetof(struct wiimote_extension_registers_t, identifier) + 4)
+
+/* Classic Controller data formats, selected by writing the last identifier byte (0xA400FE) */
+#define CLASSIC_DATA_FORMAT_OFFSET                                                                 \
+    (offsetof(struct wiimote_extension_registers_t, identifier) + 4)
+#define CLASSIC_DATA_FORMAT_DEFAULT  0x01
+#define CLASSIC_DATA_FORMAT_HIGH_RES 0x02
+#define CLASSIC_DATA_FORMAT_FULL     0x03
+
 /* Extension IDs */
 
 static const u8 EXT_ID_CODE_NUNCHUNK[6] = { 0x00, 0x00, 0xa4, 0x20, 0x00, 0x00 };
@@ -1,109 +1,465 @@
+#include <assert.h>
+
 #include "button_map.h"
 #include "egc.h"
 #include "internals.h"
 
 static bool s_sensor_bar_position_top = false;
 
-static inline u8 s16_to_u8(s16 value)
+/* Q8 attenuation from the full circle to the octagon edge, indexed by |x| and |y| */
+static u8 octagon_gate[BM_STICK_GATE_LUT_LEN][BM_STICK_GATE_LUT_LEN];
+static bool octagon_gate_built = false;
+
+static_assert(EGC_GAMEPAD_BUTTON_COUNT <= BM_BUTTON_LUT_SLICES * BM_BUTTON_LUT_SLICE_BITS);
+
+/* Each entry is the entry with its lowest set bit cleared plus the mapping of that bit */
+
+void bm_button_lut16_build(struct bm_button_lut16_t *lut, int num_buttons, const u16 *button_map)
+{
+    for (int s = 0; s < BM_BUTTON_LUT_SLICES; s++) {
+        lut->slice[s][0] = 0;
+        for (int v = 1; v < BM_BUTTON_LUT_ENTRIES; v++) {
+            int button = s * BM_BUTTON_LUT_SLICE_BITS + __builtin_ctz(v);
+            lut->slice[s][v] = lut->slice[s][v & (v - 1)];
+            if (button < num_buttons)
+                lut->slice[s][v] |= button_map[button];
+        }
+    }
+}
+
+void bm_button_lut8_build(struct bm_button_lut8_t *lut, int num_buttons, const u8 *button_map)
+{
+    for (int s = 0; s < BM_BUTTON_LUT_SLICES; s++) {
+        lut->slice[s][0] = 0;
+        for (int v = 1; v < BM_BUTTON_LUT_ENTRIES; v++) {
+            int button = s * BM_BUTTON_LUT_SLICE_BITS + __builtin_ctz(v);
+            lut->slice[s][v] = lut->slice[s][v & (v - 1)];
+            if (button < num_buttons)
+                lut->slice[s][v] |= button_map[button];
+        }
+    }
+}
+
+void bm_button_lut32_build(struct bm_button_lut32_t *lut, int num_buttons, const u32 *button_map)
+{
+    for (int s = 0; s < BM_BUTTON_LUT_SLICES; s++) {
+        lut->slice[s][0] = 0;
+        for (int v = 1; v < BM_BUTTON_LUT_ENTRIES; v++) {
+            int button = s * BM_BUTTON_LUT_SLICE_BITS + __builtin_ctz(v);
+            lut->slice[s][v] = lut->slice[s][v & (v - 1)];
+            if (button < num_buttons)
+                lut->slice[s][v] |= button_map[button];
+        }
+    }
+}
+
+static u32 isqrt(u32 value)
+{
+    u32 root = 0;
+    u32 bit = 1u << 30;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+/* Octagon with its vertices on the unit circle at every 45 degrees. For a direction (u, v) with
+ * u >= v >= 0 the edge is at cos(pi/8) * |(u, v)| / (u * cos(pi/8) + v * sin(pi/8)). */
+static void octagon_gate_build(void)
 {
-    return 0x80 + (value >> 8);
+    const u32 cos_pi_8 = 30274; /* Q15 */
+    const u32 sin_pi_8 = 12540;
+
+    for (int i = 0; i < BM_STICK_GATE_LUT_LEN; i++) {
+        for (int j = 0; j < BM_STICK_GATE_LUT_LEN; j++) {
+            /* Sample each cell on its side closest to an axis, in half cells, so that full
+             * deflection along the axes is left untouched */
+            u32 u = 2 * MAX2(i, j) + 1;
+            u32 v = 2 * MIN2(i, j);
+            u32 scale = (cos_pi_8 * isqrt((u * u + v * v) << 16)) / (u * cos_pi_8 + v * sin_pi_8);
+            octagon_gate[i][j] = 256 - MIN2(scale, 256);
+        }
+    }
+    octagon_gate_built = true;
+}
+
+void bm_stick_lut_build(struct bm_stick_lut_t *lut, const struct bm_stick_config_t *config)
+{
+    s32 deadzone = (config->deadzone * BM_STICK_FULL_RADIUS) / 100;
+    s32 saturation = (config->saturation * BM_STICK_FULL_RADIUS) / 100;
+    s32 anti_deadzone = (config->anti_deadzone << 12) / 100;
+
+    assert(deadzone < saturation);
+
+    for (int i = 0; i < BM_STICK_RADIAL_LUT_LEN; i++) {
+        /* Sample the middle of the bin */
+        s32 r = isqrt((i << BM_STICK_RADIAL_SHIFT) + (1 << (BM_STICK_RADIAL_SHIFT - 1)));
+        s32 t, out;
+
+        if (r <= deadzone) {
+            lut->radial_gain[i] = 0;
+            continue;
+        }
+
+        /* Q12 position between the deadzone and the saturation radius */
+        t = MIN2(((r - deadzone) << 12) / (saturation - deadzone), 1 << 12);
+        /* Blend between linear and cubic */
+        t += (config->curve * ((((t * t) >> 12) * t >> 12) - t)) / 100;
+        out = anti_deadzone + ((((1 << 12) - anti_deadzone) * t) >> 12);
+
+        lut->radial_gain[i] = MIN2((out * BM_STICK_FULL_RADIUS) / r, 0xFFFF);
+    }
+
+    lut->octagon_gate = config->octagon_gate;
+    if (lut->octagon_gate && !octagon_gate_built)
+        octagon_gate_build();
+}
+
+static inline s32 stick_clamp(s32 value)
+{
+    return MIN2(MAX2(value, -BM_STICK_FULL_RADIUS), BM_STICK_FULL_RADIUS - 1);
+}
+
+/* egc axes to unsigned 12 bits, centered at 0x800 */
+static inline void stick_condition(const struct bm_stick_lut_t *lut, s16 in_x, s16 in_y,
+                                   u16 *out_x, u16 *out_y)
+{
+    s32 x = in_x >> BM_STICK_RADIUS_SHIFT;
+    s32 y = in_y >> BM_STICK_RADIUS_SHIFT;
+    u32 r2 = x * x + y * y;
+    u32 gain = lut->radial_gain[MIN2(r2 >> BM_STICK_RADIAL_SHIFT, BM_STICK_RADIAL_LUT_LEN - 1)];
+
+    if (lut->octagon_gate) {
+        u32 gx = MIN2((u32)(x < 0 ? -x : x) >> BM_STICK_GATE_SHIFT, BM_STICK_GATE_LUT_LEN - 1);
+        u32 gy = MIN2((u32)(y < 0 ? -y : y) >> BM_STICK_GATE_SHIFT, BM_STICK_GATE_LUT_LEN - 1);
+        gain -= (gain * octagon_gate[gx][gy]) >> 8;
+    }
+
+    *out_x = 0x800 + stick_clamp((x * (s32)gain) >> 12);
+    *out_y = 0x800 + stick_clamp((y * (s32)gain) >> 12);
+}
+
+/* Gathers the Classic axes: 12-bit conditioned sticks and raw triggers */
+static inline void classic_map_analog_axis(
+    int num_analog_axis, const s16 *analog_axis, const u8 *classic_analog_axis_map,
+    const struct bm_stick_lut_t *left_stick_lut, const struct bm_stick_lut_t *right_stick_lut,
+    u16 sticks[static BM_CLASSIC_ANALOG_AXIS__NUM], s16 *left_trigger, s16 *right_trigger)
+{
+    s16 axes[BM_CLASSIC_ANALOG_AXIS__NUM] = { 0 };
+
+    for (int i = 0; i < num_analog_axis; i++) {
+        if (classic_analog_axis_map[i])
+            axes[classic_analog_axis_map[i] - 1] = analog_axis[i];
+    }
+
+    stick_condition(left_stick_lut, axes[BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1],
+                    axes[BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1],
+                    &sticks[BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1],
+                    &sticks[BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1]);
+    stick_condition(right_stick_lut, axes[BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1],
+                    axes[BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1],
+                    &sticks[BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1],
+                    &sticks[BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1]);
+
+    *left_trigger = axes[BM_CLASSIC_ANALOG_AXIS_LEFT_TRIGGER - 1];
+    *right_trigger = axes[BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER - 1];
+}
+
+/* egc triggers rest at 0 */
+static inline u16 trigger_to_u10(s16 value)
+{
+    return (value < 0) ? 0 : (value >> 5);
 }
 
 void bm_map_wiimote(
     /* Inputs */
-    int num_buttons, u32 buttons,
+    u32 buttons,
     /* Mapping tables */
-    const u16 *wiimote_button_map,
+    const struct bm_button_lut16_t *wiimote_button_lut,
     /* Outputs */
     u16 *wiimote_buttons)
 {
-    for (int i = 0; i < num_buttons; i++) {
-        if (buttons & 1)
-            *wiimote_buttons |= wiimote_button_map[i];
-        buttons >>= 1;
-    }
+    *wiimote_buttons |= bm_button_lut16_lookup(wiimote_button_lut, buttons);
 }
 
 void bm_map_nunchuk(
     /* Inputs */
-    int num_buttons, u32 buttons, int num_analog_axis, const s16 *analog_axis, u16 ax, u16 ay,
-    u16 az,
+    u32 buttons, int num_analog_axis, const s16 *analog_axis, u16 ax, u16 ay, u16 az,
     /* Mapping tables */
-    const u8 *nunchuk_button_map, const u8 *nunchuk_analog_axis_map,
+    const struct bm_button_lut8_t *nunchuk_button_lut, const u8 *nunchuk_analog_axis_map,
+    const struct bm_stick_lut_t *stick_lut,
     /* Outputs */
     struct wiimote_extension_data_format_nunchuk_t *nunchuk)
 {
-    u8 nunchuk_buttons = 0;
-    u8 nunchuk_analog_axis[BM_NUNCHUK_ANALOG_AXIS__NUM] = { 0 };
-
-    for (int i = 0; i < num_buttons; i++) {
-        if (buttons & 1)
-            nunchuk_buttons |= nunchuk_button_map[i];
-        buttons >>= 1;
-    }
+    u8 nunchuk_buttons = bm_button_lut8_lookup(nunchuk_button_lut, buttons);
+    s16 stick[BM_NUNCHUK_ANALOG_AXIS__NUM] = { 0 };
+    u16 stick_x, stick_y;
+    u8 nunchuk_analog_axis[BM_NUNCHUK_ANALOG_AXIS__NUM];
 
     for (int i = 0; i < num_analog_axis; i++) {
         if (nunchuk_analog_axis_map[i])
-            nunchuk_analog_axis[nunchuk_analog_axis_map[i] - 1] = s16_to_u8(analog_axis[i]);
+            stick[nunchuk_analog_axis_map[i] - 1] = analog_axis[i];
     }
 
+    stick_condition(stick_lut, stick[BM_NUNCHUK_ANALOG_AXIS_X - 1],
+                    stick[BM_NUNCHUK_ANALOG_AXIS_Y - 1], &stick_x, &stick_y);
+    nunchuk_analog_axis[BM_NUNCHUK_ANALOG_AXIS_X - 1] = stick_x >> 4;
+    nunchuk_analog_axis[BM_NUNCHUK_ANALOG_AXIS_Y - 1] = stick_y >> 4;
+
     bm_nunchuk_format(nunchuk, nunchuk_buttons, nunchuk_analog_axis, ax, ay, az);
 }
 
 void bm_map_classic(
     /* Inputs */
-    int num_buttons, u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
     /* Mapping tables */
-    const u16 *classic_button_map, const u8 *classic_analog_axis_map,
+    const struct bm_button_lut16_t *classic_button_lut, const u8 *classic_analog_axis_map,
+    const struct bm_stick_lut_t *left_stick_lut, const struct bm_stick_lut_t *right_stick_lut,
+    u8 data_format,
     /* Outputs */
-    struct wiimote_extension_data_format_classic_t *classic)
+    union wiimote_extension_data_t *classic, u8 *size)
 {
-    u16 classic_buttons = 0;
-    u8 classic_analog_axis[BM_CLASSIC_ANALOG_AXIS__NUM] = { 0 };
+    u16 classic_buttons = bm_button_lut16_lookup(classic_button_lut, buttons);
+    u16 classic_analog_axis[BM_CLASSIC_ANALOG_AXIS__NUM];
+    s16 left_trigger, right_trigger;
 
-    for (int i = 0; i < num_buttons; i++) {
-        if (buttons & 1)
-            classic_buttons |= classic_button_map[i];
-        buttons >>= 1;
-    }
+    classic_map_analog_axis(num_analog_axis, analog_axis, classic_analog_axis_map, left_stick_lut,
+                            right_stick_lut, classic_analog_axis, &left_trigger, &right_trigger);
+
+    /* 12 to 10 bits */
+    for (int i = BM_CLASSIC_ANALOG_AXIS_LEFT_X; i <= BM_CLASSIC_ANALOG_AXIS_RIGHT_Y; i++)
+        classic_analog_axis[i - 1] >>= 2;
+
+    /* The trigger buttons click at the end of the travel: a pressed button means fully pressed,
+     * which also covers controllers without analog triggers */
+    classic_analog_axis[BM_CLASSIC_ANALOG_AXIS_LEFT_TRIGGER - 1] =
+        (classic_buttons & CLASSIC_CTRL_BUTTON_FULL_L) ? BM_CLASSIC_ANALOG_MAX
+                                                       : trigger_to_u10(left_trigger);
+    classic_analog_axis[BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER - 1] =
+        (classic_buttons & CLASSIC_CTRL_BUTTON_FULL_R) ? BM_CLASSIC_ANALOG_MAX
+                                                       : trigger_to_u10(right_trigger);
+
+    *size = bm_classic_format(classic, data_format, classic_buttons, classic_analog_axis);
+}
+
+void bm_map_wiiu_pro(
+    /* Inputs */
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    /* Mapping tables */
+    const struct bm_button_lut32_t *wiiu_pro_button_lut, const u8 *classic_analog_axis_map,
+    const struct bm_stick_lut_t *left_stick_lut, const struct bm_stick_lut_t *right_stick_lut,
+    /* Outputs */
+    struct wiimote_extension_data_format_wiiu_pro_t *wiiu_pro)
+{
+    u32 wiiu_pro_buttons = bm_button_lut32_lookup(wiiu_pro_button_lut, buttons);
+    u16 sticks[BM_CLASSIC_ANALOG_AXIS__NUM];
+    s16 left_trigger, right_trigger;
+
+    /* The triggers are digital (ZL/ZR) on this controller */
+    classic_map_analog_axis(num_analog_axis, analog_axis, classic_analog_axis_map, left_stick_lut,
+                            right_stick_lut, sticks, &left_trigger, &right_trigger);
+
+    bm_wiiu_pro_format(wiiu_pro, wiiu_pro_buttons, sticks[BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1],
+                       sticks[BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1],
+                       sticks[BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1],
+                       sticks[BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1]);
+}
+
+/* Slider positions covered by the fingers from the green to the orange fret */
+static const u8 guitar_touch_bar_positions[] = {
+    0x04, 0x07, 0x0A, 0x0C, 0x12, 0x14, 0x17, 0x1A, 0x1F,
+};
+
+/* Axes closer to the center than this don't touch the bar */
+#define GUITAR_TOUCH_BAR_DEADZONE 2048
+
+void bm_map_guitar(
+    /* Inputs */
+    u32 buttons, int num_analog_axis, const s16 *analog_axis,
+    /* Mapping tables */
+    const struct bm_button_lut16_t *guitar_button_lut, const u8 *guitar_analog_axis_map,
+    /* Outputs */
+    struct wiimote_extension_data_format_guitar_t *guitar, bool *tilt)
+{
+    u16 guitar_buttons = bm_button_lut16_lookup(guitar_button_lut, buttons);
+    s16 axes[BM_GUITAR_ANALOG_AXIS__NUM] = { 0 };
+    s32 touch, whammy;
+    u8 touch_bar = GUITAR_TOUCH_BAR_NONE;
 
     for (int i = 0; i < num_analog_axis; i++) {
-        if (classic_analog_axis_map[i])
-            classic_analog_axis[classic_analog_axis_map[i] - 1] = s16_to_u8(analog_axis[i]);
+        if (guitar_analog_axis_map[i])
+            axes[guitar_analog_axis_map[i] - 1] = analog_axis[i];
+    }
+
+    touch = axes[BM_GUITAR_ANALOG_AXIS_TOUCH_BAR - 1];
+    if (touch <= -GUITAR_TOUCH_BAR_DEADZONE || touch >= GUITAR_TOUCH_BAR_DEADZONE) {
+        touch_bar = guitar_touch_bar_positions[((touch + 32768) *
+                                                ARRAY_SIZE(guitar_touch_bar_positions)) >>
+                                               16];
+    }
+
+    /* Released whammy bar rests at its minimum, so do the egc triggers */
+    whammy = MAX2(axes[BM_GUITAR_ANALOG_AXIS_WHAMMY - 1], 0);
+    whammy = GUITAR_WHAMMY_BAR_MIN +
+             ((whammy * (GUITAR_WHAMMY_BAR_MAX - GUITAR_WHAMMY_BAR_MIN + 1)) >> 15);
+
+    *tilt = guitar_buttons & BM_GUITAR_BUTTON_TILT;
+    bm_guitar_format(guitar, guitar_buttons & GUITAR_BUTTON_ALL,
+                     0x20 + (axes[BM_GUITAR_ANALOG_AXIS_STICK_X - 1] >> 10),
+                     0x20 + (axes[BM_GUITAR_ANALOG_AXIS_STICK_Y - 1] >> 10), touch_bar,
+                     MIN2(whammy, GUITAR_WHAMMY_BAR_MAX));
+}
+
+void bm_motion_transform_init(struct bm_motion_transform_t *transform,
+                              const struct bm_accel_calibration_t *calibration,
+                              enum bm_motion_orientation_e orientation,
+                              enum bm_motion_route_e route)
+{
+    static const u8 route_axes[][BM_MOTION_TARGET__NUM] = {
+        [BM_MOTION_ROUTE_WIIMOTE] = { BIT(0) | BIT(1) | BIT(2), 0 },
+        [BM_MOTION_ROUTE_NUNCHUK] = { 0, BIT(0) | BIT(1) | BIT(2) },
+        [BM_MOTION_ROUTE_BOTH] = { BIT(0) | BIT(1) | BIT(2), BIT(0) | BIT(1) | BIT(2) },
+        [BM_MOTION_ROUTE_SPLIT] = { BIT(0), BIT(1) | BIT(2) },
+    };
+    /* Rotation from the controller held flat to the Wiimote held in each orientation */
+    static const s8 orientations[][3][3] = {
+        [BM_MOTION_ORIENTATION_POINTING] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+        /* Wiimote Y axis pointing right */
+        [BM_MOTION_ORIENTATION_SIDEWAYS] = { { 0, 1, 0 }, { -1, 0, 0 }, { 0, 0, 1 } },
+        /* Wiimote Y axis pointing up */
+        [BM_MOTION_ORIENTATION_UPRIGHT] = { { 1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },
+    };
+    /* Q16 gain from controller units to Wiimote units (same calibration for the Nunchuk) */
+    s32 gain = ((ACCEL_ONE_G - ACCEL_ZERO_G) << 16) / calibration->one_g;
+
+    for (int t = 0; t < BM_MOTION_TARGET__NUM; t++) {
+        for (int i = 0; i < 3; i++) {
+            bool routed = route_axes[route][t] & BIT(i);
+            s32 bias = 0;
+
+            for (int j = 0; j < 3; j++) {
+                s32 m = 0;
+
+                if (routed) {
+                    for (int k = 0; k < 3; k++)
+                        m += orientations[orientation][i][k] * calibration->matrix[k][j];
+                }
+
+                /* Q12 * Q16 >> 12 = Q16 */
+                transform->matrix[t][i][j] = (m * gain) >> 12;
+                bias += transform->matrix[t][i][j] * calibration->bias[j];
+            }
+
+            if (routed)
+                transform->offset[t][i] = ACCEL_ZERO_G - (bias >> 16);
+            else
+                transform->offset[t][i] = (i == 2) ? ACCEL_ONE_G : ACCEL_ZERO_G;
+        }
+    }
+}
+
+/* Camera focal length in pixels, gives a ~43 degree horizontal field of view */
+#define IR_CAMERA_FOCAL_LENGTH 1280
+/* Distance between the center of the sensor bar and the center of each LED cluster, in mm */
+#define SENSOR_BAR_HALF_WIDTH_MM 100
+/* Distance between the center of a LED cluster and its outermost LEDs, in mm */
+#define SENSOR_BAR_CLUSTER_HALF_WIDTH_MM 15
+/* Closer than this (in camera pixels) the camera sees a single blob per LED cluster */
+#define IR_DOT_MERGE_DISTANCE 24
+/* Dot size and intensity reported at the default distance */
+#define IR_DOT_SIZE      4
+#define IR_DOT_INTENSITY 64
+
+/* Gyro rates are signed 16-bit over +-2000 degrees/s, sampled every 5ms. Rate times this gives
+ * degrees per tick in Q16. */
+#define GYRO_TICK_SCALE 20
+/* Smoothing filter coefficient range (out of 256) and how fast it opens up with speed */
+#define GYRO_FILTER_MIN_ALPHA   32
+#define GYRO_FILTER_SPEED_SHIFT 12
+
+/* sin(x) in Q14 for the first quadrant, angles are 1/256 of a turn */
+static const s16 sin_table[65] = {
+    0,     402,   804,   1205,  1606,  2006,  2404,  2801,  3196,  3590,  3981,  4370,  4756,
+    5139,  5520,  5897,  6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,  9102,  9434,
+    9760,  10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160,
+    13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286, 15426, 15557,
+    15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379, 16384,
+};
+
+/* atan(i / 32) in 1/256 of a turn */
+static const u8 atan_table[33] = {
+    0,  1,  3,  4,  5,  6,  8,  9,  10, 11, 12, 13, 15, 16, 17, 18, 19,
+    20, 21, 22, 23, 24, 25, 25, 26, 27, 28, 29, 29, 30, 31, 31, 32,
+};
+
+static inline s32 fixed_sin(u8 angle)
+{
+    u8 idx = angle & 63;
+
+    switch (angle >> 6) {
+    case 0:
+        return sin_table[idx];
+    case 1:
+        return sin_table[64 - idx];
+    case 2:
+        return -sin_table[idx];
+    default:
+        return -sin_table[64 - idx];
     }
+}
 
-    bm_classic_format(classic, classic_buttons, classic_analog_axis);
+static inline s32 fixed_cos(u8 angle)
+{
+    return fixed_sin(angle + 64);
 }
 
-static inline void map_ir_dot(struct ir_dot_t ir_dots[static IR_MAX_DOTS],
-                              const struct ir_dot_t *dot)
+static u8 fixed_atan2(s32 y, s32 x)
 {
-    s16 vert_offset = s_sensor_bar_position_top ? IR_VERTICAL_OFFSET : -IR_VERTICAL_OFFSET;
+    u32 abs_x = (x < 0) ? -x : x;
+    u32 abs_y = (y < 0) ? -y : y;
+    u8 angle;
+
+    if (abs_x == 0 && abs_y == 0)
+        return 0;
 
-    ir_dots[0].x = (IR_DOT_CENTER_MIN_X + (IR_DOT_CENTER_MAX_X - dot->x)) - IR_HORIZONTAL_OFFSET;
-    ir_dots[0].y = dot->y + vert_offset;
-    ir_dots[1].x = (IR_DOT_CENTER_MIN_X + (IR_DOT_CENTER_MAX_X - dot->x)) + IR_HORIZONTAL_OFFSET;
-    ir_dots[1].y = dot->y + vert_offset;
+    if (abs_x >= abs_y)
+        angle = atan_table[(abs_y * 32 + abs_x / 2) / abs_x];
+    else
+        angle = 64 - atan_table[(abs_x * 32 + abs_y / 2) / abs_y];
+
+    if (x < 0)
+        angle = 128 - angle;
+    if (y < 0)
+        angle = -angle;
+
+    return angle;
 }
 
-void bm_map_ir_direct(
+bool bm_map_ir_direct(
     /* Inputs */
     s16 x, s16 y,
     /* Outputs */
-    struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+    struct ir_dot_t *pointer)
 {
-    struct ir_dot_t dot;
-
-    if (x < 0) {
-        bm_ir_dots_set_out_of_screen(ir_dots);
-        return;
-    }
+    if (x < 0)
+        return false;
 
-    dot.x = IR_DOT_CENTER_MIN_X +
-            ((int)x * (IR_DOT_CENTER_MAX_X - IR_DOT_CENTER_MIN_X)) / EGC_GAMEPAD_TOUCH_RES;
-    dot.y = IR_DOT_CENTER_MIN_Y +
-            ((int)y * (IR_DOT_CENTER_MAX_Y - IR_DOT_CENTER_MIN_Y)) / EGC_GAMEPAD_TOUCH_RES;
-    map_ir_dot(ir_dots, &dot);
+    pointer->x = IR_DOT_CENTER_MIN_X +
+                 ((int)x * (IR_DOT_CENTER_MAX_X - IR_DOT_CENTER_MIN_X)) / EGC_GAMEPAD_TOUCH_RES;
+    pointer->y = IR_DOT_CENTER_MIN_Y +
+                 ((int)y * (IR_DOT_CENTER_MAX_Y - IR_DOT_CENTER_MIN_Y)) / EGC_GAMEPAD_TOUCH_RES;
+    return true;
 }
 
 void bm_map_ir_analog_axis(
@@ -111,10 +467,8 @@ void bm_map_ir_analog_axis(
     enum bm_ir_emulation_mode_e mode, struct bm_ir_emulation_state_t *state, int num_analog_axis,
     const s16 *analog_axis, const u8 *ir_analog_axis_map,
     /* Outputs */
-    struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+    struct ir_dot_t *pointer)
 {
-    struct ir_dot_t dot;
-
     for (int i = 0; i < num_analog_axis; i++) {
         if (ir_analog_axis_map[i]) {
             s16 val = analog_axis[i];
@@ -138,9 +492,131 @@ void bm_map_ir_analog_axis(
     else if (state->position[BM_IR_AXIS_Y - 1] > IR_DOT_CENTER_MAX_Y)
         state->position[BM_IR_AXIS_Y - 1] = IR_DOT_CENTER_MAX_Y;
 
-    dot.x = state->position[BM_IR_AXIS_X - 1];
-    dot.y = IR_DOT_CENTER_MIN_Y + (IR_DOT_CENTER_MAX_Y - state->position[BM_IR_AXIS_Y - 1]);
-    map_ir_dot(ir_dots, &dot);
+    pointer->x = state->position[BM_IR_AXIS_X - 1];
+    pointer->y = IR_DOT_CENTER_MIN_Y + (IR_DOT_CENTER_MAX_Y - state->position[BM_IR_AXIS_Y - 1]);
+}
+
+static inline s32 clamp_s32(s32 value, s32 min, s32 max)
+{
+    if (value < min)
+        return min;
+    else if (value > max)
+        return max;
+    return value;
+}
+
+/* One-pole low-pass whose coefficient grows with the distance to the target: slow motions are
+ * smoothed out while fast motions go through with little lag. */
+static inline s32 gyro_filter(s32 filtered, s32 target)
+{
+    s32 delta = target - filtered;
+    s32 alpha = GYRO_FILTER_MIN_ALPHA + (((delta < 0) ? -delta : delta) >> GYRO_FILTER_SPEED_SHIFT);
+
+    if (alpha >= 256)
+        return target;
+
+    return filtered + (delta >> 8) * alpha;
+}
+
+void bm_map_ir_gyro(
+    /* Inputs */
+    struct bm_ir_emulation_state_t *state, u8 sensitivity, s16 pitch_rate, s16 yaw_rate,
+    /* Outputs */
+    struct ir_dot_t *pointer)
+{
+    s32 *pos_x = &state->gyro_position[BM_IR_AXIS_X - 1];
+    s32 *pos_y = &state->gyro_position[BM_IR_AXIS_Y - 1];
+    s32 *filt_x = &state->gyro_filtered[BM_IR_AXIS_X - 1];
+    s32 *filt_y = &state->gyro_filtered[BM_IR_AXIS_Y - 1];
+
+    /* Turning left (positive yaw) moves the pointer left, pitching up moves it up */
+    *pos_x -= (s32)yaw_rate * sensitivity * GYRO_TICK_SCALE;
+    *pos_y += (s32)pitch_rate * sensitivity * GYRO_TICK_SCALE;
+
+    /* Clamp the integrated position so that it doesn't drift away past the screen edges */
+    *pos_x = clamp_s32(*pos_x, IR_DOT_CENTER_MIN_X << 16, IR_DOT_CENTER_MAX_X << 16);
+    *pos_y = clamp_s32(*pos_y, IR_DOT_CENTER_MIN_Y << 16, IR_DOT_CENTER_MAX_Y << 16);
+
+    *filt_x = gyro_filter(*filt_x, *pos_x);
+    *filt_y = gyro_filter(*filt_y, *pos_y);
+
+    pointer->x = *filt_x >> 16;
+    pointer->y = IR_DOT_CENTER_MIN_Y + (IR_DOT_CENTER_MAX_Y - (*filt_y >> 16));
+}
+
+void bm_ir_sensor_bar_set_distance(struct bm_ir_sensor_bar_t *sensor_bar, u16 distance)
+{
+    s32 half_width, cluster_half_width;
+    u32 size, intensity;
+
+    if (distance < BM_IR_MIN_DISTANCE)
+        distance = BM_IR_MIN_DISTANCE;
+    else if (distance > BM_IR_MAX_DISTANCE)
+        distance = BM_IR_MAX_DISTANCE;
+
+    /* Divisions are done here so that bm_ir_synthesize_dots() only needs multiplications */
+    half_width = (IR_CAMERA_FOCAL_LENGTH * SENSOR_BAR_HALF_WIDTH_MM) / (distance * 10);
+    cluster_half_width =
+        (IR_CAMERA_FOCAL_LENGTH * SENSOR_BAR_CLUSTER_HALF_WIDTH_MM) / (distance * 10);
+    size = (IR_DOT_SIZE * BM_IR_DEFAULT_DISTANCE) / distance;
+    intensity = (IR_DOT_INTENSITY * BM_IR_DEFAULT_DISTANCE * BM_IR_DEFAULT_DISTANCE) /
+                (distance * distance);
+
+    sensor_bar->distance = distance;
+    sensor_bar->dot_size = MIN2(MAX2(size, 1), 15);
+    sensor_bar->dot_intensity = MIN2(MAX2(intensity, 1), 255);
+
+    if (cluster_half_width * 2 >= IR_DOT_MERGE_DISTANCE) {
+        /* Close enough to tell apart the outer and inner LEDs of each cluster */
+        sensor_bar->num_dots = 4;
+        sensor_bar->dot_offset[0] = -half_width - cluster_half_width;
+        sensor_bar->dot_offset[1] = -half_width + cluster_half_width;
+        sensor_bar->dot_offset[2] = half_width - cluster_half_width;
+        sensor_bar->dot_offset[3] = half_width + cluster_half_width;
+    } else {
+        sensor_bar->num_dots = 2;
+        sensor_bar->dot_offset[0] = -half_width;
+        sensor_bar->dot_offset[1] = half_width;
+    }
+}
+
+void bm_ir_synthesize_dots(
+    /* Inputs */
+    const struct ir_dot_t *pointer, const struct bm_ir_sensor_bar_t *sensor_bar, u16 acc_x,
+    u16 acc_z,
+    /* Outputs */
+    struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+{
+    s32 vert_offset = s_sensor_bar_position_top ? IR_VERTICAL_OFFSET : -IR_VERTICAL_OFFSET;
+    /* Position of the sensor bar center relative to the center of the camera */
+    s32 bar_x = (IR_DOT_CENTER_MIN_X + (IR_DOT_CENTER_MAX_X - pointer->x)) - IR_CAMERA_RES_X / 2;
+    s32 bar_y = pointer->y + vert_offset - IR_CAMERA_RES_Y / 2;
+    /* Rolling the Wiimote rotates the image seen by the camera the other way around */
+    u8 roll = fixed_atan2((s32)acc_x - ACCEL_ZERO_G, (s32)acc_z - ACCEL_ZERO_G);
+    s32 cos_roll = fixed_cos(roll);
+    s32 sin_roll = fixed_sin(roll);
+    int i;
+
+    for (i = 0; i < sensor_bar->num_dots; i++) {
+        s32 x = bar_x + sensor_bar->dot_offset[i];
+        s32 rot_x = ((x * cos_roll + bar_y * sin_roll) >> 14) + IR_CAMERA_RES_X / 2;
+        s32 rot_y = ((bar_y * cos_roll - x * sin_roll) >> 14) + IR_CAMERA_RES_Y / 2;
+
+        if (rot_x < 0 || rot_x >= IR_CAMERA_RES_X || rot_y < 0 || rot_y >= IR_CAMERA_RES_Y) {
+            ir_dots[i].x = IR_DOT_INVALID;
+            ir_dots[i].y = IR_DOT_INVALID;
+        } else {
+            ir_dots[i].x = rot_x;
+            ir_dots[i].y = rot_y;
+            ir_dots[i].size = sensor_bar->dot_size;
+            ir_dots[i].intensity = sensor_bar->dot_intensity;
+        }
+    }
+
+    for (; i < IR_MAX_DOTS; i++) {
+        ir_dots[i].x = IR_DOT_INVALID;
+        ir_dots[i].y = IR_DOT_INVALID;
+    }
 }
 
 void bm_set_sensor_bar_position_top(bool on_top)
@@ -0,0 +1,276 @@
+#include <string.h>
+
+#include "capture.h"
+#include "hci.h"
+#include "hw_timer.h"
+#include "ipc.h"
+#include "syscalls.h"
+#include "types.h"
+#include "utils.h"
+
+/* /dev/fs ioctls */
+#define ISFS_IOCTL_DELETE     7
+#define ISFS_IOCTL_CREATEFILE 9
+#define ISFS_MAXPATH          64
+#define ISFS_PERM_RW          3
+
+/* btsnoop, big endian: file header, then a record header before each packet */
+#define BTSNOOP_VERSION             1
+#define BTSNOOP_DATALINK_HCI_UNENC  1001
+#define BTSNOOP_HEADER_SIZE         16
+#define BTSNOOP_RECORD_HEADER_SIZE  24
+#define BTSNOOP_FLAG_RECEIVED       BIT(0)
+#define BTSNOOP_FLAG_COMMAND_EVENT  BIT(1)
+/* Microseconds from 0 AD to the Unix epoch, timestamps count from there */
+#define BTSNOOP_EPOCH_DELTA_US      0x00dcddb30f2f8000ull
+
+static_assert((CAPTURE_NUM_RECORDS & (CAPTURE_NUM_RECORDS - 1)) == 0);
+static_assert(CAPTURE_INPUT_HEADER_SIZE + CAPTURE_INPUT_STATE_SIZE <= CAPTURE_SNAPLEN);
+
+/* Input devices whose changes are recorded */
+#define CAPTURE_INPUT_SLOTS 4
+
+struct capture_record_t {
+    u32 timestamp; /* Timer ticks */
+    u16 size;      /* Before truncation */
+    u8 type;
+    u8 pad;
+    u8 data[CAPTURE_SNAPLEN];
+};
+
+struct isfs_attr_t {
+    u32 owner_id;
+    u16 group_id;
+    char path[ISFS_MAXPATH];
+    u8 owner_perm;
+    u8 group_perm;
+    u8 other_perm;
+    u8 attributes;
+    u8 pad[2];
+};
+static_assert(sizeof(struct isfs_attr_t) == 0x4C);
+
+static struct capture_record_t capture_ring[CAPTURE_NUM_RECORDS];
+/* Copy of the ring being written to NAND, away from the thread that records */
+static struct capture_record_t capture_staged[CAPTURE_NUM_RECORDS];
+static u32 capture_num_staged;
+/* Records ever written, the ring slot is the low bits */
+static u32 capture_next;
+/* Ticks ever completed, never reset so that the records of consecutive flushes line up */
+static u32 capture_ticks;
+/* Last state recorded per slot, and when. Cleared slots record their next state whatever it is,
+ * and so do the slots whose last state is about to leave the ring: every ring holds the state of
+ * all the controllers plugged in */
+static egc_gamepad_state_t capture_input_states[CAPTURE_INPUT_SLOTS];
+static u32 capture_input_next[CAPTURE_INPUT_SLOTS];
+static bool capture_input_recorded[CAPTURE_INPUT_SLOTS];
+
+void capture_reset(void)
+{
+    capture_next = 0;
+    memset(capture_input_recorded, 0, sizeof(capture_input_recorded));
+}
+
+void capture_record(enum capture_type_e type, const void *data, u32 size)
+{
+    struct capture_record_t *rec = &capture_ring[capture_next % CAPTURE_NUM_RECORDS];
+
+    rec->timestamp = hw_timer_read();
+    rec->size = size;
+    rec->type = type;
+    memcpy(rec->data, data, MIN2(size, CAPTURE_SNAPLEN));
+    capture_next++;
+}
+
+static inline void put_be16(u8 *p, u16 val)
+{
+    p[0] = val >> 8;
+    p[1] = val;
+}
+
+static inline void put_be32(u8 *p, u32 val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static void put_input_state(u8 *p, const egc_gamepad_state_t *state)
+{
+    put_be32(p, state->buttons);
+    p += 4;
+    for (int i = 0; i < EGC_GAMEPAD_AXIS_COUNT; i++, p += 2)
+        put_be16(p, state->axes[i]);
+    for (int i = 0; i < 2; i++, p += 4) {
+        put_be16(&p[0], state->touch_points[i].x);
+        put_be16(&p[2], state->touch_points[i].y);
+    }
+    put_be16(&p[0], state->accelerometer[0].x);
+    put_be16(&p[2], state->accelerometer[0].y);
+    put_be16(&p[4], state->accelerometer[0].z);
+    put_be16(&p[6], state->gyroscope[0].x);
+    put_be16(&p[8], state->gyroscope[0].y);
+    put_be16(&p[10], state->gyroscope[0].z);
+}
+
+void capture_record_input(enum capture_input_e type, u8 slot, const egc_gamepad_state_t *state)
+{
+    u8 data[CAPTURE_INPUT_HEADER_SIZE + CAPTURE_INPUT_STATE_SIZE];
+    u32 size = CAPTURE_INPUT_HEADER_SIZE;
+
+    if (slot >= CAPTURE_INPUT_SLOTS)
+        return;
+
+    if (type == CAPTURE_INPUT_STATE) {
+        if (capture_input_recorded[slot] &&
+            (capture_next - capture_input_next[slot] < CAPTURE_NUM_RECORDS / 2) &&
+            !memcmp(&capture_input_states[slot], state, sizeof(*state)))
+            return;
+        capture_input_states[slot] = *state;
+        capture_input_next[slot] = capture_next;
+        capture_input_recorded[slot] = true;
+        put_input_state(&data[CAPTURE_INPUT_HEADER_SIZE], state);
+        size += CAPTURE_INPUT_STATE_SIZE;
+    } else {
+        /* A new device starts over, with its first state */
+        capture_input_recorded[slot] = false;
+    }
+
+    data[0] = HCI_EVENT_VENDOR;
+    data[1] = size - 2;
+    data[2] = type;
+    data[3] = slot;
+    put_be32(&data[4], capture_ticks);
+    capture_record(CAPTURE_TYPE_INPUT, data, size);
+}
+
+void capture_tick(void)
+{
+    capture_ticks++;
+}
+
+u32 capture_count(void)
+{
+    return MIN2(capture_next, CAPTURE_NUM_RECORDS);
+}
+
+static inline u32 btsnoop_flags(u8 type)
+{
+    switch (type) {
+    case CAPTURE_TYPE_HCI_CMD:
+        return BTSNOOP_FLAG_COMMAND_EVENT;
+    case CAPTURE_TYPE_HCI_EVENT:
+        return BTSNOOP_FLAG_COMMAND_EVENT | BTSNOOP_FLAG_RECEIVED;
+    case CAPTURE_TYPE_ACL_IN:
+        return BTSNOOP_FLAG_RECEIVED;
+    case CAPTURE_TYPE_HCI_EVENT_INJECTED:
+        return BTSNOOP_FLAG_COMMAND_EVENT | BTSNOOP_FLAG_RECEIVED | BTSNOOP_FLAG_INJECTED;
+    case CAPTURE_TYPE_ACL_IN_INJECTED:
+        return BTSNOOP_FLAG_RECEIVED | BTSNOOP_FLAG_INJECTED;
+    case CAPTURE_TYPE_INPUT:
+        return BTSNOOP_FLAG_COMMAND_EVENT | BTSNOOP_FLAG_RECEIVED | BTSNOOP_FLAG_INPUT;
+    default:
+        return 0;
+    }
+}
+
+/* ISFS doesn't truncate on open, start from an empty file */
+static int create_file(const char *path)
+{
+    static char delete_path[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32);
+    static struct isfs_attr_t attr ATTRIBUTE_ALIGN(32);
+    int fs_fd, ret;
+
+    if (strlen(path) >= ISFS_MAXPATH)
+        return IOS_EINVAL;
+
+    fs_fd = os_open("/dev/fs", 0);
+    if (fs_fd < 0)
+        return fs_fd;
+
+    memset(delete_path, 0, sizeof(delete_path));
+    strcpy(delete_path, path);
+    os_ioctl(fs_fd, ISFS_IOCTL_DELETE, delete_path, sizeof(delete_path), NULL, 0);
+
+    memset(&attr, 0, sizeof(attr));
+    strcpy(attr.path, path);
+    attr.owner_perm = ISFS_PERM_RW;
+    attr.group_perm = ISFS_PERM_RW;
+    attr.other_perm = ISFS_PERM_RW;
+    ret = os_ioctl(fs_fd, ISFS_IOCTL_CREATEFILE, &attr, sizeof(attr), NULL, 0);
+    os_close(fs_fd);
+    if (ret < 0)
+        return ret;
+
+    return os_open(path, IOS_OPEN_WRITE);
+}
+
+int capture_stage(void)
+{
+    u32 first_slot = (capture_next - capture_count()) % CAPTURE_NUM_RECORDS;
+    u32 tail = MIN2(capture_count(), CAPTURE_NUM_RECORDS - first_slot);
+
+    /* Oldest first, in at most two pieces */
+    memcpy(&capture_staged[0], &capture_ring[first_slot], tail * sizeof(capture_ring[0]));
+    memcpy(&capture_staged[tail], &capture_ring[0],
+           (capture_count() - tail) * sizeof(capture_ring[0]));
+    capture_num_staged = capture_count();
+
+    capture_reset();
+    return capture_num_staged;
+}
+
+int capture_write_staged(const char *path)
+{
+    static u8 buf[BTSNOOP_RECORD_HEADER_SIZE + CAPTURE_SNAPLEN] ATTRIBUTE_ALIGN(32);
+    const struct capture_record_t *rec;
+    u32 prev_timestamp;
+    u64 ticks, us;
+    u16 snaplen;
+    int fd, ret;
+
+    fd = create_file(path);
+    if (fd < 0)
+        return fd;
+
+    memcpy(buf, "btsnoop", 8);
+    put_be32(&buf[8], BTSNOOP_VERSION);
+    put_be32(&buf[12], BTSNOOP_DATALINK_HCI_UNENC);
+    ret = os_write(fd, buf, BTSNOOP_HEADER_SIZE);
+
+    /* The 32-bit timer wraps every ~37 minutes, rebuild a monotonic count from the deltas */
+    prev_timestamp = capture_staged[0].timestamp;
+    ticks = prev_timestamp;
+
+    for (u32 i = 0; (i < capture_num_staged) && (ret >= 0); i++) {
+        rec = &capture_staged[i];
+        snaplen = MIN2(rec->size, CAPTURE_SNAPLEN);
+        ticks += (u32)(rec->timestamp - prev_timestamp);
+        prev_timestamp = rec->timestamp;
+        /* Rounded, so that the mock's microseconds come back exact */
+        us = BTSNOOP_EPOCH_DELTA_US +
+             (ticks * HW_TIMER_MUL + HW_TIMER_DIV / 2) / HW_TIMER_DIV;
+
+        put_be32(&buf[0], rec->size);
+        put_be32(&buf[4], snaplen);
+        put_be32(&buf[8], btsnoop_flags(rec->type) | BTSNOOP_FLAGS_BYTE_ORDER);
+        put_be32(&buf[12], 0);
+        put_be32(&buf[16], us >> 32);
+        put_be32(&buf[20], us);
+        memcpy(&buf[BTSNOOP_RECORD_HEADER_SIZE], rec->data, snaplen);
+        ret = os_write(fd, buf, BTSNOOP_RECORD_HEADER_SIZE + snaplen);
+    }
+
+    os_close(fd);
+    if (ret < 0)
+        return ret;
+
+    return capture_num_staged;
+}
+
+int capture_flush(const char *path)
+{
+    capture_stage();
+    return capture_write_staged(path);
+}
@@ -1,5 +1,6 @@
 #include "button_map.h"
 #include "fake_wiimote.h"
+#include "fakemote_dev.h"
 #include "hci.h"
 #include "hci_state.h"
 #include "injmessage.h"
@@ -88,6 +89,15 @@ static int wiimote_send_ack(const fake_wiimote_t *wiimote, u8 rpt_id, u8 error_c
                                  INPUT_REPORT_ID_ACK, &ack, sizeof(ack));
 }
 
+static inline bool extension_port_is_connected(const fake_wiimote_t *wiimote)
+{
+    /* While switching to/from the MotionPlus the port reports a detach first */
+    if (wiimote->motion_plus_port_event == MOTION_PLUS_PORT_ATTACH)
+        return false;
+
+    return wiimote->motion_plus_active || (wiimote->cur_extension != WIIMOTE_EXT_NONE);
+}
+
 static int wiimote_send_input_report_status(const fake_wiimote_t *wiimote)
 {
     struct wiimote_input_report_status_t status;
@@ -95,8 +105,9 @@ static int wiimote_send_input_report_status(const fake_wiimote_t *wiimote)
     status.leds = wiimote->status.leds;
     status.ir = wiimote->status.ir;
     status.speaker = 0;
-    status.extension = wiimote->cur_extension != WIIMOTE_EXT_NONE;
+    status.extension = extension_port_is_connected(wiimote);
     status.battery_low = 0;
+    memset(&status.padding2, 0, sizeof(status.padding2));
     status.battery = 0xFF;
     return send_hid_input_report(wiimote->hci_con_handle, wiimote->psm_hid_intr_chn.remote_cid,
                                  INPUT_REPORT_ID_STATUS, &status, sizeof(status));
@@ -112,6 +123,101 @@ static inline int disconnect_l2cap_channel(u16 hci_con_handle, l2cap_channel_inf
     return ret;
 }
 
+/* IR camera data encoders. Dots that aren't visible are reported as all 0xFF bytes. */
+
+static inline bool ir_dot_is_valid(const struct ir_dot_t *dot)
+{
+    return dot->y < IR_CAMERA_RES_Y;
+}
+
+static void ir_camera_encode_basic(u8 ir_data[static CAMERA_DATA_BYTES],
+                                   const struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+{
+    /* Invalid dots have both coordinates set to 0x3FF, which encodes to all 0xFF already */
+    for (int i = 0; i < IR_MAX_DOTS; i += 2) {
+        const struct ir_dot_t *dot0 = &ir_dots[i];
+        const struct ir_dot_t *dot1 = &ir_dots[i + 1];
+        u8 *out = &ir_data[(i / 2) * 5];
+
+        out[0] = dot0->x & 0xFF;
+        out[1] = dot0->y & 0xFF;
+        out[2] = (((dot0->y >> 8) & 3) << 6) | (((dot0->x >> 8) & 3) << 4) |
+                 (((dot1->y >> 8) & 3) << 2) | ((dot1->x >> 8) & 3);
+        out[3] = dot1->x & 0xFF;
+        out[4] = dot1->y & 0xFF;
+    }
+}
+
+static inline void ir_camera_encode_extended_dot(u8 out[static 3], const struct ir_dot_t *dot)
+{
+    if (!ir_dot_is_valid(dot)) {
+        memset(out, 0xFF, 3);
+        return;
+    }
+
+    out[0] = dot->x & 0xFF;
+    out[1] = dot->y & 0xFF;
+    out[2] = ((dot->y & 0x300) >> 2) | ((dot->x & 0x300) >> 4) | (dot->size & 0xF);
+}
+
+static void ir_camera_encode_extended(u8 ir_data[static CAMERA_DATA_BYTES],
+                                      const struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+{
+    for (int i = 0; i < IR_MAX_DOTS; i++)
+        ir_camera_encode_extended_dot(&ir_data[i * 3], &ir_dots[i]);
+}
+
+static void ir_camera_encode_full(u8 ir_data[static CAMERA_DATA_BYTES],
+                                  const struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+{
+    for (int i = 0; i < IR_MAX_DOTS; i++) {
+        const struct ir_dot_t *dot = &ir_dots[i];
+        u8 *out = &ir_data[i * 9];
+
+        ir_camera_encode_extended_dot(out, dot);
+        if (!ir_dot_is_valid(dot)) {
+            memset(&out[3], 0xFF, 6);
+            continue;
+        }
+
+        /* The bounding box is in sensor pixels (1/8 of the reported resolution) */
+        out[3] = (dot->x > dot->size) ? (dot->x - dot->size) >> 3 : 0;
+        out[4] = (dot->y > dot->size) ? (dot->y - dot->size) >> 3 : 0;
+        out[5] = MIN2(dot->x + dot->size, IR_CAMERA_RES_X - 1) >> 3;
+        out[6] = MIN2(dot->y + dot->size, IR_CAMERA_RES_Y - 1) >> 3;
+        out[7] = 0;
+        out[8] = dot->intensity;
+    }
+}
+
+static void ir_camera_encode_disabled(u8 ir_data[static CAMERA_DATA_BYTES],
+                                      const struct ir_dot_t ir_dots[static IR_MAX_DOTS])
+{
+    /* Nothing to do, the camera data is all 0xFF */
+}
+
+static void ir_camera_select_encoder(fake_wiimote_t *wiimote)
+{
+    /* Also clears the bytes past the end of the new mode's data */
+    memset(wiimote->ir_regs.camera_data, 0xFF, sizeof(wiimote->ir_regs.camera_data));
+
+    switch (wiimote->ir_regs.mode) {
+    case IR_MODE_BASIC:
+        wiimote->ir_encode = ir_camera_encode_basic;
+        break;
+    case IR_MODE_EXTENDED:
+        wiimote->ir_encode = ir_camera_encode_extended;
+        break;
+    case IR_MODE_FULL:
+        wiimote->ir_encode = ir_camera_encode_full;
+        break;
+    default:
+        /* This seems to be fairly common, 0xff data is sent in this case */
+        wiimote->ir_encode = ir_camera_encode_disabled;
+        break;
+    }
+}
+
 /* Init state */
 
 static inline u8 calculate_calibration_data_checksum(const u8 *data, u8 size)
@@ -187,6 +293,35 @@ void fake_wiimote_init(fake_wiimote_t *wiimote, const bdaddr_t *bdaddr)
     bacpy(&wiimote->bdaddr, bdaddr);
 }
 
+static void nunchuk_calibration_init(struct wiimote_extension_registers_t *regs)
+{
+    /* Same accelerometer calibration as the Wiimote, full range sticks */
+    static const u8 calibration[14] = {
+        ACCEL_ZERO_G >> 2,
+        ACCEL_ZERO_G >> 2,
+        ACCEL_ZERO_G >> 2,
+        ((ACCEL_ZERO_G & 3) << 4) | ((ACCEL_ZERO_G & 3) << 2) | (ACCEL_ZERO_G & 3),
+        ACCEL_ONE_G >> 2,
+        ACCEL_ONE_G >> 2,
+        ACCEL_ONE_G >> 2,
+        ((ACCEL_ONE_G & 3) << 4) | ((ACCEL_ONE_G & 3) << 2) | (ACCEL_ONE_G & 3),
+        /* Stick X max, min, center */
+        0xFF,
+        0x00,
+        0x80,
+        /* Stick Y max, min, center */
+        0xFF,
+        0x00,
+        0x80,
+    };
+    u8 checksum = calculate_calibration_data_checksum(calibration, sizeof(calibration));
+
+    memcpy(regs->calibration1, calibration, sizeof(calibration));
+    regs->calibration1[14] = checksum;
+    regs->calibration1[15] = checksum + 0x55;
+    memcpy(regs->calibration2, regs->calibration1, sizeof(regs->calibration2));
+}
+
 static inline void fake_wiimote_reset_extension_state(fake_wiimote_t *wiimote)
 {
     union wiimote_extension_data_t ext;
@@ -196,6 +331,8 @@ static inline void fake_wiimote_reset_extension_state(fake_wiimote_t *wiimote)
     memset(&wiimote->extension_regs, 0, sizeof(wiimote->extension_regs));
     memset(&wiimote->extension_key, 0, sizeof(wiimote->extension_key));
     wiimote->extension_key_dirty = true;
+    wiimote->extension_shadow_len = 0;
+    wiimote->classic_data_format = CLASSIC_DATA_FORMAT_DEFAULT;
 
     switch (wiimote->cur_extension) {
     case WIIMOTE_EXT_NUNCHUK:
@@ -229,17 +366,51 @@ static inline void fake_wiimote_reset_extension_state(fake_wiimote_t *wiimote)
         for (int i = 0; i < ARRAY_SIZE(analog_axis); i++)
             analog_axis[i] = 0x80;
 
-        bm_nunchuk_format(&ext.nunchuk, 0, analog_axis, 0, 0, 0);
+        bm_nunchuk_format(&ext.nunchuk, 0, analog_axis, ACCEL_ZERO_G, ACCEL_ZERO_G, ACCEL_ONE_G);
         memcpy(ext_controller_data, &ext.nunchuk, sizeof(ext.nunchuk));
+        nunchuk_calibration_init(&wiimote->extension_regs);
     } else if (wiimote->cur_extension == WIIMOTE_EXT_CLASSIC) {
-        u8 analog_axis[BM_CLASSIC_ANALOG_AXIS__NUM];
+        u16 analog_axis[BM_CLASSIC_ANALOG_AXIS__NUM] = {
+            [BM_CLASSIC_ANALOG_AXIS_LEFT_X - 1] = 0x200,
+            [BM_CLASSIC_ANALOG_AXIS_LEFT_Y - 1] = 0x200,
+            [BM_CLASSIC_ANALOG_AXIS_RIGHT_X - 1] = 0x200,
+            [BM_CLASSIC_ANALOG_AXIS_RIGHT_Y - 1] = 0x200,
+        };
+        u8 size;
+
+        size = bm_classic_format(&ext, CLASSIC_DATA_FORMAT_DEFAULT, 0, analog_axis);
+        memcpy(ext_controller_data, &ext, size);
+    } else if (wiimote->cur_extension == WIIMOTE_EXT_CLASSIC_WIIU_PRO) {
+        bm_wiiu_pro_format(&ext.wiiu_pro, 0, 0x800, 0x800, 0x800, 0x800);
+        memcpy(ext_controller_data, &ext.wiiu_pro, sizeof(ext.wiiu_pro));
+    } else if (wiimote->cur_extension == WIIMOTE_EXT_GUITAR) {
+        bm_guitar_format(&ext.guitar, 0, 0x20, 0x20, GUITAR_TOUCH_BAR_NONE, GUITAR_WHAMMY_BAR_MIN);
+        memcpy(ext_controller_data, &ext.guitar, sizeof(ext.guitar));
+    }
+}
 
-        for (int i = 0; i < ARRAY_SIZE(analog_axis); i++)
-            analog_axis[i] = 0x80;
+static void motion_plus_reset_state(fake_wiimote_t *wiimote)
+{
+    /* Fast and slow calibration blocks: zero and scale values for yaw, roll and pitch (16-bit
+     * big endian, zero at 1 << 15, +0x4400 for the full scale) and the full scale in degrees/s
+     * divided by 6 (1200 and 270). The CRC32 of both blocks is split across their last 2 bytes. */
+    static const u8 calibration[0x20] = {
+        /* Fast */
+        0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0xC4, 0x00,
+        0xC4, 0x00, 0xC4, 0x00, 0xC8, 0x00, 0x3A, 0xEB,
+        /* Slow */
+        0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0xC4, 0x00,
+        0xC4, 0x00, 0xC4, 0x00, 0x2D, 0x00, 0x44, 0x1B,
+    };
 
-        bm_classic_format(&ext.classic, 0, analog_axis);
-        memcpy(ext_controller_data, &ext.classic, sizeof(ext.classic));
-    }
+    memset(&wiimote->motion_plus_regs, 0, sizeof(wiimote->motion_plus_regs));
+    memcpy((u8 *)&wiimote->motion_plus_regs + WIIMOTE_EXP_MEM_CALIBR, calibration,
+           sizeof(calibration));
+    memcpy(wiimote->motion_plus_regs.identifier, EXP_ID_CODE_MOTION_PLUS,
+           sizeof(wiimote->motion_plus_regs.identifier));
+    wiimote->motion_plus_active = false;
+    wiimote->motion_plus_report_ext = false;
+    wiimote->motion_plus_port_event = MOTION_PLUS_PORT_IDLE;
 }
 
 void fake_wiimote_init_state(fake_wiimote_t *wiimote, input_device_t *input_device)
@@ -261,10 +432,17 @@ void fake_wiimote_init_state(fake_wiimote_t *wiimote, input_device_t *input_devi
     wiimote->acc_z = ACCEL_ONE_G;
     wiimote->rumble_on = false;
     memset(&wiimote->ir_regs, 0, sizeof(wiimote->ir_regs));
-    wiimote->ir_valid_dots = 0;
+    ir_camera_select_encoder(wiimote);
     fake_wiimote_reset_extension_state(wiimote);
     wiimote->cur_extension = WIIMOTE_EXT_NONE;
-    wiimote->new_extension = WIIMOTE_EXT_NONE;
+    /* Attached once the game is connected, as if it had been plugged in */
+    wiimote->new_extension = input_device_get_extension(input_device);
+    wiimote->extension_change_holdoff = 0;
+    wiimote->motion_plus_available = input_device_has_gyroscope(input_device);
+    wiimote->gyro_yaw = 0;
+    wiimote->gyro_roll = 0;
+    wiimote->gyro_pitch = 0;
+    motion_plus_reset_state(wiimote);
     eeprom_init(&wiimote->eeprom);
     wiimote->read_request.size = 0;
     wiimote->reporting_mode = INPUT_REPORT_ID_BTN;
@@ -355,61 +533,17 @@ void fake_wiimote_report_accelerometer(fake_wiimote_t *wiimote, u16 acc_x, u16 a
 void fake_wiimote_report_ir_dots(fake_wiimote_t *wiimote,
                                  struct ir_dot_t ir_dots[static IR_MAX_DOTS])
 {
-    u8 *ir_data = wiimote->ir_regs.camera_data;
+    wiimote->ir_encode(wiimote->ir_regs.camera_data, ir_dots);
+}
 
-    switch (wiimote->ir_regs.mode) {
-    case IR_MODE_BASIC:
-        ir_data[0] = ir_dots[0].x & 0xFF;
-        ir_data[1] = ir_dots[0].y & 0xFF;
-        ir_data[2] = (((ir_dots[0].y >> 8) & 3) << 6) | (((ir_dots[0].x >> 8) & 3) << 4) |
-                     (((ir_dots[1].y >> 8) & 3) << 2) | ((ir_dots[1].x >> 8) & 3);
-        ir_data[3] = ir_dots[1].x & 0xFF;
-        ir_data[4] = ir_dots[1].y & 0xFF;
-        ir_data[5] = 0xFF;
-        ir_data[6] = 0xFF;
-        ir_data[7] = 0xFF;
-        ir_data[8] = 0xFF;
-        ir_data[9] = 0xFF;
-        break;
-    case IR_MODE_EXTENDED:
-        ir_data[0] = ir_dots[0].x & 0xFF;
-        ir_data[1] = ir_dots[0].y & 0xFF;
-        ir_data[2] = ((ir_dots[0].y & 0x300) >> 2) | ((ir_dots[0].x & 0x300) >> 4) | IR_DOT_SIZE;
-        ir_data[3] = ir_dots[1].x & 0xFF;
-        ir_data[4] = ir_dots[1].y & 0xFF;
-        ir_data[5] = ((ir_dots[1].y & 0x300) >> 2) | ((ir_dots[1].x & 0x300) >> 4) | IR_DOT_SIZE;
-        ir_data[6] = 0xFF;
-        ir_data[7] = 0xFF;
-        ir_data[8] = 0xF0;
-        ir_data[9] = 0xFF;
-        ir_data[10] = 0xFF;
-        ir_data[11] = 0xF0;
-        break;
-    case IR_MODE_FULL:
-        ir_data[0] = ir_dots[0].x & 0xFF;
-        ir_data[1] = ir_dots[0].y & 0xFF;
-        ir_data[2] = ((ir_dots[0].y & 0x300) >> 2) | ((ir_dots[0].x & 0x300) >> 4) | IR_DOT_SIZE;
-        ir_data[3] = 0;
-        ir_data[4] = 0x7F;
-        ir_data[5] = 0;
-        ir_data[6] = 0x7F;
-        ir_data[7] = 0;
-        ir_data[8] = 0xFF;
-        ir_data[9] = ir_dots[1].x & 0xFF;
-        ir_data[10] = ir_dots[1].y & 0xFF;
-        ir_data[11] = ((ir_dots[1].y & 0x300) >> 2) | ((ir_dots[1].x & 0x300) >> 4) | IR_DOT_SIZE;
-        ir_data[12] = 0;
-        ir_data[13] = 0x7F;
-        ir_data[14] = 0;
-        ir_data[15] = 0x7F;
-        ir_data[16] = 0;
-        ir_data[17] = 0xFF;
-        memset(&ir_data[18], 0xFF, 2 * 9);
-        break;
-    default:
-        /* This seems to be fairly common, 0xff data is sent in this case */
-        memset(ir_data, 0xFF, sizeof(wiimote->ir_regs.camera_data));
-        break;
+void fake_wiimote_report_motion_plus(fake_wiimote_t *wiimote, s16 yaw, s16 roll, s16 pitch)
+{
+    if (yaw != wiimote->gyro_yaw || roll != wiimote->gyro_roll || pitch != wiimote->gyro_pitch) {
+        wiimote->gyro_yaw = yaw;
+        wiimote->gyro_roll = roll;
+        wiimote->gyro_pitch = pitch;
+        if (wiimote->motion_plus_active)
+            wiimote->input_dirty = true;
     }
 }
 
@@ -423,12 +557,27 @@ void fake_wiimote_report_input_ext(fake_wiimote_t *wiimote, u16 buttons, const v
     if (btn_changed || (ext_cmp != ext_size)) {
         wiimote->buttons = buttons;
         /* If there are changes to the extension bytes, copy them */
-        if (ext_cmp != ext_size)
+        if (ext_cmp != ext_size) {
             memcpy(ext_controller_data + ext_cmp, ext_data + ext_cmp, ext_size - ext_cmp);
+            wiimote->extension_shadow_len = MIN2(wiimote->extension_shadow_len, ext_cmp);
+        }
         wiimote->input_dirty = true;
     }
 }
 
+enum wiimote_ext_e fake_wiimote_get_extension(const fake_wiimote_t *wiimote)
+{
+    return wiimote->cur_extension;
+}
+
+u8 fake_wiimote_get_classic_data_format(const fake_wiimote_t *wiimote)
+{
+    /* The MotionPlus passthrough packs the default format */
+    if (wiimote->motion_plus_active)
+        return CLASSIC_DATA_FORMAT_DEFAULT;
+    return wiimote->classic_data_format;
+}
+
 static inline bool ir_camera_read_data(fake_wiimote_t *wiimote, void *dst, u16 address, u16 size)
 {
     if (address + size > sizeof(wiimote->ir_regs))
@@ -449,23 +598,36 @@ static inline bool ir_camera_write_data(fake_wiimote_t *wiimote, const void *src
     /* Copy the requested data to the IR camera registers */
     memcpy((u8 *)&wiimote->ir_regs + address, src, size);
 
+    /* Pick the encoder for the (possibly) new mode */
+    if ((address + size > IR_CAMERA_MODE_OFFSET) && (address < IR_CAMERA_DATA_END))
+        ir_camera_select_encoder(wiimote);
+
     return true;
 }
 
-static bool extension_read_data(fake_wiimote_t *wiimote, void *dst, u16 address, u16 size)
+/* The active MotionPlus takes over the extension address and passes the extension through */
+static inline struct wiimote_extension_registers_t *extension_port_regs(fake_wiimote_t *wiimote)
+{
+    return wiimote->motion_plus_active ? &wiimote->motion_plus_regs : &wiimote->extension_regs;
+}
+
+static bool extension_read_data(fake_wiimote_t *wiimote,
+                                const struct wiimote_extension_registers_t *regs, void *dst,
+                                u16 address, u16 size)
 {
-    if (address + size > sizeof(wiimote->extension_regs))
+    if (address + size > sizeof(*regs))
         return false;
 
     /* Copy the requested data from the extension registers */
-    memcpy(dst, (u8 *)&wiimote->extension_regs + address, size);
+    memcpy(dst, (const u8 *)regs + address, size);
 
     /* Encrypt data read from extension registers (if necessary) */
-    if (wiimote->extension_regs.encryption == ENCRYPTION_ENABLED) {
+    if (regs->encryption == ENCRYPTION_ENABLED) {
         if (wiimote->extension_key_dirty) {
-            wiimote_crypto_generate_key_from_extension_key_data(
-                &wiimote->extension_key, wiimote->extension_regs.encryption_key_data);
+            wiimote_crypto_generate_key_from_extension_key_data(&wiimote->extension_key,
+                                                                regs->encryption_key_data);
             wiimote->extension_key_dirty = false;
+            wiimote->extension_shadow_len = 0;
         }
         wiimote_crypto_encrypt(dst, &wiimote->extension_key, address, size);
     }
@@ -473,9 +635,41 @@ static bool extension_read_data(fake_wiimote_t *wiimote, void *dst, u16 address,
     return true;
 }
 
-static bool extension_write_data(fake_wiimote_t *wiimote, const void *src, u16 address, u16 size)
+/* Data reports always read the extension data from offset 0. Encrypting it for every report is
+ * wasteful, so only the bytes that changed since the last one are encrypted into the shadow */
+static void extension_read_controller_data(fake_wiimote_t *wiimote, void *dst, u8 size)
+{
+    const struct wiimote_extension_registers_t *regs = &wiimote->extension_regs;
+    u8 len;
+
+    if (regs->encryption != ENCRYPTION_ENABLED) {
+        memcpy(dst, regs->controller_data, size);
+        return;
+    }
+
+    if (wiimote->extension_key_dirty) {
+        wiimote_crypto_generate_key_from_extension_key_data(&wiimote->extension_key,
+                                                            regs->encryption_key_data);
+        wiimote->extension_key_dirty = false;
+        wiimote->extension_shadow_len = 0;
+    }
+
+    len = wiimote->extension_shadow_len;
+    if (len < size) {
+        memcpy(&wiimote->extension_shadow[len], &regs->controller_data[len], size - len);
+        wiimote_crypto_encrypt(&wiimote->extension_shadow[len], &wiimote->extension_key, len,
+                               size - len);
+        wiimote->extension_shadow_len = size;
+    }
+
+    memcpy(dst, wiimote->extension_shadow, size);
+}
+
+static bool extension_write_data(fake_wiimote_t *wiimote,
+                                 struct wiimote_extension_registers_t *regs, const void *src,
+                                 u16 address, u16 size)
 {
-    if (address + size > sizeof(wiimote->extension_regs))
+    if (address + size > sizeof(*regs))
         return false;
 
     if ((address + size > ENCRYPTION_KEY_DATA_BEGIN) && (address < ENCRYPTION_KEY_DATA_END)) {
@@ -483,11 +677,67 @@ static bool extension_write_data(fake_wiimote_t *wiimote, const void *src, u16 a
         wiimote->extension_key_dirty = true;
     }
 
+    /* Covers the key and encryption flag, and any game writing to the data itself */
+    wiimote->extension_shadow_len = 0;
+
     /* Copy the requested data to the extension registers */
-    memcpy((u8 *)&wiimote->extension_regs + address, src, size);
+    memcpy((u8 *)regs + address, src, size);
     return true;
 }
 
+static inline bool write_covers(u16 address, u16 size, u16 reg)
+{
+    return (address <= reg) && (reg < address + size);
+}
+
+static void classic_check_data_format(fake_wiimote_t *wiimote, u16 address, u16 size)
+{
+    u8 format = wiimote->extension_regs.identifier[4];
+
+    if (wiimote->cur_extension != WIIMOTE_EXT_CLASSIC ||
+        !write_covers(address, size, CLASSIC_DATA_FORMAT_OFFSET))
+        return;
+
+    if (format == CLASSIC_DATA_FORMAT_HIGH_RES || format == CLASSIC_DATA_FORMAT_FULL)
+        wiimote->classic_data_format = format;
+    else
+        wiimote->classic_data_format = CLASSIC_DATA_FORMAT_DEFAULT;
+}
+
+static void motion_plus_check_activation(fake_wiimote_t *wiimote, u16 address, u16 size)
+{
+    u8 *identifier = wiimote->motion_plus_regs.identifier;
+    u8 mode = identifier[4];
+
+    if (!write_covers(address, size, MOTION_PLUS_MODE_OFFSET))
+        return;
+
+    if (mode != MOTION_PLUS_MODE_STANDALONE && mode != MOTION_PLUS_MODE_NUNCHUK &&
+        mode != MOTION_PLUS_MODE_CLASSIC)
+        return;
+
+    /* Move to the extension address: 00 00 A4 20 <mode> 05 */
+    identifier[2] = 0xA4;
+    memset(wiimote->motion_plus_regs.controller_data, 0,
+           sizeof(wiimote->motion_plus_regs.controller_data));
+    wiimote->motion_plus_active = true;
+    wiimote->motion_plus_report_ext = false;
+    wiimote->motion_plus_port_event = MOTION_PLUS_PORT_DETACH;
+    wiimote->extension_key_dirty = true;
+}
+
+static void motion_plus_check_deactivation(fake_wiimote_t *wiimote, u16 address, u16 size)
+{
+    if (!write_covers(address, size, EXTENSION_ENCRYPTION_OFFSET) ||
+        wiimote->motion_plus_regs.encryption != MOTION_PLUS_DEACTIVATE)
+        return;
+
+    /* Back to its own address, the passed-through extension needs to be set up again */
+    motion_plus_reset_state(wiimote);
+    fake_wiimote_reset_extension_state(wiimote);
+    wiimote->motion_plus_port_event = MOTION_PLUS_PORT_DETACH;
+}
+
 static bool fake_wiimote_process_read_request(fake_wiimote_t *wiimote)
 {
     struct wiimote_input_report_read_data_t reply;
@@ -513,7 +763,13 @@ static bool fake_wiimote_process_read_request(fake_wiimote_t *wiimote)
         if (wiimote->read_request.slave_address == EEPROM_I2C_ADDR) {
             error = ERROR_CODE_INVALID_ADDRESS;
         } else if (wiimote->read_request.slave_address == EXTENSION_I2C_ADDR) {
-            if (!extension_read_data(wiimote, reply.data, address, read_size))
+            if (!extension_read_data(wiimote, extension_port_regs(wiimote), reply.data, address,
+                                     read_size))
+                error = ERROR_CODE_NACK;
+        } else if (wiimote->read_request.slave_address == MOTION_PLUS_I2C_ADDR) {
+            if (!wiimote->motion_plus_available || wiimote->motion_plus_active ||
+                !extension_read_data(wiimote, &wiimote->motion_plus_regs, reply.data, address,
+                                     read_size))
                 error = ERROR_CODE_NACK;
         } else if (wiimote->read_request.slave_address == CAMERA_I2C_ADDR) {
             if (!ir_camera_read_data(wiimote, reply.data, address, read_size))
@@ -567,8 +823,22 @@ static void fake_wiimote_process_write_request(fake_wiimote_t *wiimote,
         if (write->slave_address == EEPROM_I2C_ADDR) {
             error = ERROR_CODE_INVALID_ADDRESS;
         } else if (write->slave_address == EXTENSION_I2C_ADDR) {
-            if (!extension_write_data(wiimote, write->data, write->address, write->size))
+            bool motion_plus_active = wiimote->motion_plus_active;
+
+            if (!extension_write_data(wiimote, extension_port_regs(wiimote), write->data,
+                                      write->address, write->size))
+                error = ERROR_CODE_NACK;
+            else if (motion_plus_active)
+                motion_plus_check_deactivation(wiimote, write->address, write->size);
+            else
+                classic_check_data_format(wiimote, write->address, write->size);
+        } else if (write->slave_address == MOTION_PLUS_I2C_ADDR) {
+            if (!wiimote->motion_plus_available || wiimote->motion_plus_active ||
+                !extension_write_data(wiimote, &wiimote->motion_plus_regs, write->data,
+                                      write->address, write->size))
                 error = ERROR_CODE_NACK;
+            else
+                motion_plus_check_activation(wiimote, write->address, write->size);
         } else if (write->slave_address == CAMERA_I2C_ADDR) {
             if (!ir_camera_write_data(wiimote, write->data, write->address, write->size))
                 error = ERROR_CODE_NACK;
@@ -583,8 +853,18 @@ static void fake_wiimote_process_write_request(fake_wiimote_t *wiimote,
     wiimote_send_ack(wiimote, OUTPUT_REPORT_ID_WRITE_DATA, error);
 }
 
+/* Leaves the game time to probe the new extension before the next swap, 250ms at 5ms per tick */
+#define EXTENSION_CHANGE_HOLDOFF_TICKS 50
+
 static inline bool fake_wiimote_process_extension_change(fake_wiimote_t *wiimote)
 {
+    /* Only the latest requested extension is applied once the hold-off expires, so switching
+     * quickly through the rotation doesn't queue a pair of status reports per step */
+    if (wiimote->extension_change_holdoff > 0) {
+        wiimote->extension_change_holdoff--;
+        return false;
+    }
+
     if (wiimote->new_extension == wiimote->cur_extension)
         return false;
 
@@ -592,21 +872,128 @@ static inline bool fake_wiimote_process_extension_change(fake_wiimote_t *wiimote
      * is disabled and the Data Reporting Mode must be reset before new data can arrive */
     wiimote->reporting_mode = INPUT_REPORT_ID_REPORT_DISABLED;
 
-    if (wiimote->cur_extension == WIIMOTE_EXT_NONE) {
-        /* Extension connect */
-        wiimote->cur_extension = wiimote->new_extension;
-    } else {
-        /* First we must detach the current extension.
-           The next call will change to the new extension if needed. */
+    /* Swap in a single tick: the game still needs to see the detach to probe the new
+     * extension, but both status reports are sent back to back */
+    if (wiimote->cur_extension != WIIMOTE_EXT_NONE) {
         wiimote->cur_extension = WIIMOTE_EXT_NONE;
+        fake_wiimote_reset_extension_state(wiimote);
+        wiimote_send_input_report_status(wiimote);
     }
 
-    fake_wiimote_reset_extension_state(wiimote);
+    if (wiimote->new_extension != WIIMOTE_EXT_NONE) {
+        wiimote->cur_extension = wiimote->new_extension;
+        fake_wiimote_reset_extension_state(wiimote);
+        wiimote_send_input_report_status(wiimote);
+    }
+
+    wiimote->extension_change_holdoff = EXTENSION_CHANGE_HOLDOFF_TICKS;
+
+    return true;
+}
+
+static inline bool fake_wiimote_process_motion_plus_port_event(fake_wiimote_t *wiimote)
+{
+    if (wiimote->motion_plus_port_event == MOTION_PLUS_PORT_IDLE)
+        return false;
+
+    /* Same as a regular extension change, data reporting has to be set up again */
+    wiimote->reporting_mode = INPUT_REPORT_ID_REPORT_DISABLED;
+
+    if (wiimote->motion_plus_port_event == MOTION_PLUS_PORT_DETACH)
+        wiimote->motion_plus_port_event = MOTION_PLUS_PORT_ATTACH;
+    else
+        wiimote->motion_plus_port_event = MOTION_PLUS_PORT_IDLE;
+
     wiimote_send_input_report_status(wiimote);
 
     return true;
 }
 
+/* Converts a gyro rate (+-2000 degrees/s over the s16 range) to a 14-bit MotionPlus value.
+ * Slow mode (+-270 degrees/s full scale) is used whenever the value fits in it. */
+#define MOTION_PLUS_SLOW_SCALE 64474 /* Q16, 2000 / 32768 * 0x1100 / 270 */
+#define MOTION_PLUS_FAST_SCALE 14507 /* Q16, 2000 / 32768 * 0x1100 / 1200 */
+
+static inline u16 motion_plus_gyro_value(s16 rate, bool *slow)
+{
+    s32 value = ((s32)rate * MOTION_PLUS_SLOW_SCALE) >> 16;
+
+    *slow = (value > -MOTION_PLUS_GYRO_ZERO) && (value < MOTION_PLUS_GYRO_ZERO);
+    if (!*slow)
+        value = ((s32)rate * MOTION_PLUS_FAST_SCALE) >> 16;
+
+    return MOTION_PLUS_GYRO_ZERO + value;
+}
+
+static void motion_plus_format_gyro(const fake_wiimote_t *wiimote,
+                                    u8 out[static MOTION_PLUS_DATA_BYTES])
+{
+    bool yaw_slow, roll_slow, pitch_slow;
+    u16 yaw = motion_plus_gyro_value(wiimote->gyro_yaw, &yaw_slow);
+    u16 roll = motion_plus_gyro_value(wiimote->gyro_roll, &roll_slow);
+    u16 pitch = motion_plus_gyro_value(wiimote->gyro_pitch, &pitch_slow);
+
+    out[0] = yaw & 0xFF;
+    out[1] = roll & 0xFF;
+    out[2] = pitch & 0xFF;
+    out[3] = ((yaw >> 8) << 2) | (yaw_slow << 1) | pitch_slow;
+    out[4] = ((roll >> 8) << 2) | (roll_slow << 1) | (wiimote->cur_extension != WIIMOTE_EXT_NONE);
+    /* Bit 1 tells MotionPlus data apart from passed-through extension data */
+    out[5] = ((pitch >> 8) << 2) | 0x02;
+}
+
+/* Passthrough modes drop some LSBs of the extension data to make room for the
+ * "extension connected" and "MotionPlus data" bits */
+static void motion_plus_format_nunchuk(const u8 in[static MOTION_PLUS_DATA_BYTES],
+                                       u8 out[static MOTION_PLUS_DATA_BYTES])
+{
+    out[0] = in[0];
+    out[1] = in[1];
+    out[2] = in[2];
+    out[3] = in[3];
+    /* Acceleration Z bits 9-3, extension connected */
+    out[4] = (in[4] & 0xFE) | 0x01;
+    /* Acceleration Z bits 2-1, Y bit 1, X bit 1, C, Z */
+    out[5] = ((in[4] & 0x01) << 7) | ((in[5] & 0x80) >> 1) | (in[5] & 0x20) |
+             ((in[5] & 0x08) << 1) | ((in[5] & 0x03) << 2);
+}
+
+static void motion_plus_format_classic(const u8 in[static MOTION_PLUS_DATA_BYTES],
+                                       u8 out[static MOTION_PLUS_DATA_BYTES])
+{
+    /* The left stick LSBs are replaced by D-pad up and left */
+    out[0] = (in[0] & 0xFE) | (in[5] & 0x01);
+    out[1] = (in[1] & 0xFE) | ((in[5] & 0x02) >> 1);
+    out[2] = in[2];
+    out[3] = in[3];
+    /* Extension connected */
+    out[4] = (in[4] & 0xFE) | 0x01;
+    out[5] = in[5] & 0xFC;
+}
+
+static void motion_plus_update_data(fake_wiimote_t *wiimote)
+{
+    const u8 *ext_data = wiimote->extension_regs.controller_data;
+    u8 *out = wiimote->motion_plus_regs.controller_data;
+    u8 mode = wiimote->motion_plus_regs.identifier[4];
+    bool passthrough = (mode == MOTION_PLUS_MODE_NUNCHUK &&
+                        wiimote->cur_extension == WIIMOTE_EXT_NUNCHUK) ||
+                       (mode == MOTION_PLUS_MODE_CLASSIC &&
+                        wiimote->cur_extension == WIIMOTE_EXT_CLASSIC);
+
+    /* With an extension passed through, its data is interleaved with the gyro data */
+    if (passthrough && wiimote->motion_plus_report_ext) {
+        if (mode == MOTION_PLUS_MODE_NUNCHUK)
+            motion_plus_format_nunchuk(ext_data, out);
+        else
+            motion_plus_format_classic(ext_data, out);
+    } else {
+        motion_plus_format_gyro(wiimote, out);
+    }
+
+    wiimote->motion_plus_report_ext = passthrough && !wiimote->motion_plus_report_ext;
+}
+
 static void fake_wiimote_send_data_report(fake_wiimote_t *wiimote)
 {
     u8 report_data[CONTROLLER_DATA_BYTES] ATTRIBUTE_ALIGN(4);
@@ -646,15 +1033,24 @@ static void fake_wiimote_send_data_report(fake_wiimote_t *wiimote)
             memcpy(&report_data[ir_offset], wiimote->ir_regs.camera_data, ir_size);
 
         if (ext_size) {
-            /* Takes care of encrypting the extension data if necessary */
-            extension_read_data(wiimote, report_data + ext_offset, 0, ext_size);
+            /* Both take care of encrypting the extension data if necessary */
+            if (wiimote->motion_plus_active) {
+                motion_plus_update_data(wiimote);
+                extension_read_data(wiimote, &wiimote->motion_plus_regs,
+                                    report_data + ext_offset, 0, ext_size);
+            } else {
+                extension_read_controller_data(wiimote, report_data + ext_offset, ext_size);
+            }
         }
 
         if (has_btn)
             memcpy(report_data, &buttons, sizeof(buttons));
 
-        send_hid_input_report(wiimote->hci_con_handle, wiimote->psm_hid_intr_chn.remote_cid,
-                              wiimote->reporting_mode, report_data, report_size);
+        if (send_hid_input_report(wiimote->hci_con_handle, wiimote->psm_hid_intr_chn.remote_cid,
+                                  wiimote->reporting_mode, report_data, report_size) >= 0)
+            fakemote_stats.reports_sent++;
+        else
+            fakemote_stats.reports_dropped++;
 
         wiimote->input_dirty = false;
     }
@@ -732,7 +1128,8 @@ void fake_wiimote_tick(fake_wiimote_t *wiimote)
                 return;
             }
 
-            if (fake_wiimote_process_extension_change(wiimote)) {
+            if (fake_wiimote_process_extension_change(wiimote) ||
+                fake_wiimote_process_motion_plus_port_event(wiimote)) {
                 /* Extension port event occurred. Don't send any other reports. */
                 return;
             }
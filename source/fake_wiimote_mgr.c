@@ -284,6 +284,8 @@ bool fake_wiimote_mgr_handle_hci_cmd_from_host(const hci_cmd_hdr_t *hdr)
                 fake_wiimotes[i].active = false;
             }
         }
+        /* The running title resets the BT stack when it starts */
+        input_devices_select_title_profile();
         break;
     case HCI_CMD_READ_STORED_LINK_KEY: {
         hci_read_stored_link_key_cp *cp = payload;
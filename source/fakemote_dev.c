@@ -0,0 +1,222 @@
+#include <string.h>
+
+#include "capture.h"
+#include "fakemote_dev.h"
+#include "input_device.h"
+#include "ipc.h"
+#include "mapping_profile.h"
+#include "profile.h"
+#include "syscalls.h"
+#include "types.h"
+#include "utils.h"
+
+/* How often a request waiting for the OH1 thread checks whether it's done */
+#define OH1_REQUEST_POLL_PERIOD 1000
+
+struct fakemote_stats_t fakemote_stats;
+
+/* The emulation state belongs to the OH1 thread, which runs in another process and hence can't
+ * be sent messages. Requests that touch it are left here, one at a time, for its next tick */
+enum oh1_request_e {
+    OH1_REQUEST_NONE,
+    OH1_REQUEST_RESET_STATS,
+    OH1_REQUEST_SET_SLOT_OPTIONS,
+    OH1_REQUEST_SET_MAPPING_PROFILE,
+    OH1_REQUEST_STAGE_CAPTURE,
+    OH1_REQUEST_GET_PROFILE,
+};
+
+static volatile u32 oh1_request;
+static volatile int oh1_request_result;
+static struct fakemote_slot_options_t oh1_request_slot_options;
+static u32 oh1_request_mapping_profile;
+/* A consistent copy, taken between two updates */
+static struct fakemote_profile_t oh1_request_profile;
+/* Set by the first tick: until then, nothing would run the requests */
+static volatile bool oh1_ticking;
+
+static void *fakemote_dev_queue_data[8];
+static int fakemote_dev_queue_id;
+static void *oh1_wait_queue_data[1];
+static int oh1_wait_queue_id;
+
+static inline int option_value(u8 value)
+{
+    return (value == FAKEMOTE_OPTION_KEEP) ? -1 : value;
+}
+
+void fakemote_dev_tick(void)
+{
+    const struct mapping_profile_t *profile;
+    int ret = IOS_OK;
+
+    oh1_ticking = true;
+
+    switch (oh1_request) {
+    case OH1_REQUEST_NONE:
+        return;
+    case OH1_REQUEST_RESET_STATS:
+        memset(&fakemote_stats, 0, sizeof(fakemote_stats));
+        profile_reset();
+        break;
+    case OH1_REQUEST_SET_SLOT_OPTIONS:
+        ret = input_devices_set_slot_options(oh1_request_slot_options.slot,
+                                             option_value(oh1_request_slot_options.ir_mode),
+                                             option_value(oh1_request_slot_options.extension),
+                                             option_value(oh1_request_slot_options.motion_route));
+        break;
+    case OH1_REQUEST_SET_MAPPING_PROFILE:
+        if (oh1_request_mapping_profile == FAKEMOTE_MAPPING_PROFILE_TITLE) {
+            input_devices_select_title_profile();
+        } else {
+            profile = mapping_profile_get(oh1_request_mapping_profile);
+            input_devices_switch_mapping_profile(profile);
+        }
+        break;
+    case OH1_REQUEST_STAGE_CAPTURE:
+        /* Only the copy: the NAND writes would hold up the reports */
+        ret = capture_stage();
+        break;
+    case OH1_REQUEST_GET_PROFILE:
+        ret = profile_get(&oh1_request_profile);
+        break;
+    default:
+        ret = IOS_EINVAL;
+        break;
+    }
+
+    oh1_request_result = ret;
+    oh1_request = OH1_REQUEST_NONE;
+}
+
+static int run_oh1_request(enum oh1_request_e request)
+{
+    void *msg;
+    int timer_id;
+
+    if (!oh1_ticking)
+        return IOS_ENOENT;
+
+    timer_id = os_create_timer(OH1_REQUEST_POLL_PERIOD, OH1_REQUEST_POLL_PERIOD,
+                               oh1_wait_queue_id, 0);
+    if (timer_id < 0)
+        return timer_id;
+
+    oh1_request = request;
+    while (oh1_request != OH1_REQUEST_NONE)
+        os_message_queue_receive(oh1_wait_queue_id, &msg, 0);
+
+    os_destroy_timer(timer_id);
+    return oh1_request_result;
+}
+
+static int handle_ioctl(u32 cmd, void *in, u32 in_len, void *io, u32 io_len)
+{
+    int ret = IOS_OK;
+
+    switch (cmd) {
+    case FAKEMOTE_IOCTL_GET_VERSION:
+        if (io_len < sizeof(u32))
+            return IOS_EINVAL;
+        *(u32 *)io = FAKEMOTE_DEV_VERSION;
+        os_sync_after_write(io, sizeof(u32));
+        break;
+    case FAKEMOTE_IOCTL_GET_STATS:
+        if (io_len < sizeof(fakemote_stats))
+            return IOS_EINVAL;
+        /* Each counter is read whole, no need to stop the OH1 thread */
+        memcpy(io, &fakemote_stats, sizeof(fakemote_stats));
+        os_sync_after_write(io, sizeof(fakemote_stats));
+        break;
+    case FAKEMOTE_IOCTL_RESET_STATS:
+        ret = run_oh1_request(OH1_REQUEST_RESET_STATS);
+        break;
+    case FAKEMOTE_IOCTL_SET_SLOT_OPTIONS:
+        if (in_len < sizeof(oh1_request_slot_options))
+            return IOS_EINVAL;
+        os_sync_before_read(in, sizeof(oh1_request_slot_options));
+        memcpy(&oh1_request_slot_options, in, sizeof(oh1_request_slot_options));
+        ret = run_oh1_request(OH1_REQUEST_SET_SLOT_OPTIONS);
+        break;
+    case FAKEMOTE_IOCTL_SET_MAPPING_PROFILE:
+        if (in_len < sizeof(u32))
+            return IOS_EINVAL;
+        os_sync_before_read(in, sizeof(u32));
+        oh1_request_mapping_profile = *(u32 *)in;
+        /* mapping_profile_get() would silently fall back to the built-in one */
+        if ((oh1_request_mapping_profile != FAKEMOTE_MAPPING_PROFILE_TITLE) &&
+            (oh1_request_mapping_profile >= mapping_profiles_count()))
+            return IOS_EINVAL;
+        ret = run_oh1_request(OH1_REQUEST_SET_MAPPING_PROFILE);
+        break;
+    case FAKEMOTE_IOCTL_FLUSH_CAPTURE:
+        ret = run_oh1_request(OH1_REQUEST_STAGE_CAPTURE);
+        if (ret < 0)
+            break;
+        ret = capture_write_staged(CAPTURE_PATH);
+        break;
+    case FAKEMOTE_IOCTL_GET_PROFILE:
+        if (io_len < sizeof(oh1_request_profile))
+            return IOS_EINVAL;
+        ret = run_oh1_request(OH1_REQUEST_GET_PROFILE);
+        if (ret < 0)
+            break;
+        memcpy(io, &oh1_request_profile, sizeof(oh1_request_profile));
+        os_sync_after_write(io, sizeof(oh1_request_profile));
+        break;
+    default:
+        ret = IOS_EINVAL;
+        break;
+    }
+
+    return ret;
+}
+
+int fakemote_dev_run(void)
+{
+    ipcmessage *msg;
+    int ret;
+
+    ret = os_message_queue_create(oh1_wait_queue_data, ARRAY_SIZE(oh1_wait_queue_data));
+    if (ret < 0)
+        return ret;
+    oh1_wait_queue_id = ret;
+
+    ret = os_message_queue_create(fakemote_dev_queue_data, ARRAY_SIZE(fakemote_dev_queue_data));
+    if (ret < 0)
+        return ret;
+    fakemote_dev_queue_id = ret;
+
+    ret = os_device_register(FAKEMOTE_DEV_PATH, fakemote_dev_queue_id);
+    if (ret < 0)
+        return ret;
+
+    while (1) {
+        ret = os_message_queue_receive(fakemote_dev_queue_id, &msg, 0);
+        if (ret != IOS_OK)
+            continue;
+
+        switch (msg->command) {
+        case IOS_OPEN:
+            if (!strcmp(msg->open.device, FAKEMOTE_DEV_PATH))
+                ret = msg->open.resultfd;
+            else
+                ret = IOS_ENOENT;
+            break;
+        case IOS_CLOSE:
+            ret = IOS_OK;
+            break;
+        case IOS_IOCTL:
+            ret = handle_ioctl(msg->ioctl.command, msg->ioctl.buffer_in, msg->ioctl.length_in,
+                               msg->ioctl.buffer_io, msg->ioctl.length_io);
+            break;
+        default:
+            ret = IOS_EINVAL;
+            break;
+        }
+
+        os_message_queue_ack(msg, ret);
+    }
+
+    return IOS_OK;
+}
@@ -1,7 +1,10 @@
 #include "input_device.h"
 #include "button_map.h"
+#include "capture.h"
 #include "egc.h"
 #include "fake_wiimote.h"
+#include "mapping_profile.h"
+#include "syscalls.h"
 #include "types.h"
 #include "utils.h"
 #include "wiimote.h"
@@ -9,68 +12,64 @@
 #define MAX_INPUT_DEVS  2
 #define RECONNECT_DELAY 200 /* 1s @ 200Hz */
 
-static const struct {
-    u16 wiimote_button_map[EGC_GAMEPAD_BUTTON_COUNT];
-    u8 nunchuk_button_map[EGC_GAMEPAD_BUTTON_COUNT];
-    u8 nunchuk_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
-    u16 classic_button_map[EGC_GAMEPAD_BUTTON_COUNT];
-    u8 classic_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT];
-} input_mappings = {
-	.wiimote_button_map = {
-		[EGC_GAMEPAD_BUTTON_NORTH] = WIIMOTE_BUTTON_ONE,
-		[EGC_GAMEPAD_BUTTON_EAST] = WIIMOTE_BUTTON_B,
-		[EGC_GAMEPAD_BUTTON_SOUTH] = WIIMOTE_BUTTON_A,
-		[EGC_GAMEPAD_BUTTON_WEST] = WIIMOTE_BUTTON_TWO,
-		[EGC_GAMEPAD_BUTTON_DPAD_UP] = WIIMOTE_BUTTON_UP,
-		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = WIIMOTE_BUTTON_DOWN,
-		[EGC_GAMEPAD_BUTTON_DPAD_LEFT] = WIIMOTE_BUTTON_LEFT,
-		[EGC_GAMEPAD_BUTTON_DPAD_RIGHT] = WIIMOTE_BUTTON_RIGHT,
-		[EGC_GAMEPAD_BUTTON_START] = WIIMOTE_BUTTON_PLUS,
-		[EGC_GAMEPAD_BUTTON_BACK] = WIIMOTE_BUTTON_MINUS,
-		[EGC_GAMEPAD_BUTTON_LEFT_STICK] = WIIMOTE_BUTTON_HOME,
-	},
-	.nunchuk_button_map = {
-		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = NUNCHUK_BUTTON_C,
-		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = NUNCHUK_BUTTON_Z,
-	},
-	.nunchuk_analog_axis_map = {
-		[EGC_GAMEPAD_AXIS_LEFTX] = BM_NUNCHUK_ANALOG_AXIS_X,
-		[EGC_GAMEPAD_AXIS_LEFTY] = BM_NUNCHUK_ANALOG_AXIS_Y,
-	},
-	.classic_button_map = {
-		[EGC_GAMEPAD_BUTTON_NORTH] = CLASSIC_CTRL_BUTTON_X,
-		[EGC_GAMEPAD_BUTTON_EAST] = CLASSIC_CTRL_BUTTON_A,
-		[EGC_GAMEPAD_BUTTON_SOUTH] = CLASSIC_CTRL_BUTTON_B,
-		[EGC_GAMEPAD_BUTTON_WEST] = CLASSIC_CTRL_BUTTON_Y,
-		[EGC_GAMEPAD_BUTTON_DPAD_UP] = CLASSIC_CTRL_BUTTON_UP,
-		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = CLASSIC_CTRL_BUTTON_DOWN,
-		[EGC_GAMEPAD_BUTTON_DPAD_LEFT] = CLASSIC_CTRL_BUTTON_LEFT,
-		[EGC_GAMEPAD_BUTTON_DPAD_RIGHT] = CLASSIC_CTRL_BUTTON_RIGHT,
-		[EGC_GAMEPAD_BUTTON_START] = CLASSIC_CTRL_BUTTON_PLUS,
-		[EGC_GAMEPAD_BUTTON_BACK] = CLASSIC_CTRL_BUTTON_MINUS,
-		[EGC_GAMEPAD_BUTTON_RIGHT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZR,
-		[EGC_GAMEPAD_BUTTON_LEFT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZL,
-		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_R,
-		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_L,
-		[EGC_GAMEPAD_BUTTON_LEFT_STICK] = CLASSIC_CTRL_BUTTON_HOME,
-	},
-	.classic_analog_axis_map = {
-		[EGC_GAMEPAD_AXIS_LEFTX] = BM_CLASSIC_ANALOG_AXIS_LEFT_X,
-		[EGC_GAMEPAD_AXIS_LEFTY] = BM_CLASSIC_ANALOG_AXIS_LEFT_Y,
-		[EGC_GAMEPAD_AXIS_RIGHTX] = BM_CLASSIC_ANALOG_AXIS_RIGHT_X,
-		[EGC_GAMEPAD_AXIS_RIGHTY] = BM_CLASSIC_ANALOG_AXIS_RIGHT_Y,
-	},
+/* Game ID (e.g. "RSBE") of the running title in MEM1, set by the apploader/ES. The host build
+ * points it to its mocked MEM1 */
+#ifndef TITLE_GAME_ID_ADDR
+#define TITLE_GAME_ID_ADDR 0x00003180
+#endif
+
+/* Active mapping profile and its button lookup tables, shared by all the input devices */
+static const struct mapping_profile_t *input_mapping = &mapping_profile_default;
+static struct {
+    struct bm_button_lut16_t wiimote;
+    struct bm_button_lut8_t nunchuk;
+    struct bm_button_lut16_t classic;
+    struct bm_button_lut32_t wiiu_pro;
+    struct bm_button_lut16_t guitar;
+    struct bm_stick_lut_t sticks[BM_STICK__NUM];
+} input_luts;
+
+/* Rows are Wiimote axes (X left, Y towards the screen, Z up), columns controller axes */
+#define Q12(x) ((s16)((x) * 4096))
+
+static const struct bm_accel_calibration_t accel_calibrations[] = {
+    /* DualShock 3: 10-bit, X right, Y towards the player, Z up */
+    {
+        .vid = 0x054c,
+        .pid = 0x0268,
+        .matrix = { { Q12(-1), 0, 0 }, { 0, Q12(-1), 0 }, { 0, 0, Q12(1) } },
+        .bias = { 512, 512, 512 },
+        .one_g = 113,
+    },
+    /* DualShock 4 (both revisions): X right, Y up, Z towards the player */
+    {
+        .vid = 0x054c,
+        .pid = 0x05c4,
+        .matrix = { { Q12(-1), 0, 0 }, { 0, 0, Q12(-1) }, { 0, Q12(1), 0 } },
+        .bias = { 0, 0, 0 },
+        .one_g = 8192,
+    },
+    {
+        .vid = 0x054c,
+        .pid = 0x09cc,
+        .matrix = { { Q12(-1), 0, 0 }, { 0, 0, Q12(-1) }, { 0, Q12(1), 0 } },
+        .bias = { 0, 0, 0 },
+        .one_g = 8192,
+    },
 };
 
-static const u8 ir_analog_axis_map[EGC_GAMEPAD_AXIS_COUNT] = {
-    [EGC_GAMEPAD_AXIS_RIGHTX] = BM_IR_AXIS_X,
-    [EGC_GAMEPAD_AXIS_RIGHTY] = BM_IR_AXIS_Y,
+/* Same axes as the DualShock 4 */
+static const struct bm_accel_calibration_t default_accel_calibration = {
+    .matrix = { { Q12(-1), 0, 0 }, { 0, 0, Q12(-1) }, { 0, Q12(1), 0 } },
+    .bias = { 0, 0, 0 },
+    .one_g = BM_EGC_ACCEL_ONE_G,
 };
 
 static const enum bm_ir_emulation_mode_e ir_emu_modes[] = {
     BM_IR_EMULATION_MODE_DIRECT,
     BM_IR_EMULATION_MODE_RELATIVE_ANALOG_AXIS,
     BM_IR_EMULATION_MODE_ABSOLUTE_ANALOG_AXIS,
+    BM_IR_EMULATION_MODE_GYRO,
 };
 
 static struct input_device_t {
@@ -80,17 +79,39 @@ static struct input_device_t {
     u32 reconnect_delay;
     u32 switch_mapping_combo;
     u32 switch_ir_emu_mode_combo;
+    u32 ir_recenter_combo;
     enum bm_ir_emulation_mode_e ir_emu_mode;
     struct bm_ir_emulation_state_t ir_emu_state;
+    struct bm_ir_sensor_bar_t ir_sensor_bar;
+    const struct bm_accel_calibration_t *accel_calibration;
+    struct bm_motion_transform_t motion_transform;
     bool switch_mapping;
     bool switch_ir_emu_mode;
+    bool ir_recenter;
     u8 extension;
+    /* Position in the profile's extension rotation */
+    u8 extension_idx;
     u8 ir_emu_mode_idx;
+    u8 ir_gyro_sensitivity;
+    u8 motion_route;
 } input_devices[MAX_INPUT_DEVS];
 
-static inline bool has_button(egc_input_device_t *device, egc_gamepad_button_e button)
+static bool ir_emu_mode_is_supported(egc_input_device_t *device, enum bm_ir_emulation_mode_e mode)
 {
-    return device->desc->available_buttons & BIT(button);
+    if (mode == BM_IR_EMULATION_MODE_DIRECT)
+        return device->desc->num_touch_points > 0;
+    else if (mode == BM_IR_EMULATION_MODE_GYRO)
+        return device->desc->num_gyroscopes > 0;
+    return true;
+}
+
+static const struct bm_accel_calibration_t *find_accel_calibration(egc_input_device_t *device)
+{
+    for (int i = 0; i < ARRAY_SIZE(accel_calibrations); i++) {
+        if (accel_calibrations[i].vid == device->vid && accel_calibrations[i].pid == device->pid)
+            return &accel_calibrations[i];
+    }
+    return &default_accel_calibration;
 }
 
 static input_device_t *input_device_from_egc(egc_input_device_t *device)
@@ -101,8 +122,137 @@ static input_device_t *input_device_from_egc(egc_input_device_t *device)
     return NULL;
 }
 
+static inline u32 available_combo(egc_input_device_t *device, u32 combo)
+{
+    /* A combo the device can't press would leave the binding unreachable */
+    if ((device->desc->available_buttons & combo) != combo)
+        return 0;
+    return combo;
+}
+
+void input_devices_set_mapping_profile(const struct mapping_profile_t *profile)
+{
+    input_mapping = profile;
+    bm_button_lut16_build(&input_luts.wiimote, EGC_GAMEPAD_BUTTON_COUNT,
+                          profile->wiimote_button_map);
+    bm_button_lut8_build(&input_luts.nunchuk, EGC_GAMEPAD_BUTTON_COUNT,
+                         profile->nunchuk_button_map);
+    bm_button_lut16_build(&input_luts.classic, EGC_GAMEPAD_BUTTON_COUNT,
+                          profile->classic_button_map);
+    bm_button_lut32_build(&input_luts.wiiu_pro, EGC_GAMEPAD_BUTTON_COUNT,
+                          profile->wiiu_pro_button_map);
+    bm_button_lut16_build(&input_luts.guitar, EGC_GAMEPAD_BUTTON_COUNT,
+                          profile->guitar_button_map);
+    for (int i = 0; i < BM_STICK__NUM; i++)
+        bm_stick_lut_build(&input_luts.sticks[i], &profile->stick_configs[i]);
+}
+
+/* Per-device state derived from the active mapping profile */
+static void input_device_apply_mapping(input_device_t *input_device)
+{
+    egc_input_device_t *device = input_device->device;
+
+    input_device->extension = input_mapping->default_extension;
+    /* If the default isn't part of the rotation the first switch goes to its start */
+    input_device->extension_idx = input_mapping->num_extension_rotation - 1;
+    for (int i = 0; i < input_mapping->num_extension_rotation; i++) {
+        if (input_mapping->extension_rotation[i] == input_device->extension) {
+            input_device->extension_idx = i;
+            break;
+        }
+    }
+    input_device->switch_mapping_combo =
+        available_combo(device, input_mapping->switch_extension_combo);
+    input_device->switch_ir_emu_mode_combo =
+        available_combo(device, input_mapping->switch_ir_emu_mode_combo);
+    input_device->ir_recenter_combo = available_combo(device, input_mapping->ir_recenter_combo);
+    if (input_device->assigned_wiimote)
+        fake_wiimote_set_extension(input_device->assigned_wiimote, input_device->extension);
+    bm_ir_sensor_bar_set_distance(&input_device->ir_sensor_bar, input_mapping->ir_distance);
+    input_device->ir_gyro_sensitivity = input_mapping->ir_gyro_sensitivity;
+    input_device->motion_route = input_mapping->motion_route;
+    /* Recomposed here so that the input path stays branch free */
+    bm_motion_transform_init(&input_device->motion_transform, input_device->accel_calibration,
+                             input_mapping->motion_orientation, input_device->motion_route);
+}
+
+void input_devices_switch_mapping_profile(const struct mapping_profile_t *profile)
+{
+    if (profile == input_mapping)
+        return;
+
+    input_devices_set_mapping_profile(profile);
+    for (int i = 0; i < ARRAY_SIZE(input_devices); i++) {
+        if (input_devices[i].device)
+            input_device_apply_mapping(&input_devices[i]);
+    }
+}
+
+void input_devices_select_title_profile(void)
+{
+    const struct mapping_profile_t *profile;
+    u32 game_id;
+
+    os_sync_before_read((void *)TITLE_GAME_ID_ADDR, sizeof(game_id));
+    game_id = *(volatile u32 *)TITLE_GAME_ID_ADDR;
+
+    profile = mapping_profile_find_title(game_id);
+    if (!profile)
+        profile = mapping_profile_get(0);
+    LOG_DEBUG("Title %08x: mapping profile %p\n", game_id, profile);
+
+    input_devices_switch_mapping_profile(profile);
+}
+
+int input_devices_set_slot_options(u32 slot, int ir_emu_mode, int extension, int motion_route)
+{
+    input_device_t *input_device;
+    int ir_emu_mode_idx = -1;
+
+    if (slot >= ARRAY_SIZE(input_devices) || !input_devices[slot].device)
+        return IOS_ENOENT;
+    input_device = &input_devices[slot];
+
+    if (ir_emu_mode >= 0) {
+        for (int i = 0; i < ARRAY_SIZE(ir_emu_modes); i++) {
+            if (ir_emu_modes[i] == ir_emu_mode)
+                ir_emu_mode_idx = i;
+        }
+        if ((ir_emu_mode_idx < 0) || !ir_emu_mode_is_supported(input_device->device, ir_emu_mode))
+            return IOS_EINVAL;
+    }
+    if ((extension >= 0) && !extension_is_valid(extension))
+        return IOS_EINVAL;
+    if (motion_route > BM_MOTION_ROUTE_SPLIT)
+        return IOS_EINVAL;
+
+    if (ir_emu_mode_idx >= 0) {
+        input_device->ir_emu_mode_idx = ir_emu_mode_idx;
+        bm_ir_emulation_state_reset(&input_device->ir_emu_state);
+    }
+    if (extension >= 0) {
+        input_device->extension = extension;
+        /* The switch combo carries on from there if it is part of the rotation */
+        for (int i = 0; i < input_mapping->num_extension_rotation; i++) {
+            if (input_mapping->extension_rotation[i] == extension)
+                input_device->extension_idx = i;
+        }
+        if (input_device->assigned_wiimote)
+            fake_wiimote_set_extension(input_device->assigned_wiimote, extension);
+    }
+    if (motion_route >= 0) {
+        input_device->motion_route = motion_route;
+        bm_motion_transform_init(&input_device->motion_transform, input_device->accel_calibration,
+                                 input_mapping->motion_orientation, motion_route);
+    }
+
+    return IOS_OK;
+}
+
 void input_devices_init(void)
 {
+    input_devices_set_mapping_profile(input_mapping);
+
     for (int i = 0; i < ARRAY_SIZE(input_devices); i++)
         input_devices[i].device = NULL;
 }
@@ -116,26 +266,15 @@ void input_device_handle_added(egc_input_device_t *device, void *userdata)
             /* No assigned fake Wiimote yet */
             input_devices[i].assigned_wiimote = NULL;
             input_devices[i].reconnect_delay = 0;
-            input_devices[i].extension = WIIMOTE_EXT_NUNCHUK;
-            input_devices[i].ir_emu_mode_idx = BM_IR_EMULATION_MODE_DIRECT;
-
-            if (has_button(device, EGC_GAMEPAD_BUTTON_LEFT_STICK) &&
-                has_button(device, EGC_GAMEPAD_BUTTON_LEFT_SHOULDER)) {
-                input_devices[i].switch_mapping_combo =
-                    BIT(EGC_GAMEPAD_BUTTON_LEFT_STICK) | BIT(EGC_GAMEPAD_BUTTON_LEFT_SHOULDER);
-            } else {
-                /* TODO; figure out another combination */
-                input_devices[i].switch_mapping_combo = 0;
-            }
-
-            if (has_button(device, EGC_GAMEPAD_BUTTON_RIGHT_STICK) &&
-                has_button(device, EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER)) {
-                input_devices[i].switch_ir_emu_mode_combo =
-                    BIT(EGC_GAMEPAD_BUTTON_RIGHT_STICK) | BIT(EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER);
-            } else {
-                /* TODO; figure out another combination */
-                input_devices[i].switch_ir_emu_mode_combo = 0;
-            }
+            /* The first mode the device supports, RELATIVE_ANALOG_AXIS always is */
+            input_devices[i].ir_emu_mode_idx = 0;
+            while (!ir_emu_mode_is_supported(device,
+                                             ir_emu_modes[input_devices[i].ir_emu_mode_idx]))
+                input_devices[i].ir_emu_mode_idx++;
+            bm_ir_emulation_state_reset(&input_devices[i].ir_emu_state);
+            input_devices[i].accel_calibration = find_accel_calibration(device);
+            input_device_apply_mapping(&input_devices[i]);
+            capture_record_input(CAPTURE_INPUT_ADDED, i, NULL);
             break;
         }
     }
@@ -156,11 +295,15 @@ void input_device_handle_removed(egc_input_device_t *device, void *userdata)
         fake_wiimote_disconnect(wiimote);
     }
     input_device->device = NULL;
+    capture_record_input(CAPTURE_INPUT_REMOVED, input_device - input_devices, NULL);
 }
 
 void input_devices_tick(void)
 {
     for (int i = 0; i < ARRAY_SIZE(input_devices); i++) {
+        /* The states egc_handle_events() left for this tick */
+        if (input_devices[i].device)
+            capture_record_input(CAPTURE_INPUT_STATE, i, &input_devices[i].device->state.gamepad);
         if (input_devices[i].device && !input_devices[i].assigned_wiimote) {
             if (input_devices[i].reconnect_delay > 0)
                 input_devices[i].reconnect_delay--;
@@ -213,75 +356,145 @@ int input_device_set_rumble(input_device_t *input_device, bool rumble_on)
                                        rumble_on ? EGC_RUMBLE_MAX : EGC_RUMBLE_OFF);
 }
 
+bool input_device_has_gyroscope(input_device_t *input_device)
+{
+    return input_device->device->desc->num_gyroscopes > 0;
+}
+
+enum wiimote_ext_e input_device_get_extension(input_device_t *input_device)
+{
+    return input_device->extension;
+}
+
 bool input_device_report_input(input_device_t *input_device)
 {
     const egc_input_state_t *input = &input_device->device->state;
     fake_wiimote_t *wiimote = input_device->assigned_wiimote;
     u16 wiimote_buttons = 0;
     union wiimote_extension_data_t extension_data;
+    u8 extension_size;
     struct ir_dot_t ir_dots[IR_MAX_DOTS];
+    struct ir_dot_t ir_pointer;
     enum bm_ir_emulation_mode_e ir_emu_mode;
+    enum wiimote_ext_e extension;
+    bool ir_pointer_visible = true;
+    u16 acc[BM_MOTION_TARGET__NUM][3];
 
     if (bm_check_switch_mapping(input->gamepad.buttons, &input_device->switch_mapping,
                                 input_device->switch_mapping_combo)) {
-        input_device->extension = input_device->extension == WIIMOTE_EXT_NUNCHUK
-                                      ? WIIMOTE_EXT_CLASSIC
-                                      : WIIMOTE_EXT_NUNCHUK;
+        if (input_mapping->num_extension_rotation == 0)
+            return false;
+        input_device->extension_idx =
+            (input_device->extension_idx + 1) % input_mapping->num_extension_rotation;
+        input_device->extension = input_mapping->extension_rotation[input_device->extension_idx];
         fake_wiimote_set_extension(wiimote, input_device->extension);
         return false;
     } else if (bm_check_switch_mapping(input->gamepad.buttons, &input_device->switch_ir_emu_mode,
                                        input_device->switch_ir_emu_mode_combo)) {
-        input_device->ir_emu_mode_idx =
-            (input_device->ir_emu_mode_idx + 1) % ARRAY_SIZE(ir_emu_modes);
-        /* Direct mode is only supported if we have a touchpad */
-        if (input_device->ir_emu_mode_idx == BM_IR_EMULATION_MODE_DIRECT &&
-            input_device->device->desc->num_touch_points == 0) {
+        /* Skip the modes that need a touchpad or a gyroscope if the device lacks them */
+        do {
             input_device->ir_emu_mode_idx =
                 (input_device->ir_emu_mode_idx + 1) % ARRAY_SIZE(ir_emu_modes);
-        }
+        } while (!ir_emu_mode_is_supported(input_device->device,
+                                           ir_emu_modes[input_device->ir_emu_mode_idx]));
+        bm_ir_emulation_state_reset(&input_device->ir_emu_state);
+    } else if (ir_emu_modes[input_device->ir_emu_mode_idx] == BM_IR_EMULATION_MODE_GYRO &&
+               bm_check_switch_mapping(input->gamepad.buttons, &input_device->ir_recenter,
+                                       input_device->ir_recenter_combo)) {
+        /* Only the gyro pointer drifts, the other modes have nothing to recenter */
         bm_ir_emulation_state_reset(&input_device->ir_emu_state);
     }
 
-    if (input_device->extension == WIIMOTE_EXT_NUNCHUK) {
-        bm_map_wiimote(EGC_GAMEPAD_BUTTON_COUNT, input->gamepad.buttons,
-                       input_mappings.wiimote_button_map, &wiimote_buttons);
+    /* Until the Wiimote is done swapping, the game still reads the previous extension's format */
+    extension = fake_wiimote_get_extension(wiimote);
+
+    if (extension == WIIMOTE_EXT_NONE || extension == WIIMOTE_EXT_NUNCHUK) {
+        bm_map_wiimote(input->gamepad.buttons, &input_luts.wiimote, &wiimote_buttons);
     }
 
     if (input_device->device->desc->num_accelerometers > 0) {
-        fake_wiimote_report_accelerometer(wiimote, input->gamepad.accelerometer[0].x,
-                                          input->gamepad.accelerometer[0].y,
-                                          input->gamepad.accelerometer[0].z);
+        const s16 accel[3] = { input->gamepad.accelerometer[0].x,
+                               input->gamepad.accelerometer[0].y,
+                               input->gamepad.accelerometer[0].z };
+        const u16 *wiimote_acc = acc[BM_MOTION_TARGET_WIIMOTE];
+
+        bm_map_motion(&input_device->motion_transform, accel, acc);
+        fake_wiimote_report_accelerometer(wiimote, wiimote_acc[0], wiimote_acc[1],
+                                          wiimote_acc[2]);
+    } else {
+        bm_motion_set_rest(acc);
+    }
+
+    if (input_device->device->desc->num_gyroscopes > 0) {
+        /* egc roll (Z) points towards the player, the Wiimote's points towards the screen */
+        fake_wiimote_report_motion_plus(wiimote, input->gamepad.gyroscope[0].y,
+                                        -input->gamepad.gyroscope[0].z,
+                                        input->gamepad.gyroscope[0].x);
     }
 
     ir_emu_mode = ir_emu_modes[input_device->ir_emu_mode_idx];
     if (ir_emu_mode == BM_IR_EMULATION_MODE_NONE) {
-        bm_ir_dots_set_out_of_screen(ir_dots);
+        ir_pointer_visible = false;
+    } else if (ir_emu_mode == BM_IR_EMULATION_MODE_DIRECT) {
+        ir_pointer_visible = bm_map_ir_direct(input->gamepad.touch_points[0].x,
+                                              input->gamepad.touch_points[0].y, &ir_pointer);
+    } else if (ir_emu_mode == BM_IR_EMULATION_MODE_GYRO) {
+        /* egc gyro axes: X is pitch, Y is yaw, Z is roll */
+        bm_map_ir_gyro(&input_device->ir_emu_state, input_device->ir_gyro_sensitivity,
+                       input->gamepad.gyroscope[0].x, input->gamepad.gyroscope[0].y, &ir_pointer);
     } else {
-        if (ir_emu_mode == BM_IR_EMULATION_MODE_DIRECT) {
-            bm_map_ir_direct(input->gamepad.touch_points[0].x, input->gamepad.touch_points[0].y,
-                             ir_dots);
-        } else {
-            bm_map_ir_analog_axis(ir_emu_mode, &input_device->ir_emu_state, EGC_GAMEPAD_AXIS_COUNT,
-                                  input->gamepad.axes, ir_analog_axis_map, ir_dots);
-        }
+        bm_map_ir_analog_axis(ir_emu_mode, &input_device->ir_emu_state, EGC_GAMEPAD_AXIS_COUNT,
+                              input->gamepad.axes, input_mapping->ir_analog_axis_map,
+                              &ir_pointer);
+    }
+
+    if (ir_pointer_visible) {
+        /* Roll is taken from the same accelerometer data reported to the game */
+        bm_ir_synthesize_dots(&ir_pointer, &input_device->ir_sensor_bar,
+                              acc[BM_MOTION_TARGET_WIIMOTE][0], acc[BM_MOTION_TARGET_WIIMOTE][2],
+                              ir_dots);
+    } else {
+        bm_ir_dots_set_out_of_screen(ir_dots);
     }
 
     fake_wiimote_report_ir_dots(wiimote, ir_dots);
 
-    if (input_device->extension == WIIMOTE_EXT_NONE) {
+    if (extension == WIIMOTE_EXT_NONE) {
         fake_wiimote_report_input(wiimote, wiimote_buttons);
-    } else if (input_device->extension == WIIMOTE_EXT_NUNCHUK) {
-        bm_map_nunchuk(EGC_GAMEPAD_BUTTON_COUNT, input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT,
-                       input->gamepad.axes, 0, 0, 0, input_mappings.nunchuk_button_map,
-                       input_mappings.nunchuk_analog_axis_map, &extension_data.nunchuk);
+    } else if (extension == WIIMOTE_EXT_NUNCHUK) {
+        bm_map_nunchuk(input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT, input->gamepad.axes,
+                       acc[BM_MOTION_TARGET_NUNCHUK][0], acc[BM_MOTION_TARGET_NUNCHUK][1],
+                       acc[BM_MOTION_TARGET_NUNCHUK][2], &input_luts.nunchuk,
+                       input_mapping->nunchuk_analog_axis_map,
+                       &input_luts.sticks[BM_STICK_NUNCHUK], &extension_data.nunchuk);
         fake_wiimote_report_input_ext(wiimote, wiimote_buttons, &extension_data,
                                       sizeof(extension_data.nunchuk));
-    } else if (input_device->extension == WIIMOTE_EXT_CLASSIC) {
-        bm_map_classic(EGC_GAMEPAD_BUTTON_COUNT, input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT,
-                       input->gamepad.axes, input_mappings.classic_button_map,
-                       input_mappings.classic_analog_axis_map, &extension_data.classic);
+    } else if (extension == WIIMOTE_EXT_CLASSIC) {
+        bm_map_classic(input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT, input->gamepad.axes,
+                       &input_luts.classic, input_mapping->classic_analog_axis_map,
+                       &input_luts.sticks[BM_STICK_CLASSIC_LEFT],
+                       &input_luts.sticks[BM_STICK_CLASSIC_RIGHT],
+                       fake_wiimote_get_classic_data_format(wiimote), &extension_data,
+                       &extension_size);
+        fake_wiimote_report_input_ext(wiimote, wiimote_buttons, &extension_data, extension_size);
+    } else if (extension == WIIMOTE_EXT_CLASSIC_WIIU_PRO) {
+        bm_map_wiiu_pro(input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT, input->gamepad.axes,
+                        &input_luts.wiiu_pro, input_mapping->classic_analog_axis_map,
+                        &input_luts.sticks[BM_STICK_CLASSIC_LEFT],
+                        &input_luts.sticks[BM_STICK_CLASSIC_RIGHT], &extension_data.wiiu_pro);
+        fake_wiimote_report_input_ext(wiimote, wiimote_buttons, &extension_data,
+                                      sizeof(extension_data.wiiu_pro));
+    } else if (extension == WIIMOTE_EXT_GUITAR) {
+        bool tilt;
+
+        bm_map_guitar(input->gamepad.buttons, EGC_GAMEPAD_AXIS_COUNT, input->gamepad.axes,
+                      &input_luts.guitar, input_mapping->guitar_analog_axis_map,
+                      &extension_data.guitar, &tilt);
+        /* Star power: the neck pointing up, overriding the accelerometer */
+        if (tilt)
+            fake_wiimote_report_accelerometer(wiimote, ACCEL_ZERO_G, ACCEL_ONE_G, ACCEL_ZERO_G);
         fake_wiimote_report_input_ext(wiimote, wiimote_buttons, &extension_data,
-                                      sizeof(extension_data.classic));
+                                      sizeof(extension_data.guitar));
     }
     return true;
 }
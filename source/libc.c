@@ -1,8 +1,58 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+/* Word accesses to buffers of any type */
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+#define WORD_SIZE sizeof(word_t)
+#define WORD_MASK (WORD_SIZE - 1)
+
+/* Below this, aligning the pointers costs more than the word loop saves */
+#define WORD_THRESHOLD 8
+
+static inline bool is_word_aligned(const void *p)
+{
+    return ((uintptr_t)p & WORD_MASK) == 0;
+}
+
+/* Bytes [shift / 8, shift / 8 + 4) of the 8 bytes in memory order prev, next */
+static inline word_t merge_words(word_t prev, word_t next, unsigned int shift)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (prev << shift) | (next >> (32 - shift));
+#else
+    return (prev >> shift) | (next << (32 - shift));
+#endif
+}
+
 void *memset(void *s, int c, size_t n)
 {
-    char *p = s;
+    unsigned char *p = s;
+
+    if (n >= WORD_THRESHOLD) {
+        word_t w = (unsigned char)c * 0x01010101u;
+        word_t *wp;
+
+        while (!is_word_aligned(p)) {
+            *p++ = c;
+            n--;
+        }
+
+        /* Four words per iteration, unrolled to cut the loop overhead. GCC may merge the stores
+         * into an STM, but nothing relies on it */
+        wp = (word_t *)p;
+        for (; n >= 4 * WORD_SIZE; n -= 4 * WORD_SIZE) {
+            wp[0] = w;
+            wp[1] = w;
+            wp[2] = w;
+            wp[3] = w;
+            wp += 4;
+        }
+        for (; n >= WORD_SIZE; n -= WORD_SIZE)
+            *wp++ = w;
+        p = (unsigned char *)wp;
+    }
 
     while (n) {
         *p++ = c;
@@ -14,8 +64,53 @@ void *memset(void *s, int c, size_t n)
 
 void *memcpy(void *dest, const void *src, size_t n)
 {
-    const char *s = src;
-    char *d = dest;
+    const unsigned char *s = src;
+    unsigned char *d = dest;
+
+    if (n >= WORD_THRESHOLD) {
+        word_t *dw;
+
+        while (!is_word_aligned(d)) {
+            *d++ = *s++;
+            n--;
+        }
+
+        dw = (word_t *)d;
+        if (is_word_aligned(s)) {
+            const word_t *sw = (const word_t *)s;
+
+            /* Four words per iteration, loads ahead of the stores. Whether these become LDM/STM
+             * depends on the compiler, the loop doesn't rely on it */
+            for (; n >= 4 * WORD_SIZE; n -= 4 * WORD_SIZE) {
+                word_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+                dw[0] = w0;
+                dw[1] = w1;
+                dw[2] = w2;
+                dw[3] = w3;
+                sw += 4;
+                dw += 4;
+            }
+            for (; n >= WORD_SIZE; n -= WORD_SIZE)
+                *dw++ = *sw++;
+            s = (const unsigned char *)sw;
+        } else {
+            /* The ARM926 can't load unaligned words, so aligned source words are shifted
+             * into place. The last load may read past src + n, but never past its word */
+            unsigned int shift = ((uintptr_t)s & WORD_MASK) * 8;
+            const word_t *sw = (const word_t *)((uintptr_t)s & ~WORD_MASK);
+            word_t prev = *sw++;
+            size_t words = n / WORD_SIZE;
+
+            for (size_t i = 0; i < words; i++) {
+                word_t next = *sw++;
+                *dw++ = merge_words(prev, next, shift);
+                prev = next;
+            }
+            s += words * WORD_SIZE;
+            n -= words * WORD_SIZE;
+        }
+        d = (unsigned char *)dw;
+    }
 
     while (n) {
         *d++ = *s++;
@@ -27,11 +122,36 @@ void *memcpy(void *dest, const void *src, size_t n)
 
 int memcmp(const void *s1, const void *s2, size_t n)
 {
+    const unsigned char *p1 = s1;
+    const unsigned char *p2 = s2;
     unsigned char u1, u2;
 
-    for (; n--; s1++, s2++) {
-        u1 = *(unsigned char *)s1;
-        u2 = *(unsigned char *)s2;
+    /* Skip the equal words, the bytes of the first differing one are compared below so that
+     * the result doesn't depend on endianness */
+    if (n >= WORD_THRESHOLD && ((uintptr_t)p1 & WORD_MASK) == ((uintptr_t)p2 & WORD_MASK)) {
+        const word_t *w1, *w2;
+
+        while (!is_word_aligned(p1)) {
+            if (*p1 != *p2)
+                return *p1 - *p2;
+            p1++;
+            p2++;
+            n--;
+        }
+
+        w1 = (const word_t *)p1;
+        w2 = (const word_t *)p2;
+        for (; n >= WORD_SIZE && *w1 == *w2; n -= WORD_SIZE) {
+            w1++;
+            w2++;
+        }
+        p1 = (const unsigned char *)w1;
+        p2 = (const unsigned char *)w2;
+    }
+
+    for (; n--; p1++, p2++) {
+        u1 = *p1;
+        u2 = *p2;
         if (u1 != u2)
             return u1 - u2;
     }
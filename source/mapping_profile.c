@@ -0,0 +1,438 @@
+#include <string.h>
+
+#include "mapping_profile.h"
+#include "button_map.h"
+#include "ipc.h"
+#include "wiimote.h"
+
+const struct mapping_profile_t mapping_profile_default = {
+	.wiimote_button_map = {
+		[EGC_GAMEPAD_BUTTON_NORTH] = WIIMOTE_BUTTON_ONE,
+		[EGC_GAMEPAD_BUTTON_EAST] = WIIMOTE_BUTTON_B,
+		[EGC_GAMEPAD_BUTTON_SOUTH] = WIIMOTE_BUTTON_A,
+		[EGC_GAMEPAD_BUTTON_WEST] = WIIMOTE_BUTTON_TWO,
+		[EGC_GAMEPAD_BUTTON_DPAD_UP] = WIIMOTE_BUTTON_UP,
+		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = WIIMOTE_BUTTON_DOWN,
+		[EGC_GAMEPAD_BUTTON_DPAD_LEFT] = WIIMOTE_BUTTON_LEFT,
+		[EGC_GAMEPAD_BUTTON_DPAD_RIGHT] = WIIMOTE_BUTTON_RIGHT,
+		[EGC_GAMEPAD_BUTTON_START] = WIIMOTE_BUTTON_PLUS,
+		[EGC_GAMEPAD_BUTTON_BACK] = WIIMOTE_BUTTON_MINUS,
+		[EGC_GAMEPAD_BUTTON_LEFT_STICK] = WIIMOTE_BUTTON_HOME,
+	},
+	.nunchuk_button_map = {
+		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = NUNCHUK_BUTTON_C,
+		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = NUNCHUK_BUTTON_Z,
+	},
+	.nunchuk_analog_axis_map = {
+		[EGC_GAMEPAD_AXIS_LEFTX] = BM_NUNCHUK_ANALOG_AXIS_X,
+		[EGC_GAMEPAD_AXIS_LEFTY] = BM_NUNCHUK_ANALOG_AXIS_Y,
+	},
+	.classic_button_map = {
+		[EGC_GAMEPAD_BUTTON_NORTH] = CLASSIC_CTRL_BUTTON_X,
+		[EGC_GAMEPAD_BUTTON_EAST] = CLASSIC_CTRL_BUTTON_A,
+		[EGC_GAMEPAD_BUTTON_SOUTH] = CLASSIC_CTRL_BUTTON_B,
+		[EGC_GAMEPAD_BUTTON_WEST] = CLASSIC_CTRL_BUTTON_Y,
+		[EGC_GAMEPAD_BUTTON_DPAD_UP] = CLASSIC_CTRL_BUTTON_UP,
+		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = CLASSIC_CTRL_BUTTON_DOWN,
+		[EGC_GAMEPAD_BUTTON_DPAD_LEFT] = CLASSIC_CTRL_BUTTON_LEFT,
+		[EGC_GAMEPAD_BUTTON_DPAD_RIGHT] = CLASSIC_CTRL_BUTTON_RIGHT,
+		[EGC_GAMEPAD_BUTTON_START] = CLASSIC_CTRL_BUTTON_PLUS,
+		[EGC_GAMEPAD_BUTTON_BACK] = CLASSIC_CTRL_BUTTON_MINUS,
+		[EGC_GAMEPAD_BUTTON_RIGHT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZR,
+		[EGC_GAMEPAD_BUTTON_LEFT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZL,
+		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_R,
+		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_L,
+		[EGC_GAMEPAD_BUTTON_LEFT_STICK] = CLASSIC_CTRL_BUTTON_HOME,
+	},
+	.classic_analog_axis_map = {
+		[EGC_GAMEPAD_AXIS_LEFTX] = BM_CLASSIC_ANALOG_AXIS_LEFT_X,
+		[EGC_GAMEPAD_AXIS_LEFTY] = BM_CLASSIC_ANALOG_AXIS_LEFT_Y,
+		[EGC_GAMEPAD_AXIS_RIGHTX] = BM_CLASSIC_ANALOG_AXIS_RIGHT_X,
+		[EGC_GAMEPAD_AXIS_RIGHTY] = BM_CLASSIC_ANALOG_AXIS_RIGHT_Y,
+		[EGC_GAMEPAD_AXIS_LEFT_TRIGGER] = BM_CLASSIC_ANALOG_AXIS_LEFT_TRIGGER,
+		[EGC_GAMEPAD_AXIS_RIGHT_TRIGGER] = BM_CLASSIC_ANALOG_AXIS_RIGHT_TRIGGER,
+	},
+	.wiiu_pro_button_map = {
+		[EGC_GAMEPAD_BUTTON_NORTH] = CLASSIC_CTRL_BUTTON_X,
+		[EGC_GAMEPAD_BUTTON_EAST] = CLASSIC_CTRL_BUTTON_A,
+		[EGC_GAMEPAD_BUTTON_SOUTH] = CLASSIC_CTRL_BUTTON_B,
+		[EGC_GAMEPAD_BUTTON_WEST] = CLASSIC_CTRL_BUTTON_Y,
+		[EGC_GAMEPAD_BUTTON_DPAD_UP] = CLASSIC_CTRL_BUTTON_UP,
+		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = CLASSIC_CTRL_BUTTON_DOWN,
+		[EGC_GAMEPAD_BUTTON_DPAD_LEFT] = CLASSIC_CTRL_BUTTON_LEFT,
+		[EGC_GAMEPAD_BUTTON_DPAD_RIGHT] = CLASSIC_CTRL_BUTTON_RIGHT,
+		[EGC_GAMEPAD_BUTTON_START] = CLASSIC_CTRL_BUTTON_PLUS,
+		[EGC_GAMEPAD_BUTTON_BACK] = CLASSIC_CTRL_BUTTON_MINUS,
+		[EGC_GAMEPAD_BUTTON_GUIDE] = CLASSIC_CTRL_BUTTON_HOME,
+		[EGC_GAMEPAD_BUTTON_RIGHT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZR,
+		[EGC_GAMEPAD_BUTTON_LEFT_PADDLE1] = CLASSIC_CTRL_BUTTON_ZL,
+		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_R,
+		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = CLASSIC_CTRL_BUTTON_FULL_L,
+		[EGC_GAMEPAD_BUTTON_LEFT_STICK] = WIIU_PRO_BUTTON_LEFT_STICK << BM_WIIU_PRO_BUTTON_SHIFT,
+		[EGC_GAMEPAD_BUTTON_RIGHT_STICK] = WIIU_PRO_BUTTON_RIGHT_STICK << BM_WIIU_PRO_BUTTON_SHIFT,
+	},
+	/* Same layout as the guitar games on pads */
+	.guitar_button_map = {
+		[EGC_GAMEPAD_BUTTON_SOUTH] = GUITAR_BUTTON_GREEN,
+		[EGC_GAMEPAD_BUTTON_EAST] = GUITAR_BUTTON_RED,
+		[EGC_GAMEPAD_BUTTON_NORTH] = GUITAR_BUTTON_YELLOW,
+		[EGC_GAMEPAD_BUTTON_WEST] = GUITAR_BUTTON_BLUE,
+		[EGC_GAMEPAD_BUTTON_LEFT_SHOULDER] = GUITAR_BUTTON_ORANGE,
+		[EGC_GAMEPAD_BUTTON_DPAD_UP] = GUITAR_BUTTON_STRUM_UP,
+		[EGC_GAMEPAD_BUTTON_DPAD_DOWN] = GUITAR_BUTTON_STRUM_DOWN,
+		[EGC_GAMEPAD_BUTTON_START] = GUITAR_BUTTON_PLUS,
+		[EGC_GAMEPAD_BUTTON_BACK] = GUITAR_BUTTON_MINUS,
+		[EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER] = BM_GUITAR_BUTTON_TILT,
+	},
+	.guitar_analog_axis_map = {
+		[EGC_GAMEPAD_AXIS_LEFTX] = BM_GUITAR_ANALOG_AXIS_STICK_X,
+		[EGC_GAMEPAD_AXIS_LEFTY] = BM_GUITAR_ANALOG_AXIS_STICK_Y,
+		[EGC_GAMEPAD_AXIS_RIGHTX] = BM_GUITAR_ANALOG_AXIS_TOUCH_BAR,
+		[EGC_GAMEPAD_AXIS_RIGHT_TRIGGER] = BM_GUITAR_ANALOG_AXIS_WHAMMY,
+	},
+	.ir_analog_axis_map = {
+		[EGC_GAMEPAD_AXIS_RIGHTX] = BM_IR_AXIS_X,
+		[EGC_GAMEPAD_AXIS_RIGHTY] = BM_IR_AXIS_Y,
+	},
+	.ir_distance = BM_IR_DEFAULT_DISTANCE,
+	.ir_gyro_sensitivity = BM_IR_GYRO_DEFAULT_SENSITIVITY,
+	/* A small deadzone hides the drift of worn sticks */
+	.stick_configs = {
+		[BM_STICK_NUNCHUK] = { .deadzone = 8, .saturation = 95, .octagon_gate = true },
+		[BM_STICK_CLASSIC_LEFT] = { .deadzone = 8, .saturation = 95 },
+		[BM_STICK_CLASSIC_RIGHT] = { .deadzone = 8, .saturation = 95 },
+	},
+	.switch_extension_combo = BIT(EGC_GAMEPAD_BUTTON_LEFT_STICK) |
+				  BIT(EGC_GAMEPAD_BUTTON_LEFT_SHOULDER),
+	.switch_ir_emu_mode_combo = BIT(EGC_GAMEPAD_BUTTON_RIGHT_STICK) |
+				    BIT(EGC_GAMEPAD_BUTTON_RIGHT_SHOULDER),
+	/* Shares no button with the switch combos, and Wii games rarely need + and - together */
+	.ir_recenter_combo = BIT(EGC_GAMEPAD_BUTTON_START) | BIT(EGC_GAMEPAD_BUTTON_BACK),
+	.extension_rotation = {
+		WIIMOTE_EXT_NUNCHUK,
+		WIIMOTE_EXT_CLASSIC,
+		WIIMOTE_EXT_CLASSIC_WIIU_PRO,
+		WIIMOTE_EXT_GUITAR,
+		WIIMOTE_EXT_NONE,
+	},
+	.num_extension_rotation = 5,
+	.default_extension = WIIMOTE_EXT_NUNCHUK,
+	.motion_orientation = BM_MOTION_ORIENTATION_POINTING,
+	/* The Wiimote reports the same either way, and Nunchuk shakes work out of the box */
+	.motion_route = BM_MOTION_ROUTE_BOTH,
+};
+
+static struct mapping_profile_t profiles[MAPPING_PROFILES_MAX];
+static int num_profiles;
+
+/* Title index, sorted by game_id so that it can be binary searched */
+static struct {
+    u32 game_id;
+    u8 profile;
+} titles[MAPPING_TITLES_MAX];
+static int num_titles;
+
+static inline u16 get_be16(const u8 *p)
+{
+    return ((u16)p[0] << 8) | p[1];
+}
+
+static inline u32 get_be32(const u8 *p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static inline bool combo_is_valid(u32 combo)
+{
+    return (combo & ~(BIT(EGC_GAMEPAD_BUTTON_COUNT) - 1)) == 0;
+}
+
+bool extension_is_valid(u8 extension)
+{
+    switch (extension) {
+    case WIIMOTE_EXT_NONE:
+    case WIIMOTE_EXT_NUNCHUK:
+    case WIIMOTE_EXT_CLASSIC:
+    case WIIMOTE_EXT_CLASSIC_WIIU_PRO:
+    case WIIMOTE_EXT_GUITAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int apply_binding(struct mapping_profile_t *profile, const u8 binding[static 4])
+{
+    u8 target = binding[0];
+    u8 source = binding[1];
+    u16 value = get_be16(&binding[2]);
+
+    switch (target) {
+    case MAPPING_PROFILE_TARGET_WIIMOTE_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT || (value & ~WIIMOTE_BUTTON_ALL))
+            return IOS_EINVAL;
+        profile->wiimote_button_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_NUNCHUK_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT ||
+            (value & ~(NUNCHUK_BUTTON_C | NUNCHUK_BUTTON_Z)))
+            return IOS_EINVAL;
+        profile->nunchuk_button_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_CLASSIC_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT || (value & ~CLASSIC_CTRL_BUTTON_ALL))
+            return IOS_EINVAL;
+        profile->classic_button_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_WIIU_PRO_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT || (value & ~CLASSIC_CTRL_BUTTON_ALL))
+            return IOS_EINVAL;
+        profile->wiiu_pro_button_map[source] &= ~0xFFFF;
+        profile->wiiu_pro_button_map[source] |= value;
+        break;
+    case MAPPING_PROFILE_TARGET_WIIU_PRO_STICK_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT || (value & ~WIIU_PRO_BUTTON_ALL))
+            return IOS_EINVAL;
+        profile->wiiu_pro_button_map[source] &= 0xFFFF;
+        profile->wiiu_pro_button_map[source] |= (u32)value << BM_WIIU_PRO_BUTTON_SHIFT;
+        break;
+    case MAPPING_PROFILE_TARGET_GUITAR_BUTTON:
+        if (source >= EGC_GAMEPAD_BUTTON_COUNT ||
+            (value & ~(GUITAR_BUTTON_ALL | BM_GUITAR_BUTTON_TILT)))
+            return IOS_EINVAL;
+        profile->guitar_button_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_NUNCHUK_AXIS:
+        if (source >= EGC_GAMEPAD_AXIS_COUNT || value > BM_NUNCHUK_ANALOG_AXIS__NUM)
+            return IOS_EINVAL;
+        profile->nunchuk_analog_axis_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_CLASSIC_AXIS:
+        if (source >= EGC_GAMEPAD_AXIS_COUNT || value > BM_CLASSIC_ANALOG_AXIS__NUM)
+            return IOS_EINVAL;
+        profile->classic_analog_axis_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_IR_AXIS:
+        if (source >= EGC_GAMEPAD_AXIS_COUNT || value > BM_IR_AXIS__NUM)
+            return IOS_EINVAL;
+        profile->ir_analog_axis_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_GUITAR_AXIS:
+        if (source >= EGC_GAMEPAD_AXIS_COUNT || value > BM_GUITAR_ANALOG_AXIS__NUM)
+            return IOS_EINVAL;
+        profile->guitar_analog_axis_map[source] = value;
+        break;
+    case MAPPING_PROFILE_TARGET_STICK_DEADZONE:
+    case MAPPING_PROFILE_TARGET_STICK_ANTI_DEADZONE:
+    case MAPPING_PROFILE_TARGET_STICK_SATURATION:
+    case MAPPING_PROFILE_TARGET_STICK_CURVE:
+        /* The combination is checked once all the bindings are applied */
+        if (source >= BM_STICK__NUM || value > 100)
+            return IOS_EINVAL;
+        if (target == MAPPING_PROFILE_TARGET_STICK_DEADZONE)
+            profile->stick_configs[source].deadzone = value;
+        else if (target == MAPPING_PROFILE_TARGET_STICK_ANTI_DEADZONE)
+            profile->stick_configs[source].anti_deadzone = value;
+        else if (target == MAPPING_PROFILE_TARGET_STICK_SATURATION)
+            profile->stick_configs[source].saturation = value;
+        else
+            profile->stick_configs[source].curve = value;
+        break;
+    case MAPPING_PROFILE_TARGET_STICK_OCTAGON_GATE:
+        if (source >= BM_STICK__NUM || value > 1)
+            return IOS_EINVAL;
+        profile->stick_configs[source].octagon_gate = value;
+        break;
+    case MAPPING_PROFILE_TARGET_EXTENSION_ROTATION:
+        if (source >= MAPPING_EXTENSIONS_MAX || !extension_is_valid(value))
+            return IOS_EINVAL;
+        /* Position 0 replaces the inherited list, the others append to it */
+        if (source == 0)
+            profile->num_extension_rotation = 0;
+        else if (source != profile->num_extension_rotation)
+            return IOS_EINVAL;
+        profile->extension_rotation[source] = value;
+        profile->num_extension_rotation++;
+        break;
+    case MAPPING_PROFILE_TARGET_IR_DISTANCE:
+        if (source != 0 || value < BM_IR_MIN_DISTANCE || value > BM_IR_MAX_DISTANCE)
+            return IOS_EINVAL;
+        profile->ir_distance = value;
+        break;
+    case MAPPING_PROFILE_TARGET_IR_GYRO_SENSITIVITY:
+        if (source != 0 || value == 0 || value > BM_IR_GYRO_MAX_SENSITIVITY)
+            return IOS_EINVAL;
+        profile->ir_gyro_sensitivity = value;
+        break;
+    case MAPPING_PROFILE_TARGET_MOTION_ROUTE:
+        if (source != 0 || value > BM_MOTION_ROUTE_SPLIT)
+            return IOS_EINVAL;
+        profile->motion_route = value;
+        break;
+    default:
+        return IOS_EINVAL;
+    }
+
+    return 0;
+}
+
+static inline bool stick_config_is_valid(const struct bm_stick_config_t *config)
+{
+    return config->deadzone < config->saturation && config->anti_deadzone < 100;
+}
+
+/* Parses one profile at data, returns the number of bytes consumed or IOS_EINVAL */
+static int parse_profile(struct mapping_profile_t *profile, const u8 *data, u32 size, u8 version)
+{
+    u8 default_extension, num_bindings, flags, motion_orientation;
+    u32 length;
+    int ret;
+
+    if (size < MAPPING_PROFILE_HEADER_SIZE)
+        return IOS_EINVAL;
+
+    default_extension = data[0];
+    num_bindings = data[1];
+    flags = data[2];
+    motion_orientation = (version > 1) ? data[3] : BM_MOTION_ORIENTATION_POINTING;
+    length = MAPPING_PROFILE_HEADER_SIZE + num_bindings * MAPPING_PROFILE_BINDING_SIZE;
+    if (size < length)
+        return IOS_EINVAL;
+
+    if (!extension_is_valid(default_extension))
+        return IOS_EINVAL;
+
+    if (motion_orientation > BM_MOTION_ORIENTATION_UPRIGHT)
+        return IOS_EINVAL;
+
+    if (flags & MAPPING_PROFILE_FLAG_INHERIT_DEFAULT) {
+        *profile = mapping_profile_default;
+    } else {
+        memset(profile, 0, sizeof(*profile));
+        /* Settings that aren't mappings keep their defaults unless bound */
+        memcpy(profile->stick_configs, mapping_profile_default.stick_configs,
+               sizeof(profile->stick_configs));
+        profile->ir_distance = mapping_profile_default.ir_distance;
+        profile->ir_gyro_sensitivity = mapping_profile_default.ir_gyro_sensitivity;
+        profile->motion_route = mapping_profile_default.motion_route;
+        /* Rotation entries replace it from position 0 */
+        memcpy(profile->extension_rotation, mapping_profile_default.extension_rotation,
+               sizeof(profile->extension_rotation));
+        profile->num_extension_rotation = mapping_profile_default.num_extension_rotation;
+    }
+
+    profile->default_extension = default_extension;
+    profile->motion_orientation = motion_orientation;
+    profile->switch_extension_combo = get_be32(&data[4]);
+    profile->switch_ir_emu_mode_combo = get_be32(&data[8]);
+    profile->ir_recenter_combo = get_be32(&data[12]);
+    if (!combo_is_valid(profile->switch_extension_combo) ||
+        !combo_is_valid(profile->switch_ir_emu_mode_combo) ||
+        !combo_is_valid(profile->ir_recenter_combo))
+        return IOS_EINVAL;
+
+    data += MAPPING_PROFILE_HEADER_SIZE;
+    for (int i = 0; i < num_bindings; i++) {
+        ret = apply_binding(profile, &data[i * MAPPING_PROFILE_BINDING_SIZE]);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (int i = 0; i < BM_STICK__NUM; i++) {
+        if (!stick_config_is_valid(&profile->stick_configs[i]))
+            return IOS_EINVAL;
+    }
+
+    return length;
+}
+
+static int parse_titles(const u8 *data, u32 size, int count, int profile_count)
+{
+    u32 prev_game_id = 0;
+
+    if (count > MAPPING_TITLES_MAX || size != count * MAPPING_TITLE_SIZE)
+        return IOS_EINVAL;
+
+    for (int i = 0; i < count; i++) {
+        const u8 *entry = &data[i * MAPPING_TITLE_SIZE];
+        u32 game_id = get_be32(&entry[0]);
+
+        /* Strictly ascending, which also rules out duplicates */
+        if ((i > 0 && game_id <= prev_game_id) || entry[4] >= profile_count)
+            return IOS_EINVAL;
+
+        titles[i].game_id = game_id;
+        titles[i].profile = entry[4];
+        prev_game_id = game_id;
+    }
+
+    return 0;
+}
+
+int mapping_profiles_load(const u8 *data, u32 size)
+{
+    u32 offset = MAPPING_PROFILE_FILE_HEADER_SIZE;
+    int count, title_count;
+    u8 version;
+    int ret;
+
+    num_profiles = 0;
+    num_titles = 0;
+
+    if (size < MAPPING_PROFILE_FILE_HEADER_SIZE || get_be32(&data[0]) != MAPPING_PROFILES_MAGIC)
+        return IOS_EINVAL;
+
+    version = data[4];
+    if (version < 1 || version > MAPPING_PROFILES_VERSION)
+        return IOS_EINVAL;
+
+    count = data[5];
+    if (count > MAPPING_PROFILES_MAX)
+        return IOS_EINVAL;
+    title_count = (version > 1) ? data[6] : 0;
+
+    for (int i = 0; i < count; i++) {
+        ret = parse_profile(&profiles[i], &data[offset], size - offset, version);
+        if (ret < 0)
+            return ret;
+        offset += ret;
+    }
+
+    /* The title index takes the rest of the file */
+    ret = parse_titles(&data[offset], size - offset, title_count, count);
+    if (ret < 0)
+        return ret;
+
+    num_profiles = count;
+    num_titles = title_count;
+    return count;
+}
+
+int mapping_profiles_count(void)
+{
+    return num_profiles;
+}
+
+const struct mapping_profile_t *mapping_profile_get(int index)
+{
+    if (index < 0 || index >= num_profiles)
+        return &mapping_profile_default;
+    return &profiles[index];
+}
+
+const struct mapping_profile_t *mapping_profile_find_title(u32 game_id)
+{
+    int lo = 0, hi = num_titles - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (titles[mid].game_id == game_id)
+            return &profiles[titles[mid].profile];
+        else if (titles[mid].game_id < game_id)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,35 @@
+#include <string.h>
+
+#include "profile.h"
+#include "utils.h"
+
+static struct fakemote_profile_t profile;
+
+void profile_reset(void)
+{
+    memset(&profile, 0, sizeof(profile));
+}
+
+void profile_record(enum fakemote_profile_stage_e stage, u32 ticks)
+{
+    struct fakemote_profile_stage_t *s = &profile.stages[stage];
+    u32 bucket = 0;
+
+    /* floor(log2(ticks)), without a CLZ in Thumb */
+    for (u32 t = ticks >> 1; t && (bucket < FAKEMOTE_PROFILE_NUM_BUCKETS - 1); t >>= 1)
+        bucket++;
+
+    if (!s->count || (ticks < s->min))
+        s->min = ticks;
+    if (ticks > s->max)
+        s->max = ticks;
+    s->count++;
+    s->total += ticks;
+    s->histogram[bucket]++;
+}
+
+int profile_get(struct fakemote_profile_t *out)
+{
+    memcpy(out, &profile, sizeof(profile));
+    return IOS_OK;
+}
@@ -14,6 +14,9 @@
 
 typedef u8 sbox_t[256];
 
+/* Extension data is encrypted in place a word at a time, through u8 buffers */
+typedef u32 __attribute__((__may_alias__)) word_t;
+
 static const sbox_t keygen_sbox_1st_party = {
     0x70, 0x51, 0x03, 0x86, 0x40, 0x0d, 0x4f, 0xeb, 0x3e, 0xcc, 0xd1, 0x87, 0x35, 0xbd, 0xf5, 0x0b,
     0x5e, 0xd0, 0xf8, 0xf2, 0xd5, 0xe2, 0x6c, 0x31, 0x0c, 0xad, 0xfc, 0x21, 0xc3, 0x78, 0xc1, 0x06,
@@ -240,6 +243,17 @@ static void generate_tables(u8 ft[static 8], u8 sb[static 8], u8 rand[static 10]
     sb[7] = sbox_a[rand[2]] ^ sbox_b[rand[6]];
 }
 
+/* Games tend to write the same key material (often all zeros) on every extension setup, so
+ * the last few derived keys are kept around. Entries are replaced round-robin */
+#define KEY_CACHE_SIZE 4
+
+static struct {
+    u8 key_data[16];
+    struct wiimote_encryption_key_t key;
+    bool valid;
+} key_cache[KEY_CACHE_SIZE];
+static u8 key_cache_next;
+
 void wiimote_crypto_generate_key_from_extension_key_data(struct wiimote_encryption_key_t *ext_key,
                                                          const u8 key_data[static 16])
 {
@@ -247,6 +261,14 @@ void wiimote_crypto_generate_key_from_extension_key_data(struct wiimote_encrypti
     u8 key[6], check_key[6];
     u32 idx;
 
+    for (int i = 0; i < KEY_CACHE_SIZE; i++) {
+        if (key_cache[i].valid &&
+            memcmp(key_cache[i].key_data, key_data, sizeof(key_cache[i].key_data)) == 0) {
+            *ext_key = key_cache[i].key;
+            return;
+        }
+    }
+
     reverse_memcpy(rand, key_data, sizeof(rand));
     reverse_memcpy(key, key_data + sizeof(rand), sizeof(key));
 
@@ -257,13 +279,63 @@ void wiimote_crypto_generate_key_from_extension_key_data(struct wiimote_encrypti
             break;
     }
 
-    generate_tables(ext_key->ft, ext_key->sb, rand, key, sboxes_1st_party[idx],
-                    sboxes_1st_party[idx + 1]);
+    if (idx == 7) {
+        /* No first-party key matched: homebrew's all-zero key, whose tables are 0x17 throughout.
+         * Its second sbox isn't in the table, so other unmatched keys get the same tables
+         * rather than a read past its end */
+        memset(ext_key->ft, 0x17, sizeof(ext_key->ft));
+        memset(ext_key->sb, 0x17, sizeof(ext_key->sb));
+    } else {
+        generate_tables(ext_key->ft, ext_key->sb, rand, key, sboxes_1st_party[idx],
+                        sboxes_1st_party[idx + 1]);
+    }
+
+    memcpy(key_cache[key_cache_next].key_data, key_data, sizeof(key_cache[0].key_data));
+    key_cache[key_cache_next].key = *ext_key;
+    key_cache[key_cache_next].valid = true;
+    key_cache_next = (key_cache_next + 1) % KEY_CACHE_SIZE;
+}
+
+/* Byte-wise (d - f) ^ s on four lanes at once, the borrows don't cross lane boundaries */
+static inline u32 encrypt_word(u32 d, u32 f, u32 s)
+{
+    const u32 h = 0x80808080;
+    return (((d | h) - (f & ~h)) ^ ((d ^ ~f) & h)) ^ s;
 }
 
 void wiimote_crypto_encrypt(u8 *data, const struct wiimote_encryption_key_t *key, u32 addr,
                             u32 size)
 {
-    for (u32 i = 0; i < size; ++i, ++addr)
+    union {
+        u8 b[8];
+        u32 w[2];
+    } ft, sb;
+    word_t *words;
+    u32 num_words;
+    u32 i = 0;
+
+    /* Head bytes, up to the first aligned word */
+    for (; i < size && ((uintptr_t)&data[i] & 3); ++i, ++addr)
+        data[i] = (data[i] - key->ft[addr % 8]) ^ key->sb[addr % 8];
+
+    num_words = (size - i) / 4;
+    if (num_words > 0) {
+        /* Keystream rotated to the current address, loaded the same way as the data so that
+         * the lanes line up regardless of endianness */
+        for (int j = 0; j < 8; j++) {
+            ft.b[j] = key->ft[(addr + j) % 8];
+            sb.b[j] = key->sb[(addr + j) % 8];
+        }
+
+        words = (word_t *)&data[i];
+        for (u32 n = 0; n < num_words; n++)
+            words[n] = encrypt_word(words[n], ft.w[n & 1], sb.w[n & 1]);
+
+        i += num_words * 4;
+        addr += num_words * 4;
+    }
+
+    /* Tail bytes */
+    for (; i < size; ++i, ++addr)
         data[i] = (data[i] - key->ft[addr % 8]) ^ key->sb[addr % 8];
 }